@@ -27,6 +27,25 @@ typedef struct MEM_Storage_tag {
 }*MEM_Storage;
 
 
+/* 分配统计 */
+typedef struct {
+    unsigned long       alloc_count;    /* MEM_malloc/MEM_realloc/MEM_strdup调用次数 */
+    unsigned long       alloc_bytes;    /* 累计申请的字节数 */
+} MEM_Stats;
+
+
+/*
+ * 内存预算：设置到线程上后，该线程经MEM分配的内存计入used。
+ * 每块内存记下计入的预算，不论在哪个线程、何时释放，都只从这个预算中扣回，
+ * 所以预算须在计入它的内存全部释放之后才能销毁。
+ * MEM层只计数，是否超过limit由使用者在安全的位置检查
+ */
+typedef struct MEM_Budget_tag {
+    size_t              limit;
+    long                used;           /* 多个线程共享同一预算，原子地增减 */
+} MEM_Budget;
+
+
 #define MEM_malloc(size) (MEM_malloc_func(__FILE__, __LINE__, size))
 #define MEM_realloc(ptr, size) (MEM_realloc_func(__FILE__, __LINE__, ptr, size))
 #define MEM_strdup(str) (MEM_strdup_func(__FILE__, __LINE__, str))
@@ -42,6 +61,8 @@ MEM_Storage MEM_open_storage_func(char *filename, int line, int page_size);
 void *MEM_storage_malloc_func(char *filename, int line, MEM_Storage storage, size_t size);
 void MEM_free(void *ptr);
 void MEM_dispose_storage(MEM_Storage storage);
+void MEM_get_stats(MEM_Stats *stats);
+MEM_Budget *MEM_set_budget(MEM_Budget *budget);
 
 #endif  /* PUBLIC_MEM_H */
 
@@ -5,10 +5,38 @@
 
 typedef struct SCP_Interpreter_tag SCP_Interpreter;
 
+typedef enum {
+    SCP_COMPILE_ERROR = 1,
+    SCP_RUNTIME_ERROR
+} SCP_ErrorType;
+
+/* 编译或执行出错时交给宿主的错误，在下一次SCP_compile或SCP_interpret之前有效 */
+typedef struct {
+    SCP_ErrorType       type;
+    int                 code;           /* 编译错误或运行错误的编号 */
+    int                 line_number;
+    char                *message;
+} SCP_Error;
+
 
 SCP_Interpreter *SCP_create_interpreter(void);
-void SCP_compile(SCP_Interpreter *interpreter, FILE *fp);
-void SCP_interpret(SCP_Interpreter *interpreter);
+SCP_Error *SCP_compile(SCP_Interpreter *interpreter, FILE *fp);
+SCP_Error *SCP_interpret(SCP_Interpreter *interpreter);
+void SCP_enable_profile(SCP_Interpreter *interpreter, char *script_path);
+void SCP_disable_jit(SCP_Interpreter *interpreter);
+void SCP_dump_types(SCP_Interpreter *interpreter, FILE *out);
+void SCP_set_stack_limit(SCP_Interpreter *interpreter, int megabytes);
+void SCP_set_fuel(SCP_Interpreter *interpreter, long fuel);
+void SCP_set_time_limit(SCP_Interpreter *interpreter, double seconds);
+void SCP_set_memory_limit(SCP_Interpreter *interpreter, int megabytes);
+void SCP_set_cache_dir(SCP_Interpreter *interpreter, char *directory);
+void SCP_enable_lazy(SCP_Interpreter *interpreter);
+void SCP_enable_tree_shake(SCP_Interpreter *interpreter, FILE *report);
 void SCP_dispose_interpreter(SCP_Interpreter *interpreter);
+int SCP_serve(SCP_Interpreter *interpreter, char *path);
+int SCP_run_client(char *path);
+int SCP_restore_snapshot(SCP_Interpreter *interpreter, char *path);
+void SCP_set_input(SCP_Interpreter *interpreter, char *input);
+int SCP_run_batch(SCP_Interpreter *interpreter, int jobs, int count, char **inputs);
 
 #endif /* PUBLIC_SCP_H_INCLUDED */
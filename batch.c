@@ -0,0 +1,184 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+/*
+ * 批量执行（-j N）：脚本只编译一次，对输入列表中的每一项fork一个子进程执行，
+ * 同时运行的子进程不超过N个。子进程与父进程写时复制地共享编译好的程序，
+ * 通过全局变量INPUT取得自己的输入，标准输出写入各自的临时文件，
+ * 父进程按输入的顺序依次把输出转写到标准输出。
+ */
+
+#define BATCH_COPY_BUFFER_SIZE  (8192)
+#define BATCH_WINDOW_FACTOR     (4)     /* 已开始而尚未输出的输入至多为jobs的几倍 */
+
+/* 设置下次执行时全局变量INPUT的值，input须保留到执行结束，为NULL时不定义INPUT */
+void SCP_set_input(SCP_Interpreter *interpreter, char *input)
+{
+    interpreter->input = input;
+}
+
+/* 执行开始时定义全局变量INPUT，字符串不复制，随全局变量一起释放 */
+void scp_add_input(SCP_Interpreter *inter)
+{
+    SCP_String *str = MEM_storage_malloc(inter->execute_storage, sizeof(SCP_String));
+    SCP_Value value;
+
+    str->ref_count = 1;
+    str->is_literal = SCP_TRUE;
+    str->is_shared = SCP_FALSE;
+    str->string = inter->input;
+    str->length = strlen(inter->input);
+    str->capacity = str->length + 1;
+    value.type = SCP_STRING_VALUE;
+    value.u.string_value = str;
+    scp_add_global_variable(inter, "INPUT", &value);
+}
+
+/*
+ * 为一次执行fork子进程，返回值同fork。批量执行和--server共用。
+ * 父进程从不执行脚本，没有工作线程，fork总是安全的
+ */
+pid_t scp_fork(void)
+{
+    /* 子进程继承的缓冲区中不能有尚未写出的内容 */
+    fflush(NULL);
+    return fork();
+}
+
+/*
+ * 在scp_fork的子进程中执行脚本，出错时把错误写到标准错误，
+ * prefix不为NULL时加在行号之前。写出所有缓冲区后返回退出码
+ */
+int scp_run_child(SCP_Interpreter *interpreter, char *prefix)
+{
+    SCP_Error *error;
+    int status = 0;
+
+    error = SCP_interpret(interpreter);
+    if (error) {
+        if (prefix) {
+            fprintf(stderr, "%s:", prefix);
+        }
+        fprintf(stderr, "%3d:%s\n", error->line_number, error->message);
+        status = 1;
+    }
+    fflush(NULL);
+
+    return status;
+}
+
+/* 子进程：标准输出换成临时文件，以input执行脚本 */
+static void run_input(SCP_Interpreter *interpreter, char *input, FILE *out)
+{
+    dup2(fileno(out), 1);
+    fclose(out);
+    SCP_set_input(interpreter, input);
+    _exit(scp_run_child(interpreter, input));
+}
+
+/* 把子进程的输出转写到标准输出 */
+static void copy_output(FILE *out)
+{
+    char buffer[BATCH_COPY_BUFFER_SIZE];
+    size_t size;
+
+    rewind(out);
+    while ((size = fread(buffer, 1, sizeof(buffer), out)) > 0) {
+        fwrite(buffer, 1, size, stdout);
+    }
+    fclose(out);
+}
+
+/*
+ * 以jobs个子进程并行地对inputs中的每一项执行脚本，按输入的顺序输出。
+ * 全部成功时返回0，有执行出错的输入或不能等待子进程时返回1
+ */
+int SCP_run_batch(SCP_Interpreter *interpreter, int jobs, int count, char **inputs)
+{
+    FILE **out = MEM_malloc(sizeof(FILE *) * (count + 1));
+    pid_t *pids = MEM_malloc(sizeof(pid_t) * (count + 1));
+    SCP_Boolean *done = MEM_malloc(sizeof(SCP_Boolean) * (count + 1));
+    int next_start = 0, next_output = 0, running = 0;
+    int result = 0, status, i;
+    pid_t pid;
+
+    while (next_output < count) {
+        /*
+         * 结束的输入在前面的输入输出之前一直占着临时文件，
+         * 前面有很慢的输入时不能无限地开始新的输入，否则文件描述符会耗尽
+         */
+        while (running < jobs && next_start < count
+               && next_start - next_output < jobs * BATCH_WINDOW_FACTOR) {
+            i = next_start++;
+            done[i] = SCP_FALSE;
+            pids[i] = -1;
+            out[i] = tmpfile();
+            if (out[i] == NULL) {
+                fprintf(stderr, "%s: cannot create a temporary file (%s).\n",
+                        inputs[i], strerror(errno));
+                done[i] = SCP_TRUE;
+                result = 1;
+                continue;
+            }
+            pids[i] = scp_fork();
+            if (pids[i] == 0) {
+                run_input(interpreter, inputs[i], out[i]);
+            }
+            if (pids[i] < 0) {
+                fprintf(stderr, "%s: cannot fork (%s).\n", inputs[i], strerror(errno));
+                fclose(out[i]);
+                out[i] = NULL;
+                done[i] = SCP_TRUE;
+                result = 1;
+                continue;
+            }
+            running++;
+        }
+        if (running > 0) {
+            do {
+                pid = waitpid(-1, &status, 0);
+            } while (pid < 0 && errno == EINTR);
+            if (pid < 0) {
+                /* 不能再等待子进程：已开始的输入按出错结束，输出已写出的部分，不再开始新的输入 */
+                fprintf(stderr, "cannot wait for child processes (%s).\n", strerror(errno));
+                for (i = next_output; i < next_start; i++) {
+                    done[i] = SCP_TRUE;
+                }
+                running = 0;
+                count = next_start;
+                result = 1;
+            } else {
+                for (i = next_output; i < next_start && pids[i] != pid; i++)
+                    ;
+                if (i == next_start)
+                    continue;
+                done[i] = SCP_TRUE;
+                running--;
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    result = 1;
+                }
+            }
+        }
+        /* 前面的输入都已结束时才输出，保持输入的顺序 */
+        while (next_output < next_start && done[next_output]) {
+            if (out[next_output]) {
+                copy_output(out[next_output]);
+            }
+            next_output++;
+        }
+    }
+    fflush(stdout);
+    MEM_free(done);
+    MEM_free(pids);
+    MEM_free(out);
+
+    return result;
+}
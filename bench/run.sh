@@ -0,0 +1,98 @@
+#!/bin/sh
+# 运行bench/下的基准程序，报告运行时间的中位数和p95、峰值常驻内存和分配次数，并与基线比较。
+#
+# 用法: sh bench/run.sh [--baseline] [sicpy路径]
+#   --baseline          把本次结果写入bench/baseline.txt作为新的基线
+#   BENCH_RUNS          每个程序的运行次数，默认5
+#   BENCH_TOLERANCE     时间和内存相对基线允许增加的百分比，默认15
+#
+# 分配次数是确定的，只要比基线多就视为退化。有退化或没有基线时以状态1退出。
+# 程序在mktemp -d建立的临时目录中执行，读写的临时文件随目录一起删除。
+
+RUNS=${BENCH_RUNS:-5}
+TOLERANCE=${BENCH_TOLERANCE:-15}
+WRITE_BASELINE=0
+
+if [ "$1" = "--baseline" ]; then
+    WRITE_BASELINE=1
+    shift
+fi
+SICPY=${1:-./sicpy}
+SICPY="$(cd "$(dirname "$SICPY")" && pwd)/$(basename "$SICPY")"
+
+cd "$(dirname "$0")" || exit 1
+BENCH_DIR=$(pwd)
+BASELINE=baseline.txt
+RESULT=last.txt
+TIMES=$(mktemp)
+STATS=$(mktemp)
+WORK=$(mktemp -d)
+trap 'rm -f "$TIMES" "$STATS"; rm -rf "$WORK"' EXIT
+
+: > "$RESULT"
+printf "%-12s %10s %10s %12s %12s\n" "benchmark" "median_ms" "p95_ms" "peak_rss_kb" "allocations"
+for script in *.scp; do
+    name=${script%.scp}
+    : > "$TIMES"
+    peak_rss=0
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        start=$(date +%s%N)
+        if ! (cd "$WORK" && "$SICPY" --mem-stats "$BENCH_DIR/$script") > /dev/null 2> "$STATS"; then
+            echo "$name: sicpy failed" >&2
+            cat "$STATS" >&2
+            exit 1
+        fi
+        end=$(date +%s%N)
+        echo $(( (end - start) / 1000 )) >> "$TIMES"
+        rss=$(awk '$1 == "peak_rss_kb" { print $2 }' "$STATS")
+        [ "$rss" -gt "$peak_rss" ] && peak_rss=$rss
+        i=$((i + 1))
+    done
+    allocs=$(awk '$1 == "alloc_count" { print $2 }' "$STATS")
+    # 中位数和p95取排序后的最近秩
+    sort -n "$TIMES" | awk -v name="$name" -v rss="$peak_rss" -v allocs="$allocs" '
+        { t[NR] = $1 }
+        END {
+            median = t[int((NR + 1) / 2)]
+            p95 = t[int(NR * 0.95 + 0.999999)]
+            printf "%s %.2f %.2f %d %d\n", name, median / 1000, p95 / 1000, rss, allocs
+        }' >> "$RESULT"
+    tail -n 1 "$RESULT" | awk '{ printf "%-12s %10s %10s %12s %12s\n", $1, $2, $3, $4, $5 }'
+done
+
+if [ $WRITE_BASELINE -eq 1 ]; then
+    cp "$RESULT" "$BASELINE"
+    echo "baseline written to bench/$BASELINE"
+    exit 0
+fi
+if [ ! -f "$BASELINE" ]; then
+    echo "no bench/$BASELINE, run 'make bench-baseline' to create one" >&2
+    exit 1
+fi
+
+# 与基线逐项比较
+awk -v tolerance="$TOLERANCE" '
+    NR == FNR { median[$1] = $2; rss[$1] = $4; allocs[$1] = $5; next }
+    !($1 in median) { printf "%-12s not in baseline\n", $1; next }
+    {
+        limit = 1 + tolerance / 100
+        if ($2 > median[$1] * limit) {
+            printf "REGRESSION %s: median %.2f ms, baseline %.2f ms\n", $1, $2, median[$1]
+            failed = 1
+        }
+        if ($4 > rss[$1] * limit) {
+            printf "REGRESSION %s: peak rss %d kb, baseline %d kb\n", $1, $4, rss[$1]
+            failed = 1
+        }
+        if ($5 > allocs[$1]) {
+            printf "REGRESSION %s: %d allocations, baseline %d\n", $1, $5, allocs[$1]
+            failed = 1
+        }
+    }
+    END {
+        if (failed) {
+            exit 1
+        }
+        print "no regression against bench/baseline.txt"
+    }' "$BASELINE" "$RESULT"
@@ -0,0 +1,930 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+/*
+ * 预编译缓存：语法分析和各遍优化结束后，把程序（函数、顶层语句、字符串常量和行号）
+ * 写成.scpc文件，文件名为源码内容的散列值。之后对同样的源码不再进行词法和语法分析，
+ * 直接用mmap映射缓存文件，从中重建语法树。
+ * 文件由头部、32位字组成的语法树编码和字符串池三部分组成，语法树中引用字符串时
+ * 记录它在字符串池中的偏移，不含指针，无需重定位；标识符和字符串常量直接指向映射的内存，
+ * 映射保留到解释器销毁。写入时先写临时文件再改名，多个进程同时运行同一脚本也不会读到半个文件。
+ * --tree-shake时语法树之后还记录被摘除的函数名，装入时据此输出与编译时相同的报告。
+ */
+
+#define CACHE_MAGIC             "SCPC"
+#define CACHE_FORMAT_VERSION    (2)     /* 编码方式变化时增加 */
+/* 表达式和语句的种类数变化时旧的缓存同样失效 */
+#define CACHE_VERSION   (CACHE_FORMAT_VERSION * 65536 + EXPRESSION_TYPE_COUNT_PLUS_1 * 256\
+                         + STATEMENT_TYPE_COUNT_PLUS_1)
+#define CACHE_POOL_BUCKETS      (1024)
+
+typedef struct {
+    char            magic[4];
+    int             version;
+    unsigned long   hash;               /* 源码的散列值 */
+    unsigned long   source_length;
+    int             word_count;
+    int             pool_size;
+} CacheHeader;
+
+struct CompileCache_tag {
+    char            *directory;
+    char            *path;              /* 本次源码对应的缓存文件 */
+    size_t          source_length;
+    unsigned long   hash;
+    void            *map;               /* 装入的缓存文件的映射 */
+    size_t          map_size;
+};
+
+typedef struct PoolEntry_tag {
+    char                *string;
+    int                 offset;
+    struct PoolEntry_tag *next;
+} PoolEntry;
+
+typedef struct {
+    int             *words;
+    int             word_count;
+    int             word_alloc;
+    char            *pool;
+    int             pool_size;
+    int             pool_alloc;
+    PoolEntry       *bucket[CACHE_POOL_BUCKETS];
+    unsigned long   **loops;            /* 外层循环的激活编号，循环不变表达式据此记录所属循环 */
+    int             loop_depth;
+    int             loop_alloc;
+} CacheWriter;
+
+typedef struct {
+    int             *words;
+    int             word_count;
+    int             position;
+    char            *pool;
+    int             pool_size;
+    SCP_Boolean     error;
+    unsigned long   **loops;
+    int             loop_depth;
+    int             loop_alloc;
+} CacheReader;
+
+/* 源码的64位FNV-1a散列 */
+unsigned long scp_hash_source(char *source, size_t length)
+{
+    unsigned long hash = 0xcbf29ce484222325UL;
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        hash ^= (unsigned char)source[i];
+        hash *= 0x100000001b3UL;
+    }
+    return hash;
+}
+
+/* 设置缓存目录，之后的SCP_compile使用缓存 */
+void scp_create_compile_cache(SCP_Interpreter *inter, char *directory)
+{
+    CompileCache *cache = MEM_malloc(sizeof(CompileCache));
+
+    cache->directory = MEM_strdup(directory);
+    cache->path = NULL;
+    cache->source_length = 0;
+    cache->hash = 0;
+    cache->map = NULL;
+    cache->map_size = 0;
+    inter->compile_cache = cache;
+}
+
+static void push_loop(unsigned long ***loops, int *depth, int *alloc, unsigned long *epoch)
+{
+    if (*depth == *alloc) {
+        *alloc = *alloc ? *alloc * 2 : 16;
+        *loops = MEM_realloc(*loops, sizeof(unsigned long *) * *alloc);
+    }
+    (*loops)[(*depth)++] = epoch;
+}
+
+/* ---------------------------------------------------------------- 写入 */
+
+static void write_word(CacheWriter *w, int word)
+{
+    if (w->word_count == w->word_alloc) {
+        w->word_alloc = w->word_alloc ? w->word_alloc * 2 : 1024;
+        w->words = MEM_realloc(w->words, sizeof(int) * w->word_alloc);
+    }
+    w->words[w->word_count++] = word;
+}
+
+/* 写入字符串在池中的偏移，相同的字符串只存一份；NULL记为-1 */
+static void write_string(CacheWriter *w, char *string)
+{
+    PoolEntry *entry;
+    unsigned int index;
+    int length;
+
+    if (string == NULL) {
+        write_word(w, -1);
+        return;
+    }
+    length = strlen(string);
+    index = scp_hash_string(string, length) % CACHE_POOL_BUCKETS;
+    for (entry = w->bucket[index]; entry; entry = entry->next) {
+        if (!strcmp(entry->string, string)) {
+            write_word(w, entry->offset);
+            return;
+        }
+    }
+    while (w->pool_size + length + 1 > w->pool_alloc) {
+        w->pool_alloc = w->pool_alloc ? w->pool_alloc * 2 : 4096;
+        w->pool = MEM_realloc(w->pool, w->pool_alloc);
+    }
+    entry = MEM_malloc(sizeof(PoolEntry));
+    entry->string = string;
+    entry->offset = w->pool_size;
+    entry->next = w->bucket[index];
+    w->bucket[index] = entry;
+    memcpy(w->pool + w->pool_size, string, length + 1);
+    w->pool_size += length + 1;
+    write_word(w, entry->offset);
+}
+
+static void write_statement_list(CacheWriter *w, StatementList *list);
+
+/* 表达式：种类、行号、推断的类型，之后是各种类自己的内容；NULL只写种类0 */
+static void write_expression(CacheWriter *w, Expression *expr)
+{
+    ArgumentList *arg;
+    int words[2];
+    int count, depth;
+
+    if (expr == NULL) {
+        write_word(w, 0);
+        return;
+    }
+    write_word(w, expr->type);
+    write_word(w, expr->line_number);
+    write_word(w, expr->static_type);
+    switch (expr->type) {
+    case BOOLEAN_EXPRESSION:
+        write_word(w, expr->u.boolean_value);
+        break;
+    case INT_EXPRESSION:
+        write_word(w, expr->u.int_value);
+        break;
+    case DOUBLE_EXPRESSION:
+        memcpy(words, &expr->u.double_value, sizeof(double));
+        write_word(w, words[0]);
+        write_word(w, words[1]);
+        break;
+    case STRING_EXPRESSION:
+        write_string(w, expr->u.string_value->string);
+        break;
+    case IDENTIFIER_EXPRESSION:
+    case INCREMENT_EXPRESSION:
+    case DECREMENT_EXPRESSION:
+        write_string(w, expr->u.identifier);
+        break;
+    case ASSIGN_EXPRESSION:
+        write_string(w, expr->u.assign_expression.variable);
+        write_expression(w, expr->u.assign_expression.operand);
+        break;
+    case COMPOUND_ASSIGN_EXPRESSION:
+        write_string(w, expr->u.compound_assign_expression.variable);
+        write_word(w, expr->u.compound_assign_expression.operator);
+        write_expression(w, expr->u.compound_assign_expression.operand);
+        break;
+    case ADD_EXPRESSION:
+    case SUB_EXPRESSION:
+    case MUL_EXPRESSION:
+    case DIV_EXPRESSION:
+    case MOD_EXPRESSION:
+    case EQ_EXPRESSION:
+    case NE_EXPRESSION:
+    case GT_EXPRESSION:
+    case GE_EXPRESSION:
+    case LT_EXPRESSION:
+    case LE_EXPRESSION:
+    case LOGICAL_AND_EXPRESSION:
+    case LOGICAL_OR_EXPRESSION:
+        write_expression(w, expr->u.binary_expression.left);
+        write_expression(w, expr->u.binary_expression.right);
+        break;
+    case MINUS_EXPRESSION:
+        write_expression(w, expr->u.minus_expression);
+        break;
+    case FUNCTION_CALL_EXPRESSION:
+        write_string(w, expr->u.function_call_expression.identifier);
+        write_word(w, expr->u.function_call_expression.is_tail_call);
+        for (count = 0, arg = expr->u.function_call_expression.argument; arg; arg = arg->next) {
+            count++;
+        }
+        write_word(w, count);
+        for (arg = expr->u.function_call_expression.argument; arg; arg = arg->next) {
+            write_expression(w, arg->expression);
+        }
+        break;
+    case LOOP_INVARIANT_EXPRESSION:
+        /* 所属循环记为从内向外数的层数 */
+        for (depth = 0; depth < w->loop_depth; depth++) {
+            if (w->loops[w->loop_depth - 1 - depth] == expr->u.loop_invariant->loop_epoch)
+                break;
+        }
+        DBG_assert(depth < w->loop_depth, ("loop of invariant not found\n"));
+        write_word(w, depth);
+        write_expression(w, expr->u.loop_invariant->operand);
+        break;
+    case NULL_EXPRESSION:
+        break;
+    case EXPRESSION_TYPE_COUNT_PLUS_1:
+    default:
+        DBG_panic(("bad case...%d", expr->type));
+    }
+}
+
+static void write_block(CacheWriter *w, Block *block)
+{
+    write_statement_list(w, block->statement_list);
+}
+
+static void write_statement(CacheWriter *w, Statement *st)
+{
+    IdentifierList *id;
+    Elif *elif;
+    MatchCase *match_case;
+    ArgumentList *label;
+    int count;
+
+    write_word(w, st->type);
+    write_word(w, st->line_number);
+    switch (st->type) {
+    case EXPRESSION_STATEMENT:
+        write_expression(w, st->u.expression_s);
+        break;
+    case GLOBAL_STATEMENT:
+        for (count = 0, id = st->u.global_identifier_list; id; id = id->next) {
+            count++;
+        }
+        write_word(w, count);
+        for (id = st->u.global_identifier_list; id; id = id->next) {
+            write_string(w, id->name);
+        }
+        break;
+    case IF_STATEMENT:
+        write_expression(w, st->u.if_block.condition);
+        write_block(w, st->u.if_block.then_block);
+        for (count = 0, elif = st->u.if_block.elif_list; elif; elif = elif->next) {
+            count++;
+        }
+        write_word(w, count);
+        for (elif = st->u.if_block.elif_list; elif; elif = elif->next) {
+            write_expression(w, elif->condition);
+            write_block(w, elif->block);
+        }
+        write_word(w, st->u.if_block.else_block != NULL);
+        if (st->u.if_block.else_block) {
+            write_block(w, st->u.if_block.else_block);
+        }
+        break;
+    case WHILE_STATEMENT:
+        push_loop(&w->loops, &w->loop_depth, &w->loop_alloc, &st->u.while_block.epoch);
+        write_expression(w, st->u.while_block.condition);
+        write_block(w, st->u.while_block.block);
+        w->loop_depth--;
+        break;
+    case FOR_STATEMENT:
+        push_loop(&w->loops, &w->loop_depth, &w->loop_alloc, &st->u.for_block.epoch);
+        write_expression(w, st->u.for_block.init);
+        write_expression(w, st->u.for_block.condition);
+        write_expression(w, st->u.for_block.post);
+        write_block(w, st->u.for_block.block);
+        w->loop_depth--;
+        break;
+    case RANGE_FOR_STATEMENT:
+        push_loop(&w->loops, &w->loop_depth, &w->loop_alloc, &st->u.range_for_block.epoch);
+        write_string(w, st->u.range_for_block.variable);
+        write_expression(w, st->u.range_for_block.start);
+        write_expression(w, st->u.range_for_block.end);
+        write_expression(w, st->u.range_for_block.step);
+        write_block(w, st->u.range_for_block.block);
+        w->loop_depth--;
+        break;
+    case MATCH_STATEMENT:
+        /* 分支表在装入时重新建立 */
+        write_expression(w, st->u.match_block.condition);
+        for (count = 0, match_case = st->u.match_block.case_list; match_case;
+             match_case = match_case->next) {
+            count++;
+        }
+        write_word(w, count);
+        for (match_case = st->u.match_block.case_list; match_case;
+             match_case = match_case->next) {
+            for (count = 0, label = match_case->labels; label; label = label->next) {
+                count++;
+            }
+            write_word(w, count);
+            for (label = match_case->labels; label; label = label->next) {
+                write_expression(w, label->expression);
+            }
+            write_block(w, match_case->block);
+        }
+        break;
+    case RETURN_STATEMENT:
+        write_expression(w, st->u.return_expression);
+        break;
+    case YIELD_STATEMENT:
+        write_expression(w, st->u.yield_expression);
+        break;
+    case BREAK_STATEMENT:
+    case CONTINUE_STATEMENT:
+        break;
+    case STATEMENT_TYPE_COUNT_PLUS_1:
+    default:
+        DBG_panic(("bad case...%d", st->type));
+    }
+}
+
+static void write_statement_list(CacheWriter *w, StatementList *list)
+{
+    StatementList *pos;
+    int count;
+
+    for (count = 0, pos = list; pos; pos = pos->next) {
+        count++;
+    }
+    write_word(w, count);
+    for (pos = list; pos; pos = pos->next) {
+        write_statement(w, pos->statement);
+    }
+}
+
+/* 函数按定义的顺序写入 */
+static void write_functions(CacheWriter *w, FunctionDefinition *func)
+{
+    ParameterList *param;
+    int count;
+
+    if (func == NULL)
+        return;
+    write_functions(w, func->next);
+    if (func->type != SICPY_FUNCTION_DEFINITION)
+        return;
+    write_word(w, 1);
+    write_string(w, func->name);
+    for (count = 0, param = func->u.sicpy_f.parameter; param; param = param->next) {
+        count++;
+    }
+    write_word(w, count);
+    for (param = func->u.sicpy_f.parameter; param; param = param->next) {
+        write_string(w, param->name);
+    }
+    write_word(w, func->u.sicpy_f.is_generator);
+    write_word(w, func->u.sicpy_f.memo != NULL);
+    write_word(w, func->u.sicpy_f.return_type);
+    write_block(w, func->u.sicpy_f.block);
+}
+
+/* 摘除前的函数个数和被摘除的函数名 */
+static void write_tree_shake(CacheWriter *w, SCP_Interpreter *inter)
+{
+    IdentifierList *pos;
+    int count = 0;
+
+    for (pos = inter->tree_shake_removed; pos; pos = pos->next) {
+        count++;
+    }
+    write_word(w, inter->tree_shake_count);
+    write_word(w, count);
+    for (pos = inter->tree_shake_removed; pos; pos = pos->next) {
+        write_string(w, pos->name);
+    }
+}
+
+/* 把编译好的程序写入缓存文件，写不进去时不影响执行 */
+void scp_save_compile_cache(SCP_Interpreter *inter)
+{
+    CompileCache *cache = inter->compile_cache;
+    CacheWriter w;
+    CacheHeader header;
+    PoolEntry *entry, *next;
+    char *temp_path;
+    SCP_Boolean ok;
+    int fd, i;
+
+    /*
+     * --lazy时函数体没有全部分析，不能写入；导入的模块不在散列的范围内，
+     * 模块修改后缓存不会失效，也不写入
+     */
+    if (cache == NULL || cache->path == NULL || cache->map || inter->lazy
+        || inter->import_list)
+        return;
+    memset(&w, 0, sizeof(w));
+    write_functions(&w, inter->function_list);
+    write_word(&w, 0);
+    write_statement_list(&w, inter->statement_list);
+    if (inter->tree_shake) {
+        write_tree_shake(&w, inter);
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, 4);
+    header.version = CACHE_VERSION;
+    header.hash = cache->hash;
+    header.source_length = cache->source_length;
+    header.word_count = w.word_count;
+    header.pool_size = w.pool_size;
+
+    temp_path = MEM_malloc(strlen(cache->path) + 32);
+    sprintf(temp_path, "%s.%ld.tmp", cache->path, (long)getpid());
+    fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        ok = scp_write_file(fd, &header, sizeof(header))
+            && scp_write_file(fd, w.words, sizeof(int) * w.word_count)
+            && scp_write_file(fd, w.pool, w.pool_size);
+        close(fd);
+        if (!ok || rename(temp_path, cache->path) != 0) {
+            unlink(temp_path);
+        }
+    }
+    MEM_free(temp_path);
+
+    for (i = 0; i < CACHE_POOL_BUCKETS; i++) {
+        for (entry = w.bucket[i]; entry; entry = next) {
+            next = entry->next;
+            MEM_free(entry);
+        }
+    }
+    MEM_free(w.words);
+    MEM_free(w.pool);
+    MEM_free(w.loops);
+}
+
+/* ---------------------------------------------------------------- 读取 */
+
+static int read_word(CacheReader *r)
+{
+    if (r->position >= r->word_count) {
+        r->error = SCP_TRUE;
+        return 0;
+    }
+    return r->words[r->position++];
+}
+
+/* 个数必须在剩余内容的范围内，防止损坏的文件导致过大的循环 */
+static int read_count(CacheReader *r)
+{
+    int count = read_word(r);
+
+    if (count < 0 || count > r->word_count - r->position) {
+        r->error = SCP_TRUE;
+        return 0;
+    }
+    return count;
+}
+
+/* 字符串直接指向映射中的字符串池 */
+static char * read_string(CacheReader *r)
+{
+    int offset = read_word(r);
+
+    if (offset < 0 || offset >= r->pool_size) {
+        r->error = SCP_TRUE;
+        return "";
+    }
+    return r->pool + offset;
+}
+
+static StatementList *read_statement_list(CacheReader *r);
+
+static Expression * read_expression(CacheReader *r)
+{
+    Expression *expr;
+    ArgumentList *args = NULL;
+    LoopInvariantExpression *invariant;
+    Expression *operand;
+    int type, words[2];
+    int count, depth, i;
+
+    type = read_word(r);
+    if (type == 0 || r->error)
+        return NULL;
+    if (type < BOOLEAN_EXPRESSION || type >= EXPRESSION_TYPE_COUNT_PLUS_1) {
+        r->error = SCP_TRUE;
+        return NULL;
+    }
+    expr = scp_alloc_expression(type);
+    expr->line_number = read_word(r);
+    expr->static_type = read_word(r);
+    if (expr->static_type < INFER_UNKNOWN || expr->static_type > INFER_ANY) {
+        r->error = SCP_TRUE;
+        return expr;
+    }
+    switch (expr->type) {
+    case BOOLEAN_EXPRESSION:
+        expr->u.boolean_value = read_word(r) ? SCP_TRUE : SCP_FALSE;
+        break;
+    case INT_EXPRESSION:
+        expr->u.int_value = read_word(r);
+        break;
+    case DOUBLE_EXPRESSION:
+        words[0] = read_word(r);
+        words[1] = read_word(r);
+        memcpy(&expr->u.double_value, words, sizeof(double));
+        break;
+    case STRING_EXPRESSION:
+        expr->u.string_value = scp_create_literal_string(read_string(r));
+        break;
+    case IDENTIFIER_EXPRESSION:
+    case INCREMENT_EXPRESSION:
+    case DECREMENT_EXPRESSION:
+        expr->u.identifier = read_string(r);
+        break;
+    case ASSIGN_EXPRESSION:
+        expr->u.assign_expression.variable = read_string(r);
+        expr->u.assign_expression.operand = read_expression(r);
+        break;
+    case COMPOUND_ASSIGN_EXPRESSION:
+        expr->u.compound_assign_expression.variable = read_string(r);
+        expr->u.compound_assign_expression.operator = read_word(r);
+        if (!dkc_is_math_operator(expr->u.compound_assign_expression.operator)) {
+            r->error = SCP_TRUE;
+        }
+        expr->u.compound_assign_expression.operand = read_expression(r);
+        break;
+    case ADD_EXPRESSION:
+    case SUB_EXPRESSION:
+    case MUL_EXPRESSION:
+    case DIV_EXPRESSION:
+    case MOD_EXPRESSION:
+    case EQ_EXPRESSION:
+    case NE_EXPRESSION:
+    case GT_EXPRESSION:
+    case GE_EXPRESSION:
+    case LT_EXPRESSION:
+    case LE_EXPRESSION:
+    case LOGICAL_AND_EXPRESSION:
+    case LOGICAL_OR_EXPRESSION:
+        expr->u.binary_expression.left = read_expression(r);
+        expr->u.binary_expression.right = read_expression(r);
+        break;
+    case MINUS_EXPRESSION:
+        expr->u.minus_expression = read_expression(r);
+        break;
+    case FUNCTION_CALL_EXPRESSION:
+        expr->u.function_call_expression.identifier = read_string(r);
+        expr->u.function_call_expression.is_tail_call = read_word(r) ? SCP_TRUE : SCP_FALSE;
+        count = read_count(r);
+        for (i = 0; i < count && !r->error; i++) {
+            operand = read_expression(r);
+            if (operand == NULL) {
+                r->error = SCP_TRUE;
+                break;
+            }
+            args = args ? scp_chain_argument_list(args, operand)
+                : scp_create_one_argument_list(operand);
+        }
+        expr->u.function_call_expression.argument = args;
+        break;
+    case LOOP_INVARIANT_EXPRESSION:
+        depth = read_word(r);
+        if (depth < 0 || depth >= r->loop_depth) {
+            r->error = SCP_TRUE;
+            break;
+        }
+        invariant = scp_malloc(sizeof(LoopInvariantExpression));
+        invariant->loop_epoch = r->loops[r->loop_depth - 1 - depth];
+        invariant->epoch = 0;
+        invariant->value.type = SCP_NULL_VALUE;
+        invariant->operand = read_expression(r);
+        expr->u.loop_invariant = invariant;
+        break;
+    case NULL_EXPRESSION:
+        break;
+    case EXPRESSION_TYPE_COUNT_PLUS_1:
+    default:
+        r->error = SCP_TRUE;
+    }
+    /* 必需的子表达式缺失说明文件已损坏 */
+    if (!r->error && ((expr->type == ASSIGN_EXPRESSION && !expr->u.assign_expression.operand)
+                      || (expr->type == COMPOUND_ASSIGN_EXPRESSION
+                          && !expr->u.compound_assign_expression.operand)
+                      || (dkc_is_math_operator(expr->type) && !expr->u.binary_expression.left)
+                      || (dkc_is_math_operator(expr->type) && !expr->u.binary_expression.right)
+                      || (dkc_is_compare_operator(expr->type) && !expr->u.binary_expression.right)
+                      || (dkc_is_logical_operator(expr->type) && !expr->u.binary_expression.right)
+                      || (expr->type == MINUS_EXPRESSION && !expr->u.minus_expression)
+                      || (expr->type == LOOP_INVARIANT_EXPRESSION
+                          && !expr->u.loop_invariant->operand))) {
+        r->error = SCP_TRUE;
+    }
+
+    return expr;
+}
+
+static Block * read_block(CacheReader *r)
+{
+    Block *block = scp_malloc(sizeof(Block));
+
+    block->statement_list = read_statement_list(r);
+    return block;
+}
+
+static Statement * read_statement(CacheReader *r)
+{
+    Statement *st;
+    IdentifierList *ids = NULL;
+    Elif *elif, *tail = NULL;
+    MatchCase *case_list = NULL, *match_case;
+    ArgumentList *labels;
+    Expression *condition;
+    int type, line_number, count, label_count, i, j;
+
+    type = read_word(r);
+    line_number = read_word(r);
+    if (type < EXPRESSION_STATEMENT || type >= STATEMENT_TYPE_COUNT_PLUS_1 || r->error) {
+        r->error = SCP_TRUE;
+        return NULL;
+    }
+    if (type == MATCH_STATEMENT) {
+        condition = read_expression(r);
+        count = read_count(r);
+        for (i = 0; i < count && !r->error; i++) {
+            labels = NULL;
+            label_count = read_count(r);
+            for (j = 0; j < label_count && !r->error; j++) {
+                labels = labels ? scp_chain_argument_list(labels, read_expression(r))
+                    : scp_create_one_argument_list(read_expression(r));
+            }
+            match_case = scp_create_match_case(labels, read_statement_list(r));
+            case_list = case_list ? scp_chain_match_case(case_list, match_case) : match_case;
+        }
+        if (r->error || condition == NULL || case_list == NULL) {
+            r->error = SCP_TRUE;
+            return NULL;
+        }
+        st = scp_create_match_statement(condition, case_list);
+        st->line_number = line_number;
+        return st;
+    }
+
+    st = alloc_statement(type);
+    st->line_number = line_number;
+    switch (st->type) {
+    case EXPRESSION_STATEMENT:
+        st->u.expression_s = read_expression(r);
+        break;
+    case GLOBAL_STATEMENT:
+        count = read_count(r);
+        for (i = 0; i < count && !r->error; i++) {
+            ids = ids ? scp_chain_identifier(ids, read_string(r))
+                : scp_create_global_identifier(read_string(r));
+        }
+        st->u.global_identifier_list = ids;
+        break;
+    case IF_STATEMENT:
+        st->u.if_block.condition = read_expression(r);
+        st->u.if_block.then_block = read_block(r);
+        st->u.if_block.elif_list = NULL;
+        count = read_count(r);
+        for (i = 0; i < count && !r->error; i++) {
+            elif = scp_malloc(sizeof(Elif));
+            elif->condition = read_expression(r);
+            elif->block = read_block(r);
+            elif->next = NULL;
+            if (tail) {
+                tail->next = elif;
+            } else {
+                st->u.if_block.elif_list = elif;
+            }
+            tail = elif;
+        }
+        st->u.if_block.else_block = read_word(r) ? read_block(r) : NULL;
+        break;
+    case WHILE_STATEMENT:
+        st->u.while_block.epoch = 0;
+        push_loop(&r->loops, &r->loop_depth, &r->loop_alloc, &st->u.while_block.epoch);
+        st->u.while_block.condition = read_expression(r);
+        st->u.while_block.block = read_block(r);
+        r->loop_depth--;
+        break;
+    case FOR_STATEMENT:
+        st->u.for_block.epoch = 0;
+        push_loop(&r->loops, &r->loop_depth, &r->loop_alloc, &st->u.for_block.epoch);
+        st->u.for_block.init = read_expression(r);
+        st->u.for_block.condition = read_expression(r);
+        st->u.for_block.post = read_expression(r);
+        st->u.for_block.block = read_block(r);
+        r->loop_depth--;
+        break;
+    case RANGE_FOR_STATEMENT:
+        st->u.range_for_block.epoch = 0;
+        push_loop(&r->loops, &r->loop_depth, &r->loop_alloc, &st->u.range_for_block.epoch);
+        st->u.range_for_block.variable = read_string(r);
+        st->u.range_for_block.start = read_expression(r);
+        st->u.range_for_block.end = read_expression(r);
+        st->u.range_for_block.step = read_expression(r);
+        st->u.range_for_block.block = read_block(r);
+        r->loop_depth--;
+        if (st->u.range_for_block.end == NULL) {
+            r->error = SCP_TRUE;
+        }
+        break;
+    case RETURN_STATEMENT:
+        st->u.return_expression = read_expression(r);
+        break;
+    case YIELD_STATEMENT:
+        st->u.yield_expression = read_expression(r);
+        break;
+    case BREAK_STATEMENT:
+    case CONTINUE_STATEMENT:
+        break;
+    case MATCH_STATEMENT:
+    case STATEMENT_TYPE_COUNT_PLUS_1:
+    default:
+        r->error = SCP_TRUE;
+    }
+    if (!r->error && ((st->type == EXPRESSION_STATEMENT && !st->u.expression_s)
+                      || (st->type == IF_STATEMENT && !st->u.if_block.condition)
+                      || (st->type == WHILE_STATEMENT && !st->u.while_block.condition)
+                      || (st->type == YIELD_STATEMENT && !st->u.yield_expression))) {
+        r->error = SCP_TRUE;
+    }
+
+    return st;
+}
+
+static StatementList * read_statement_list(CacheReader *r)
+{
+    StatementList *list = NULL;
+    Statement *st;
+    int count, i;
+
+    count = read_count(r);
+    for (i = 0; i < count && !r->error; i++) {
+        st = read_statement(r);
+        if (st == NULL)
+            break;
+        list = list ? scp_chain_statement_list(list, st) : scp_create_one_statement_list(st);
+    }
+    return list;
+}
+
+/* 读出所有函数，按定义的顺序头插到链表中 */
+static FunctionDefinition * read_functions(CacheReader *r, FunctionDefinition *list)
+{
+    FunctionDefinition *func;
+    ParameterList *params;
+    int count, i;
+
+    while (read_word(r) == 1 && !r->error) {
+        func = scp_malloc(sizeof(FunctionDefinition));
+        func->name = read_string(r);
+        func->type = SICPY_FUNCTION_DEFINITION;
+        params = NULL;
+        count = read_count(r);
+        for (i = 0; i < count && !r->error; i++) {
+            params = params ? scp_chain_parameter_list(params, read_string(r))
+                : scp_create_one_parameter_list(read_string(r));
+        }
+        func->u.sicpy_f.parameter = params;
+        func->u.sicpy_f.is_generator = read_word(r) ? SCP_TRUE : SCP_FALSE;
+        func->u.sicpy_f.memo = read_word(r) ? scp_create_memo_cache() : NULL;
+        func->u.sicpy_f.return_type = read_word(r);
+        func->u.sicpy_f.call_count = 0;
+        func->u.sicpy_f.jit = NULL;
+        func->u.sicpy_f.lazy = NULL;
+        func->u.sicpy_f.module = NULL;
+        func->u.sicpy_f.block = read_block(r);
+        func->next = list;
+        list = func;
+    }
+    return list;
+}
+
+static IdentifierList * read_tree_shake(CacheReader *r, int *function_count)
+{
+    IdentifierList *removed = NULL, **tail = &removed;
+    int count, i;
+
+    /* 函数个数不受剩余内容的限制，只检查不为负 */
+    *function_count = read_word(r);
+    if (*function_count < 0) {
+        r->error = SCP_TRUE;
+    }
+    count = read_count(r);
+    for (i = 0; i < count && !r->error; i++) {
+        *tail = scp_create_global_identifier(read_string(r));
+        tail = &(*tail)->next;
+    }
+    return removed;
+}
+
+/* 释放装入失败时已为memo函数分配的缓存 */
+static void dispose_loaded_memo(FunctionDefinition *list, FunctionDefinition *end)
+{
+    for (; list != end; list = list->next) {
+        MEM_free(list->u.sicpy_f.memo);
+    }
+}
+
+static SCP_Boolean load_cache_file(SCP_Interpreter *inter, CompileCache *cache)
+{
+    CacheHeader *header;
+    CacheReader r;
+    FunctionDefinition *functions;
+    StatementList *statements;
+    IdentifierList *removed = NULL;
+    int function_count = 0;
+    struct stat st;
+    void *map;
+    int fd;
+
+    fd = open(cache->path, O_RDONLY);
+    if (fd < 0)
+        return SCP_FALSE;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CacheHeader)) {
+        close(fd);
+        return SCP_FALSE;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return SCP_FALSE;
+
+    header = map;
+    if (memcmp(header->magic, CACHE_MAGIC, 4) != 0 || header->version != CACHE_VERSION
+        || header->hash != cache->hash || header->source_length != cache->source_length
+        || header->word_count < 0 || header->pool_size <= 0
+        || (size_t)st.st_size != sizeof(CacheHeader) + sizeof(int) * (size_t)header->word_count
+                                 + header->pool_size
+        || ((char *)map)[st.st_size - 1] != '\0') {
+        munmap(map, st.st_size);
+        return SCP_FALSE;
+    }
+
+    memset(&r, 0, sizeof(r));
+    r.words = (int *)(header + 1);
+    r.word_count = header->word_count;
+    r.pool = (char *)(r.words + r.word_count);
+    r.pool_size = header->pool_size;
+    functions = read_functions(&r, inter->function_list);
+    statements = read_statement_list(&r);
+    if (inter->tree_shake) {
+        removed = read_tree_shake(&r, &function_count);
+    }
+    MEM_free(r.loops);
+    if (r.error || r.position != r.word_count) {
+        dispose_loaded_memo(functions, inter->function_list);
+        munmap(map, st.st_size);
+        return SCP_FALSE;
+    }
+    inter->function_list = functions;
+    inter->statement_list = statements;
+    inter->tree_shake_removed = removed;
+    inter->tree_shake_count = function_count;
+    cache->map = map;
+    cache->map_size = st.st_size;
+
+    return SCP_TRUE;
+}
+
+/*
+ * 查找源码对应的缓存文件，找到且有效时把程序装入解释器，返回SCP_TRUE；
+ * 否则返回SCP_FALSE，语法分析结束后调用scp_save_compile_cache写入缓存
+ */
+SCP_Boolean scp_load_compile_cache(SCP_Interpreter *inter, SourceText *source)
+{
+    CompileCache *cache = inter->compile_cache;
+
+    cache->source_length = source->length;
+    cache->hash = inter->source_hash;
+    /* 摘除了不可达函数的程序与完整的程序分别缓存 */
+    if (inter->tree_shake) {
+        cache->hash = (cache->hash ^ 1) * 0x100000001b3UL;
+    }
+    cache->path = MEM_malloc(strlen(cache->directory) + 32);
+    sprintf(cache->path, "%s/%016lx.scpc", cache->directory, cache->hash);
+
+    return load_cache_file(inter, cache);
+}
+
+void scp_dispose_compile_cache(SCP_Interpreter *inter)
+{
+    CompileCache *cache = inter->compile_cache;
+
+    if (cache == NULL)
+        return;
+    if (cache->map) {
+        munmap(cache->map, cache->map_size);
+    }
+    MEM_free(cache->path);
+    MEM_free(cache->directory);
+    MEM_free(cache);
+    inter->compile_cache = NULL;
+}
@@ -1,9 +1,41 @@
+#include <stdlib.h>
+#include <string.h>
 #include "MEM.h"
 #include "DBG.h"
 #include "sicpy.h"
 
+/* 当前正在分析的语句中是否出现过yield */
+static SCP_Boolean st_yield_found = SCP_FALSE;
+
+/* return对函数自身的调用为尾调用，data为函数名 */
+static SCP_Boolean mark_tail_call(Visitor *visitor, Statement *st)
+{
+    Expression *expr;
+
+    if (st->type != RETURN_STATEMENT)
+        return SCP_TRUE;
+    expr = st->u.return_expression;
+    if (expr && expr->type == FUNCTION_CALL_EXPRESSION
+        && !strcmp(expr->u.function_call_expression.identifier, visitor->data)) {
+        expr->u.function_call_expression.is_tail_call = SCP_TRUE;
+    }
+    return SCP_FALSE;
+}
+
+/* 标记语句列表中return对函数自身的调用为尾调用 */
+static void mark_tail_calls(StatementList *list, char *identifier)
+{
+    Visitor visitor;
+
+    visitor.statement = mark_tail_call;
+    visitor.expression = NULL;
+    visitor.data = identifier;
+    scp_visit_statement_list(&visitor, list);
+}
+
 /* 定义函数 */
-void scp_define_function(char *identifier, ParameterList *parameter_list, Block *block)
+void scp_define_function(char *identifier, ParameterList *parameter_list, Block *block,
+                         SCP_Boolean is_memo)
 {
     /* 如果已有该函数定义，则报错 */
     if (scp_search_function(identifier)) {
@@ -17,11 +49,64 @@ void scp_define_function(char *identifier, ParameterList *parameter_list, Block
     f->type = SICPY_FUNCTION_DEFINITION;
     f->u.sicpy_f.parameter = parameter_list;
     f->u.sicpy_f.block = block;
+    /* 函数体中出现过yield，则为生成器函数 */
+    f->u.sicpy_f.is_generator = st_yield_found;
+    st_yield_found = SCP_FALSE;
+    /* memo函数的结果缓存，纯函数检查在语法分析结束后进行 */
+    f->u.sicpy_f.memo = is_memo ? scp_create_memo_cache() : NULL;
+    f->u.sicpy_f.return_type = INFER_UNKNOWN;
+    /* 生成器不能在自身帧中再次调用自己，不做尾调用；memo函数的递归调用须经过缓存 */
+    if (!f->u.sicpy_f.is_generator && !is_memo) {
+        mark_tail_calls(block->statement_list, identifier);
+    }
+    f->u.sicpy_f.call_count = 0;
+    f->u.sicpy_f.jit = NULL;
+    f->u.sicpy_f.lazy = NULL;
+    f->u.sicpy_f.module = NULL;
     /* 头插法将函数加入函数链表 */
     f->next = inter->function_list;
     inter->function_list = f;
 }
 
+/* --lazy时定义函数，只记录函数体在源码中的范围，第一次调用时再分析 */
+void scp_define_lazy_function(char *identifier, ParameterList *parameter_list, LazyBody *body,
+                              SCP_Boolean is_memo)
+{
+    if (scp_search_function(identifier)) {
+        scp_compile_error(FUNCTION_MULTIPLE_DEFINE_ERR,
+                          STRING_MESSAGE_ARGUMENT, "name", identifier, MESSAGE_ARGUMENT_END);
+        return;
+    }
+    SCP_Interpreter *inter = scp_get_interpreter();
+    FunctionDefinition *f = scp_malloc(sizeof(FunctionDefinition));
+    f->name = identifier;
+    f->type = SICPY_FUNCTION_DEFINITION;
+    f->u.sicpy_f.parameter = parameter_list;
+    f->u.sicpy_f.block = NULL;
+    f->u.sicpy_f.is_generator = SCP_FALSE;
+    f->u.sicpy_f.memo = is_memo ? scp_create_memo_cache() : NULL;
+    /* 函数体未知，调用的结果可能是任何类型 */
+    f->u.sicpy_f.return_type = INFER_ANY;
+    f->u.sicpy_f.call_count = 0;
+    f->u.sicpy_f.jit = NULL;
+    f->u.sicpy_f.lazy = body;
+    f->u.sicpy_f.module = NULL;
+    f->next = inter->function_list;
+    inter->function_list = f;
+}
+
+/* 单独分析出函数体后补全函数定义，与scp_define_function中的处理相同 */
+void scp_finish_lazy_function(FunctionDefinition *func, Block *block)
+{
+    func->u.sicpy_f.block = block;
+    func->u.sicpy_f.is_generator = st_yield_found;
+    st_yield_found = SCP_FALSE;
+    func->u.sicpy_f.return_type = INFER_UNKNOWN;
+    if (!func->u.sicpy_f.is_generator && !func->u.sicpy_f.memo) {
+        mark_tail_calls(block->statement_list, func->name);
+    }
+}
+
 /* 传入标识符，创建单个参数链表 */
 ParameterList * scp_create_one_parameter_list(char *identifier)
 {
@@ -65,21 +150,20 @@ StatementList * scp_create_one_statement_list(Statement *statement)
     StatementList *sl = scp_malloc(sizeof(StatementList));
     sl->statement = statement;
     sl->next = NULL;
+    sl->last = sl;
     return sl;
 }
 
 /* 连接语句链表 */
 StatementList * scp_chain_statement_list(StatementList *list, Statement *statement)
 {
-    StatementList *pos;
-
     /* 当前语句链表为空则创建新链表 */
     if (list == NULL)
         return scp_create_one_statement_list(statement);
 
-    /* pos遍历至链表尾 */
-    for (pos = list; pos->next; pos = pos->next);
-    pos->next = scp_create_one_statement_list(statement);
+    /* 接在头节点记录的链表尾之后，机器生成的长脚本也只需线性时间 */
+    list->last->next = scp_create_one_statement_list(statement);
+    list->last = list->last->next;
 
     return list;
 }
@@ -90,6 +174,7 @@ Expression * scp_alloc_expression(ExpressionType type)
     Expression  *exp = scp_malloc(sizeof(Expression));
     exp->type = type;
     exp->line_number = scp_get_interpreter()->current_line_number;
+    exp->static_type = INFER_UNKNOWN;
 
     return exp;
 }
@@ -105,10 +190,33 @@ Expression * scp_create_assign_expression(char *variable, Expression *operand)
     return exp;
 }
 
+/* 创建复合赋值表达式，形如a += 3，operator为对应的算术表达式类型 */
+Expression * scp_create_compound_assign_expression(char *variable, ExpressionType operator,
+                                                   Expression *operand)
+{
+    Expression *exp = scp_alloc_expression(COMPOUND_ASSIGN_EXPRESSION);
+    exp->u.compound_assign_expression.variable = variable;
+    exp->u.compound_assign_expression.operator = operator;
+    exp->u.compound_assign_expression.operand = operand;
+
+    return exp;
+}
+
+/* 创建自增或自减表达式，形如a++或a-- */
+Expression * scp_create_increment_expression(ExpressionType type, char *variable)
+{
+    Expression *exp = scp_alloc_expression(type);
+    exp->u.identifier = variable;
+
+    return exp;
+}
+
 /* 给表达式赋值 */
 static Expression assign_value_to_expression(SCP_Value *v)
 {
     Expression  expr;
+    expr.line_number = scp_get_interpreter()->current_line_number;
+    expr.static_type = INFER_UNKNOWN;
     /* 如果是int值 */
     if (v->type == SCP_INT_VALUE) {
         expr.type = INT_EXPRESSION;
@@ -169,6 +277,7 @@ Expression * scp_create_function_call_expression(char *func_name, ArgumentList *
     Expression  *exp = scp_alloc_expression(FUNCTION_CALL_EXPRESSION);
     exp->u.function_call_expression.identifier = func_name;
     exp->u.function_call_expression.argument = argument;
+    exp->u.function_call_expression.is_tail_call = SCP_FALSE;
     return exp;
 }
 
@@ -213,3 +322,191 @@ Statement * scp_create_if_statement(Expression *condition,
     return st;
 }
 
+/* 创建yield语句，并记录当前函数为生成器 */
+Statement * scp_create_yield_statement(Expression *expression)
+{
+    Statement *st = alloc_statement(YIELD_STATEMENT);
+    st->u.yield_expression = expression;
+    st_yield_found = SCP_TRUE;
+
+    return st;
+}
+
+/* 创建for-in语句，只能遍历range(end)、range(start, end)或range(start, end, step) */
+Statement * scp_create_range_for_statement(char *variable, char *function_name,
+                                           ArgumentList *argument, Block *block)
+{
+    Statement *st = alloc_statement(RANGE_FOR_STATEMENT);
+    ArgumentList *pos;
+    Expression *args[3];
+    int arg_count = 0;
+
+    if (strcmp(function_name, "range")) {
+        scp_compile_error(FOR_IN_NOT_RANGE_ERR,
+                          STRING_MESSAGE_ARGUMENT, "name", function_name, MESSAGE_ARGUMENT_END);
+    }
+    for (pos = argument; pos; pos = pos->next) {
+        if (arg_count == 3) {
+            scp_compile_error(RANGE_ARGUMENT_COUNT_ERR, MESSAGE_ARGUMENT_END);
+        }
+        args[arg_count++] = pos->expression;
+    }
+    st->u.range_for_block.variable = variable;
+    st->u.range_for_block.start = arg_count >= 2 ? args[0] : NULL;
+    st->u.range_for_block.end = arg_count >= 2 ? args[1] : args[0];
+    st->u.range_for_block.step = arg_count == 3 ? args[2] : NULL;
+    st->u.range_for_block.block = block;
+    st->u.range_for_block.epoch = 0;
+
+    return st;
+}
+
+/* 创建match的分支，labels为NULL时为default分支 */
+MatchCase * scp_create_match_case(ArgumentList *labels, StatementList *statement_list)
+{
+    MatchCase *match_case = scp_malloc(sizeof(MatchCase));
+    match_case->labels = labels;
+    match_case->block = scp_malloc(sizeof(Block));
+    match_case->block->statement_list = statement_list;
+    match_case->next = NULL;
+
+    return match_case;
+}
+
+/* 尾插法串联match的分支 */
+MatchCase * scp_chain_match_case(MatchCase *list, MatchCase *match_case)
+{
+    MatchCase *pos;
+
+    for (pos = list; pos->next; pos = pos->next);
+    pos->next = match_case;
+
+    return list;
+}
+
+static int compare_match_int_entry(const void *a, const void *b)
+{
+    const MatchIntEntry *ea = a;
+    const MatchIntEntry *eb = b;
+
+    if (ea->value != eb->value)
+        return ea->value < eb->value ? -1 : 1;
+    return 0;
+}
+
+/* 建立int分支的有序表，相邻的相同值即为重复的case */
+static void build_match_int_table(MatchBlock *match, int count)
+{
+    MatchCase *match_case;
+    ArgumentList *label;
+    char buf[LINE_BUF_SIZE];
+    int i = 0;
+
+    match->int_table = scp_malloc(sizeof(MatchIntEntry) * (count > 0 ? count : 1));
+    match->int_count = count;
+    for (match_case = match->case_list; match_case; match_case = match_case->next) {
+        for (label = match_case->labels; label; label = label->next) {
+            if (label->expression->type != INT_EXPRESSION)
+                continue;
+            match->int_table[i].value = label->expression->u.int_value;
+            match->int_table[i].block = match_case->block;
+            i++;
+        }
+    }
+    qsort(match->int_table, count, sizeof(MatchIntEntry), compare_match_int_entry);
+    for (i = 1; i < count; i++) {
+        if (match->int_table[i].value == match->int_table[i - 1].value) {
+            sprintf(buf, "%d", match->int_table[i].value);
+            scp_compile_error(MATCH_DUPLICATE_CASE_ERR,
+                              STRING_MESSAGE_ARGUMENT, "label", buf, MESSAGE_ARGUMENT_END);
+        }
+    }
+}
+
+/* 建立string分支的散列表，大小为2的幂且至少是分支数的两倍，保持探测序列很短 */
+static void build_match_string_table(MatchBlock *match, int count)
+{
+    MatchCase *match_case;
+    ArgumentList *label;
+    MatchStringEntry *entry;
+    SCP_String *str;
+    unsigned int size = 4;
+    unsigned int hash, i;
+
+    if (count == 0) {
+        match->string_table = NULL;
+        match->string_mask = 0;
+        return;
+    }
+    while (size < (unsigned int)count * 2) {
+        size *= 2;
+    }
+    match->string_table = scp_malloc(sizeof(MatchStringEntry) * size);
+    memset(match->string_table, 0, sizeof(MatchStringEntry) * size);
+    match->string_mask = size - 1;
+    for (match_case = match->case_list; match_case; match_case = match_case->next) {
+        for (label = match_case->labels; label; label = label->next) {
+            if (label->expression->type != STRING_EXPRESSION)
+                continue;
+            str = label->expression->u.string_value;
+            hash = scp_hash_string(str->string, str->length);
+            for (i = hash & match->string_mask; match->string_table[i].string;
+                 i = (i + 1) & match->string_mask) {
+                entry = &match->string_table[i];
+                if (entry->hash == hash && entry->length == str->length
+                    && !memcmp(entry->string, str->string, str->length)) {
+                    scp_compile_error(MATCH_DUPLICATE_CASE_ERR, STRING_MESSAGE_ARGUMENT,
+                                      "label", str->string, MESSAGE_ARGUMENT_END);
+                }
+            }
+            entry = &match->string_table[i];
+            entry->string = str->string;
+            entry->length = str->length;
+            entry->hash = hash;
+            entry->block = match_case->block;
+        }
+    }
+}
+
+/* 创建match语句，建立int和string分支的查找表 */
+Statement * scp_create_match_statement(Expression *condition, MatchCase *case_list)
+{
+    Statement *st = alloc_statement(MATCH_STATEMENT);
+    MatchBlock *match = &st->u.match_block;
+    MatchCase *match_case;
+    ArgumentList *label;
+    int int_count = 0, string_count = 0;
+
+    match->condition = condition;
+    match->case_list = case_list;
+    match->default_block = NULL;
+    for (match_case = case_list; match_case; match_case = match_case->next) {
+        if (match_case->labels == NULL) {
+            if (match->default_block) {
+                scp_compile_error(MATCH_DUPLICATE_CASE_ERR, STRING_MESSAGE_ARGUMENT,
+                                  "label", "default", MESSAGE_ARGUMENT_END);
+            }
+            match->default_block = match_case->block;
+        }
+        for (label = match_case->labels; label; label = label->next) {
+            if (label->expression->type == INT_EXPRESSION) {
+                int_count++;
+            } else {
+                string_count++;
+            }
+        }
+    }
+    build_match_int_table(match, int_count);
+    build_match_string_table(match, string_count);
+
+    return st;
+}
+
+/* 检查顶层语句，yield只能出现在函数中 */
+void scp_check_toplevel_statement(void)
+{
+    if (st_yield_found) {
+        st_yield_found = SCP_FALSE;
+        scp_compile_error(YIELD_OUTSIDE_FUNCTION_ERR, MESSAGE_ARGUMENT_END);
+    }
+}
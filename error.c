@@ -8,12 +8,26 @@
 
 extern char *yytext;
 
+/* ǰ̵߳Ĵ */
+static __thread ErrorTrap *st_error_trap = NULL;
+
 
 /* 뱨Ϣ */
 char* scp_compile_error_message_format[] = {
     "($(token))﷨",
     "ȷַ($(bad_char))",
     "ظ($(name))",
+    "yieldֻںʹ",
+    "for-inֻܱrange()($(name))",
+    "range()Ҫ13",
+    "matchеcase($(label))ظ",
+    "memo($(name))Ǵ($(function))ʹglobal",
+    "memo($(name))Ǵ($(function))ԭ($(native))",
+    "memo($(name))Ǵ($(function))",
+    "Ҳģ($(path))",
+    "ģ($(path))ѭ",
+    "ģ($(path))ֻкimport",
+    "﷨ֹǶ׹ڴ治㣩",
 };
 
 /* ʱϢ */
@@ -35,6 +49,21 @@ char* scp_runtime_error_message_format[] = {
     "ȫֱ$(name)ڡ",
     "ںʹglobal䡣",
     "$(operator)ַ͡",
+    "Ϊpmap()뺯ַѡ",
+    "pmap()ڵ$(line)ִ($(name))ʱ$(message)",
+    "($(name))ִУڲٴεá",
+    "($(name))$(owner)ʼ𣬲$(caller)ٿʼһΡ",
+    "ú($(name))ʱݹջ$(limit)MB",
+    "range()Ĳint͡",
+    "range()ĲΪ0",
+    "Ϊmemo_stats()memoĺ",
+    "ִеĲ($(fuel))",
+    "ִʱ䳬($(seconds))",
+    "ڴʹó($(limit)MB)",
+    "Ϊsnapshot()ļ·",
+    "snapshot()ֻΪһá",
+    "ȫֱ($(name))дա",
+    "дļ($(path))",
 };
 
 /* ַָ붨Ϊִ */
@@ -192,9 +221,18 @@ void scp_compile_error(CompileError id, ...)
     int line_number = scp_get_interpreter()->current_line_number;
     message.string = NULL;
     format_message(scp_compile_error_message_format[id], &message, ap);
-    fprintf(stderr, "%3d:%s\n", line_number, message.string);
     va_end(ap);         /* ͷű䳤ʵб */
 
+    /* ˴¼Ϣأӡ˳ */
+    if (st_error_trap) {
+        st_error_trap->type = SCP_COMPILE_ERROR;
+        st_error_trap->code = id;
+        st_error_trap->line_number = line_number;
+        st_error_trap->message = message.string;
+        longjmp(st_error_trap->environment, 1);
+    }
+    fprintf(stderr, "%3d:%s\n", line_number, message.string);
+
     exit(1);
 }
 
@@ -207,9 +245,41 @@ void scp_runtime_error(int line_number, RuntimeError id, ...)
     va_start(ap, id);
     message.string = NULL;
     format_message(scp_runtime_error_message_format[id], &message, ap);
-    fprintf(stderr, "%3d:%s\n", line_number, message.string);
     va_end(ap);
 
+    /* ˴¼Ϣأӡ˳ */
+    if (st_error_trap) {
+        st_error_trap->type = SCP_RUNTIME_ERROR;
+        st_error_trap->code = id;
+        st_error_trap->line_number = line_number;
+        st_error_trap->message = message.string;
+        longjmp(st_error_trap->environment, 1);
+    }
+    fprintf(stderr, "%3d:%s\n", line_number, message.string);
+
+    exit(1);
+}
+
+/* õǰ̵߳Ĵ壬֮ǰԱָ */
+ErrorTrap * scp_set_error_trap(ErrorTrap *trap)
+{
+    ErrorTrap *old = st_error_trap;
+    st_error_trap = trap;
+    return old;
+}
+
+/* ֲ󣬰ѲĴԭ壬ûʱӡ˳ */
+void scp_raise_error(ErrorTrap *caught)
+{
+    if (st_error_trap) {
+        st_error_trap->type = caught->type;
+        st_error_trap->code = caught->code;
+        st_error_trap->line_number = caught->line_number;
+        st_error_trap->message = caught->message;
+        longjmp(st_error_trap->environment, 1);
+    }
+    fprintf(stderr, "%3d:%s\n", caught->line_number, caught->message);
+
     exit(1);
 }
 
@@ -9,7 +9,7 @@
 static void add_refer_if_string(SCP_Value *v)
 {
     if (v->type == SCP_STRING_VALUE) {
-        v->u.string_value->ref_count++;
+        scp_refer_string(v->u.string_value);
     }
 }
 
@@ -33,7 +33,7 @@ static Variable * search_global_variable_from_env(SCP_Interpreter *inter,
 
     /* 否则搜索在局部变量中搜索 */
     for (pos = env->global_variable; pos; pos = pos->next) {
-        if (!strcmp(pos->variable->name, name)) {
+        if (pos->variable->name == name || !strcmp(pos->variable->name, name)) {
             return pos->variable;
         }
     }
@@ -98,6 +98,27 @@ static SCP_Value eval_assign_expression(SCP_Interpreter *inter, LocalEnvironment
     return v;
 }
 
+/* 取得赋值的目标变量，不存在时按赋值的规则新建，初值为null */
+Variable * scp_search_assign_target(SCP_Interpreter *inter, LocalEnvironment *env,
+                                    char *identifier)
+{
+    Variable *var = scp_search_local_variable(env, identifier);
+    SCP_Value null_value;
+
+    if (var == NULL) {
+        var = search_global_variable_from_env(inter, env, identifier);
+    }
+    if (var != NULL)
+        return var;
+    null_value.type = SCP_NULL_VALUE;
+    if (env != NULL) {
+        scp_add_local_variable(env, identifier, &null_value);
+        return env->variable;
+    }
+    scp_add_global_variable(inter, identifier, &null_value);
+    return inter->variable;
+}
+
 /* 左右均为bool值的运算 */
 static SCP_Boolean eval_binary_boolean(SCP_Interpreter *inter, ExpressionType operator,
                     SCP_Boolean left, SCP_Boolean right, int line_number)
@@ -176,6 +197,10 @@ static void eval_binary_int(SCP_Interpreter *inter, ExpressionType operator,
     case STRING_EXPRESSION:
     case IDENTIFIER_EXPRESSION:
     case ASSIGN_EXPRESSION:
+    case COMPOUND_ASSIGN_EXPRESSION:
+    case INCREMENT_EXPRESSION:
+    case DECREMENT_EXPRESSION:
+    case LOOP_INVARIANT_EXPRESSION:
     case MINUS_EXPRESSION:
     case FUNCTION_CALL_EXPRESSION:
     case NULL_EXPRESSION:
@@ -252,6 +277,10 @@ static void eval_binary_double(ExpressionType operator,
     case STRING_EXPRESSION:
     case IDENTIFIER_EXPRESSION:
     case ASSIGN_EXPRESSION:
+    case COMPOUND_ASSIGN_EXPRESSION:
+    case INCREMENT_EXPRESSION:
+    case DECREMENT_EXPRESSION:
+    case LOOP_INVARIANT_EXPRESSION:
     case LOGICAL_AND_EXPRESSION:
     case LOGICAL_OR_EXPRESSION:
     default:
@@ -288,6 +317,8 @@ static SCP_Boolean eval_compare_string(ExpressionType operator,
     /* 非上述任一种操作符，报错 */
     else {
         char *op_str = scp_get_operator_string(operator);
+        scp_release_string(left->u.string_value);
+        scp_release_string(right->u.string_value);
         scp_runtime_error(line_number, BAD_OPERATOR_FOR_STRING_ERR,
                           STRING_MESSAGE_ARGUMENT, "operator", op_str, MESSAGE_ARGUMENT_END);
     }
@@ -314,6 +345,8 @@ static SCP_Boolean eval_binary_null(ExpressionType operator,
     /* 否则报错 */
     else {
         char *op_str = scp_get_operator_string(operator);
+        release_if_string(left);
+        release_if_string(right);
         scp_runtime_error(line_number, NOT_NULL_OPERATOR_ERR,
                           STRING_MESSAGE_ARGUMENT, "operator", op_str, MESSAGE_ARGUMENT_END);
     }
@@ -323,15 +356,56 @@ static SCP_Boolean eval_binary_null(ExpressionType operator,
     return result;
 }
 
+/* 将值转换为字符串，字符串值直接返回（引用随之转移） */
+SCP_String * scp_value_to_string(SCP_Value *v)
+{
+    char    buf[LINE_BUF_SIZE];
+    SCP_String *str;
+
+    /* int值 */
+    if (v->type == SCP_INT_VALUE) {
+        sprintf(buf, "%d", v->u.int_value);
+        str = scp_create_sicpy_string(MEM_strdup(buf));
+    }
+    /* double值 */
+    else if (v->type == SCP_DOUBLE_VALUE) {
+        sprintf(buf, "%f", v->u.double_value);
+        str = scp_create_sicpy_string(MEM_strdup(buf));
+    }
+    /* 布尔值，处理为true或false字符串 */
+    else if (v->type == SCP_BOOLEAN_VALUE) {
+        if (v->u.boolean_value) {
+            str = scp_create_sicpy_string(MEM_strdup("true"));
+        } else {
+            str = scp_create_sicpy_string(MEM_strdup("false"));
+        }
+    }
+    /* 字符串 */
+    else if (v->type == SCP_STRING_VALUE) {
+        str = v->u.string_value;
+    }
+    /* 指针 */
+    else if (v->type == SCP_NATIVE_POINTER_VALUE) {
+        sprintf(buf, "(%s:%p)", v->u.native_pointer.info, v->u.native_pointer.pointer);
+        str = scp_create_sicpy_string(MEM_strdup(buf));
+    }
+    /* 空 */
+    else {
+        DBG_assert(v->type == SCP_NULL_VALUE, ("v->type..%d\n", v->type));
+        str = scp_create_sicpy_string(MEM_strdup("null"));
+    }
+    return str;
+}
+
 /* 连接字符串 */
 SCP_String * chain_string(SCP_Interpreter *inter, SCP_String *left, SCP_String *right)
 {
-    int len = strlen(left->string) + strlen(right->string);
+    int len = left->length + right->length;
     char *str = MEM_malloc(len + 1);
 
     /* 复制左边字串，连接右边字串 */
-    strcpy(str, left->string);
-    strcat(str, right->string);
+    memcpy(str, left->string, left->length);
+    memcpy(str + left->length, right->string, right->length + 1);
 
     SCP_String *ret = scp_create_sicpy_string(str);
     scp_release_string(left);
@@ -339,80 +413,44 @@ SCP_String * chain_string(SCP_Interpreter *inter, SCP_String *left, SCP_String *
     return ret;
 }
 
-/* 计算表达式，传入解释器和当前环境、操作符和左右表达式进行运算 */
-SCP_Value scp_eval_binary_expression(SCP_Interpreter *inter, LocalEnvironment *env,
-                           ExpressionType operator, Expression *left, Expression *right)
+/* 对左右两个值进行二元运算，两个值的引用随之转移 */
+static SCP_Value eval_binary_value(SCP_Interpreter *inter, ExpressionType operator,
+                                   SCP_Value left_val, SCP_Value right_val, int line_number)
 {
-    SCP_Value   left_val = eval_expression(inter, env, left);
-    SCP_Value   right_val = eval_expression(inter, env, right);
     SCP_Value   result;
 
     /* 左右都为int类型的计算 */
     if (left_val.type == SCP_INT_VALUE && right_val.type == SCP_INT_VALUE) {
         eval_binary_int(inter, operator, left_val.u.int_value,
-                        right_val.u.int_value, &result, left->line_number);
+                        right_val.u.int_value, &result, line_number);
     }
     /* 左右都为double类型的计算 */
     else if (left_val.type == SCP_DOUBLE_VALUE && right_val.type == SCP_DOUBLE_VALUE) {
         eval_binary_double(operator, left_val.u.double_value,
-                            right_val.u.double_value, &result, left->line_number);
+                            right_val.u.double_value, &result, line_number);
 
     }
     /* 左边int右边double类型的计算 */
     else if (left_val.type == SCP_INT_VALUE && right_val.type == SCP_DOUBLE_VALUE) {
         left_val.u.double_value = left_val.u.int_value;     /* 类型转换 */
         eval_binary_double(operator, left_val.u.double_value, right_val.u.double_value,
-                           &result, left->line_number);
+                           &result, line_number);
     }
     /* 左边double右边int类型的计算 */
     else if (left_val.type == SCP_DOUBLE_VALUE && right_val.type == SCP_INT_VALUE) {
         right_val.u.double_value = right_val.u.int_value;
         eval_binary_double(operator, left_val.u.double_value, right_val.u.double_value,
-                           &result, left->line_number);
+                           &result, line_number);
     }
     /* 左右均为bool值的计算 */
     else if (left_val.type == SCP_BOOLEAN_VALUE && right_val.type == SCP_BOOLEAN_VALUE) {
         result.type = SCP_BOOLEAN_VALUE;
         result.u.boolean_value = eval_binary_boolean(inter, operator, left_val.u.boolean_value,
-                                  right_val.u.boolean_value, left->line_number);
+                                  right_val.u.boolean_value, line_number);
     }
     /* 左边字符串且操作符为加的处理 */
     else if (left_val.type == SCP_STRING_VALUE && operator == ADD_EXPRESSION) {
-        char    buf[LINE_BUF_SIZE];
-        SCP_String *right_str;
-
-        /* 右边为int值 */
-        if (right_val.type == SCP_INT_VALUE) {
-            sprintf(buf, "%d", right_val.u.int_value);
-            right_str = scp_create_sicpy_string(MEM_strdup(buf));
-        }
-        /* 右边为double */
-        else if (right_val.type == SCP_DOUBLE_VALUE) {
-            sprintf(buf, "%f", right_val.u.double_value);
-            right_str = scp_create_sicpy_string(MEM_strdup(buf));
-        }
-        /* 右边为布尔值，将布尔值处理为true或false字符串 */
-        else if (right_val.type == SCP_BOOLEAN_VALUE) {
-            if (right_val.u.boolean_value) {
-                right_str = scp_create_sicpy_string(MEM_strdup("true"));
-            } else {
-                right_str = scp_create_sicpy_string(MEM_strdup("false"));
-            }
-        }
-        /* 右边为字符串 */
-        else if (right_val.type == SCP_STRING_VALUE) {
-            right_str = right_val.u.string_value;
-        }
-        /* 右边为指针 */
-        else if (right_val.type == SCP_NATIVE_POINTER_VALUE) {
-            sprintf(buf, "(%s:%p)",
-                    right_val.u.native_pointer.info, right_val.u.native_pointer.pointer);
-            right_str = scp_create_sicpy_string(MEM_strdup(buf));
-        } 
-        /* 右边为空 */
-        else if (right_val.type == SCP_NULL_VALUE) {
-            right_str = scp_create_sicpy_string(MEM_strdup("null"));
-        } 
+        SCP_String *right_str = scp_value_to_string(&right_val);
         result.type = SCP_STRING_VALUE;
         result.u.string_value = chain_string(inter, left_val.u.string_value, right_str);
 
@@ -422,23 +460,222 @@ SCP_Value scp_eval_binary_expression(SCP_Interpreter *inter, LocalEnvironment *e
     else if (left_val.type == SCP_STRING_VALUE && right_val.type == SCP_STRING_VALUE) {
         result.type = SCP_BOOLEAN_VALUE;
         result.u.boolean_value = eval_compare_string(operator, &left_val, &right_val,
-                                                    left->line_number);
+                                                    line_number);
     } 
     /* 如果有任一边为NULL */
     else if (left_val.type == SCP_NULL_VALUE || right_val.type == SCP_NULL_VALUE) {
         result.type = SCP_BOOLEAN_VALUE;
-        result.u.boolean_value = eval_binary_null(operator, &left_val, &right_val, left->line_number);
+        result.u.boolean_value = eval_binary_null(operator, &left_val, &right_val, line_number);
     } 
     /* 其他情况则报错 */
     else {
         char *op_str = scp_get_operator_string(operator);
-        scp_runtime_error(left->line_number, BAD_OPERAND_TYPE_ERR,
+        release_if_string(&left_val);
+        release_if_string(&right_val);
+        scp_runtime_error(line_number, BAD_OPERAND_TYPE_ERR,
                           STRING_MESSAGE_ARGUMENT, "operator", op_str, MESSAGE_ARGUMENT_END);
     }
 
     return result;
 }
 
+/* 计算表达式，传入解释器和当前环境、操作符和左右表达式进行运算 */
+SCP_Value scp_eval_binary_expression(SCP_Interpreter *inter, LocalEnvironment *env,
+                           ExpressionType operator, Expression *left, Expression *right)
+{
+    SCP_Value   left_val = eval_expression(inter, env, left);
+    SCP_Value   right_val, root;
+
+    /* 计算右边时出错，左边的字符串由回卷根释放 */
+    if (left_val.type == SCP_STRING_VALUE) {
+        root = left_val;
+        scp_push_unwind_root(inter, &root, 1, NULL, NULL);
+        right_val = eval_expression(inter, env, right);
+        SCP_POP_UNWIND_ROOT(inter);
+    } else {
+        right_val = eval_expression(inter, env, right);
+    }
+
+    return eval_binary_value(inter, operator, left_val, right_val, left->line_number);
+}
+
+/*
+ * 类型推断证明值为int的表达式树，直接以C的int求值，中间结果不再包装成SCP_Value，
+ * 也不再判断值的类型；其他节点和找不到的变量交给通用的求值路径
+ */
+static int eval_int_expression(SCP_Interpreter *inter, LocalEnvironment *env, Expression *expr)
+{
+    Expression *left, *right;
+    Variable *vp;
+    SCP_Value v;
+
+    switch (expr->type) {
+    case INT_EXPRESSION:
+        return expr->u.int_value;
+    case IDENTIFIER_EXPRESSION:
+        vp = scp_search_local_variable(env, expr->u.identifier);
+        if (vp == NULL) {
+            vp = search_global_variable_from_env(inter, env, expr->u.identifier);
+        }
+        if (vp == NULL)
+            break;
+        DBG_assert(vp->value.type == SCP_INT_VALUE, ("%s..%d\n", expr->u.identifier,
+                                                     vp->value.type));
+        return vp->value.u.int_value;
+    case ADD_EXPRESSION:
+    case SUB_EXPRESSION:
+    case MUL_EXPRESSION:
+    case DIV_EXPRESSION:
+    case MOD_EXPRESSION:
+        left = expr->u.binary_expression.left;
+        right = expr->u.binary_expression.right;
+        if (left->static_type != INFER_INT || right->static_type != INFER_INT)
+            break;
+        eval_binary_int(inter, expr->type, eval_int_expression(inter, env, left),
+                        eval_int_expression(inter, env, right), &v, left->line_number);
+        return v.u.int_value;
+    case MINUS_EXPRESSION:
+        if (expr->u.minus_expression->static_type != INFER_INT)
+            break;
+        return -eval_int_expression(inter, env, expr->u.minus_expression);
+    case BOOLEAN_EXPRESSION:
+    case DOUBLE_EXPRESSION:
+    case STRING_EXPRESSION:
+    case ASSIGN_EXPRESSION:
+    case COMPOUND_ASSIGN_EXPRESSION:
+    case INCREMENT_EXPRESSION:
+    case DECREMENT_EXPRESSION:
+    case LOOP_INVARIANT_EXPRESSION:
+    case EQ_EXPRESSION:
+    case NE_EXPRESSION:
+    case GT_EXPRESSION:
+    case GE_EXPRESSION:
+    case LT_EXPRESSION:
+    case LE_EXPRESSION:
+    case LOGICAL_AND_EXPRESSION:
+    case LOGICAL_OR_EXPRESSION:
+    case FUNCTION_CALL_EXPRESSION:
+    case NULL_EXPRESSION:
+    case EXPRESSION_TYPE_COUNT_PLUS_1:
+    default:
+        break;
+    }
+    v = eval_expression(inter, env, expr);
+    DBG_assert(v.type == SCP_INT_VALUE, ("line %d type..%d\n", expr->line_number, v.type));
+    return v.u.int_value;
+}
+
+/* 取得复合赋值和自增自减的目标变量，变量必须已经存在，不存在时释放operand后报错 */
+static Variable * search_update_target(SCP_Interpreter *inter, LocalEnvironment *env,
+                                       char *identifier, SCP_Value *operand, int line_number)
+{
+    Variable *var = scp_search_local_variable(env, identifier);
+
+    if (var == NULL) {
+        var = search_global_variable_from_env(inter, env, identifier);
+    }
+    if (var == NULL) {
+        if (operand) {
+            release_if_string(operand);
+        }
+        scp_runtime_error(line_number, VARIABLE_NOT_FOUND_ERR, STRING_MESSAGE_ARGUMENT,
+                          "name", identifier, MESSAGE_ARGUMENT_END);
+    }
+    return var;
+}
+
+/*
+ * 字符串追加：变量是字符串的唯一持有者时直接在原字符数组后追加，容量不足时成倍扩大，
+ * 循环中反复追加的总代价为线性；字符串还被别处引用、是字面常量或已发布给其他线程时，
+ * 与+相同，连接成新的字符串。right的引用随之转移。
+ */
+static void append_string(SCP_Interpreter *inter, SCP_Value *slot, SCP_String *right)
+{
+    SCP_String *left = slot->u.string_value;
+    int length, capacity;
+
+    if (left->is_literal || left->is_shared || left->ref_count != 1) {
+        slot->u.string_value = chain_string(inter, left, right);
+        return;
+    }
+    length = left->length + right->length;
+    if (length + 1 > left->capacity) {
+        capacity = left->capacity * 2;
+        if (capacity < length + 1) {
+            capacity = length + 1;
+        }
+        left->string = MEM_realloc(left->string, capacity);
+        left->capacity = capacity;
+    }
+    memcpy(left->string + left->length, right->string, right->length + 1);
+    left->length = length;
+    scp_release_string(right);
+}
+
+/* 复合赋值：在目标变量中就地计算，数值直接改写变量的值，字符串+=尽量原地追加 */
+static SCP_Value eval_compound_assign_expression(SCP_Interpreter *inter, LocalEnvironment *env,
+                                                 Expression *expr)
+{
+    CompoundAssignExpression *assign = &expr->u.compound_assign_expression;
+    SCP_Value   operand = eval_expression(inter, env, assign->operand);
+    Variable    *var = search_update_target(inter, env, assign->variable, &operand,
+                                            expr->line_number);
+    SCP_Value   *slot = &var->value;
+    SCP_Value   left, v;
+
+    if (slot->type == SCP_INT_VALUE && operand.type == SCP_INT_VALUE) {
+        eval_binary_int(inter, assign->operator, slot->u.int_value, operand.u.int_value,
+                        slot, expr->line_number);
+    }
+    else if (slot->type == SCP_DOUBLE_VALUE && operand.type == SCP_DOUBLE_VALUE) {
+        eval_binary_double(assign->operator, slot->u.double_value, operand.u.double_value,
+                           slot, expr->line_number);
+    }
+    else if (slot->type == SCP_DOUBLE_VALUE && operand.type == SCP_INT_VALUE) {
+        eval_binary_double(assign->operator, slot->u.double_value, operand.u.int_value,
+                           slot, expr->line_number);
+    }
+    else if (slot->type == SCP_INT_VALUE && operand.type == SCP_DOUBLE_VALUE) {
+        eval_binary_double(assign->operator, slot->u.int_value, operand.u.double_value,
+                           slot, expr->line_number);
+    }
+    else if (slot->type == SCP_STRING_VALUE && assign->operator == ADD_EXPRESSION) {
+        append_string(inter, slot, scp_value_to_string(&operand));
+    }
+    /* 其他情况与a = a op b相同 */
+    else {
+        left = *slot;
+        add_refer_if_string(&left);
+        v = eval_binary_value(inter, assign->operator, left, operand, expr->line_number);
+        release_if_string(slot);
+        *slot = v;
+    }
+    v = *slot;
+    add_refer_if_string(&v);
+
+    return v;
+}
+
+/* 自增自减：目标变量必须是数值，值为改变之前的值 */
+static SCP_Value eval_increment_expression(SCP_Interpreter *inter, LocalEnvironment *env,
+                                           Expression *expr)
+{
+    Variable    *var = search_update_target(inter, env, expr->u.identifier, NULL,
+                                               expr->line_number);
+    SCP_Value   v = var->value;
+    int         delta = expr->type == INCREMENT_EXPRESSION ? 1 : -1;
+
+    if (v.type == SCP_INT_VALUE) {
+        var->value.u.int_value += delta;
+    } else if (v.type == SCP_DOUBLE_VALUE) {
+        var->value.u.double_value += delta;
+    } else {
+        scp_runtime_error(expr->line_number, BAD_OPERAND_TYPE_ERR, STRING_MESSAGE_ARGUMENT,
+                          "operator", scp_get_operator_string(expr->type), MESSAGE_ARGUMENT_END);
+    }
+    return v;
+}
+
 /* 逻辑与或计算 */
 static SCP_Value eval_logical_and_or_expression(SCP_Interpreter *inter, LocalEnvironment *env,
                                ExpressionType operator,Expression *left, Expression *right)
@@ -450,6 +687,7 @@ static SCP_Value eval_logical_and_or_expression(SCP_Interpreter *inter, LocalEnv
 
     /* 左侧计算好的值需要是bool值，否则报错 */
     if (left_val.type != SCP_BOOLEAN_VALUE) {
+        release_if_string(&left_val);
         scp_runtime_error(left->line_number, NOT_BOOLEAN_TYPE_ERR, MESSAGE_ARGUMENT_END);
     }
     /* 操作符为逻辑与且左侧为假，短路 */
@@ -472,6 +710,7 @@ static SCP_Value eval_logical_and_or_expression(SCP_Interpreter *inter, LocalEnv
 
     right_val = eval_expression(inter, env, right);
     if (right_val.type != SCP_BOOLEAN_VALUE) {
+        release_if_string(&right_val);
         scp_runtime_error(right->line_number, NOT_BOOLEAN_TYPE_ERR, MESSAGE_ARGUMENT_END);
     }
     /* 经过短路判断之后，不管是或还是与，结果值即为右侧值 */
@@ -498,6 +737,7 @@ SCP_Value scp_eval_minus_expression(SCP_Interpreter *inter, LocalEnvironment *en
         result.u.double_value = -exp_val.u.double_value;
     }
     else {
+        release_if_string(&exp_val);
         scp_runtime_error(exp->line_number, MINUS_OPERAND_TYPE_ERR,MESSAGE_ARGUMENT_END);
     }
     return result;
@@ -505,8 +745,8 @@ SCP_Value scp_eval_minus_expression(SCP_Interpreter *inter, LocalEnvironment *en
 
 
 /* 清除局部环境 */
-static void dispose_local_environment(LocalEnvironment *env)
-{   
+static void release_local_variables(LocalEnvironment *env)
+{
     /* 从头部开始释放变量链表 */
     while (env->variable) {
         Variable *temp = env->variable;
@@ -522,9 +762,31 @@ static void dispose_local_environment(LocalEnvironment *env)
         env->global_variable = ref->next;
         MEM_free(ref);
     }
+}
+
+/* 销毁局部环境 */
+void scp_dispose_local_environment(LocalEnvironment *env)
+{
+    release_local_variables(env);
     MEM_free(env);
 }
 
+/* 回卷根的释放函数 */
+static void release_environment_root(void *env)
+{
+    scp_dispose_local_environment(env);
+}
+
+static void release_variables_root(void *env)
+{
+    release_local_variables(env);
+}
+
+static void release_memo_root(void *entry)
+{
+    scp_memo_discard(entry);
+}
+
 /* 调用原生函数 */
 static SCP_Value call_native_function(SCP_Interpreter *inter, LocalEnvironment *env,
                      Expression *expr, SCP_NativeFunctionProc *proc)
@@ -537,12 +799,19 @@ static SCP_Value call_native_function(SCP_Interpreter *inter, LocalEnvironment *
         arg_count++;
     }
     SCP_Value *args = MEM_malloc(sizeof(SCP_Value) * arg_count);
+    /* 实参数组和已计算的实参在出错时由回卷根释放 */
+    for (i = 0; i < arg_count; i++) {
+        args[i].type = SCP_NULL_VALUE;
+    }
+    scp_push_unwind_root(inter, args, arg_count, args, MEM_free);
     /* 计算每个实参 */
-    for (arg_p = expr->u.function_call_expression.argument; arg_p; arg_p = arg_p->next, i++){
+    for (i = 0, arg_p = expr->u.function_call_expression.argument; arg_p;
+         arg_p = arg_p->next, i++) {
         args[i] = eval_expression(inter, env, arg_p->expression);
     }
     /* 执行传入的原生函数 */
     SCP_Value value = proc(inter, arg_count, args);
+    SCP_POP_UNWIND_ROOT(inter);
     for (i = 0; i < arg_count; i++) {
         release_if_string(&args[i]);        /* 释放字串 */
     }
@@ -550,18 +819,117 @@ static SCP_Value call_native_function(SCP_Interpreter *inter, LocalEnvironment *
     return value;
 }
 
-/* 调用sicpy函数 */
-static SCP_Value call_sicpy_function(SCP_Interpreter *inter, LocalEnvironment *env,
-                      Expression *expr, FunctionDefinition *func)
+/* 调用栈压入一帧，空间不足时加倍 */
+static void push_call_frame(SCP_Interpreter *inter, FunctionDefinition *func, int line_number)
+{
+    CallFrame *frame;
+
+    if (inter->call_stack_depth == inter->call_stack_size) {
+        inter->call_stack_size = inter->call_stack_size ? inter->call_stack_size * 2
+                                                        : CALL_STACK_INITIAL_SIZE;
+        inter->call_stack = MEM_realloc(inter->call_stack,
+                                        sizeof(CallFrame) * inter->call_stack_size);
+    }
+    frame = &inter->call_stack[inter->call_stack_depth++];
+    frame->func = func;
+    frame->line_number = line_number;
+}
+
+/* 弹出调用栈顶帧，当前行号回到调用处 */
+static void pop_call_frame(SCP_Interpreter *inter)
+{
+    inter->call_stack_depth--;
+    inter->current_line_number = inter->call_stack[inter->call_stack_depth].line_number;
+}
+
+/*
+ * 执行sicpy函数体，实参已绑定在local_env中，执行完毕后销毁local_env。
+ * local_env由调用方压入回卷根，这里在接管它时弹出
+ */
+SCP_Value scp_execute_sicpy_function(SCP_Interpreter *inter, LocalEnvironment *local_env,
+                                     FunctionDefinition *func, int line_number)
 {
     SCP_Value   value;
-    ArgumentList        *arg_p;
-    ParameterList       *param_p;
+    StatementResult result;
+    MemoEntry   *memo_entry = NULL;
+    char stack_marker;
 
-    /* 初始化局部环境 */
+    /* C栈将要用尽时换到新的栈段上执行 */
+    if (&stack_marker < inter->stack_limit)
+        return scp_call_on_stack_segment(inter, local_env, func, line_number);
+    SCP_LIMIT_TICK(inter, line_number);
+    /* --lazy时第一次执行前分析函数体 */
+    if (__atomic_load_n(&func->u.sicpy_f.lazy, __ATOMIC_ACQUIRE)) {
+        scp_compile_lazy_function(inter, func);
+    }
+    /* memo函数先查缓存，缓存不是线程安全的，工作线程中直接执行 */
+    if (func->u.sicpy_f.memo && inter->parent == NULL) {
+        if (scp_memo_lookup(func, local_env, &value, &memo_entry)) {
+            SCP_POP_UNWIND_ROOT(inter);
+            scp_dispose_local_environment(local_env);
+            return value;
+        }
+    }
+    /* 热点函数以机器码执行，不能执行时照常解释 */
+    if (inter->jit_enabled && !func->u.sicpy_f.is_generator
+        && scp_jit_execute(inter, func, local_env, &value)) {
+        SCP_POP_UNWIND_ROOT(inter);
+        scp_dispose_local_environment(local_env);
+        return value;
+    }
+    push_call_frame(inter, func, line_number);
+    /* 生成器函数在自己的帧中执行，遇到yield时挂起，局部环境归生成器帧所有 */
+    if (func->u.sicpy_f.is_generator) {
+        SCP_POP_UNWIND_ROOT(inter);
+        value = scp_resume_generator(inter, func, local_env, line_number);
+        pop_call_frame(inter);
+        return value;
+    }
+    if (memo_entry) {
+        scp_push_unwind_root(inter, NULL, 0, memo_entry, release_memo_root);
+    }
+    /* 尾调用自身时形参已重新绑定，从头执行函数体，每次尾调用也计一个节拍 */
+    for (;;) {
+        result = scp_execute_statement_list(inter, local_env,
+                                            func->u.sicpy_f.block->statement_list);
+        if (result.type != TAIL_CALL_STATEMENT_RESULT)
+            break;
+        SCP_LIMIT_TICK(inter, inter->current_line_number);
+    }
+    /* 如果是正常的return结果，存入value中，否则置空 */
+    if (result.type == RETURN_STATEMENT_RESULT) {
+        value = result.return_value;
+    } else {
+        value.type = SCP_NULL_VALUE;
+    }
+    if (memo_entry) {
+        SCP_POP_UNWIND_ROOT(inter);
+    }
+    SCP_POP_UNWIND_ROOT(inter);
+    scp_dispose_local_environment(local_env);
+    pop_call_frame(inter);
+    if (memo_entry) {
+        scp_memo_store(func, memo_entry, &value);
+    }
+
+    return value;
+}
+
+/* 创建空的局部环境 */
+static LocalEnvironment * alloc_local_environment(void)
+{
     LocalEnvironment    *local_env = MEM_malloc(sizeof(LocalEnvironment));
     local_env->variable = NULL;
     local_env->global_variable = NULL;
+    return local_env;
+}
+
+/* 在env中计算实参，依次绑定到local_env的形参 */
+static void bind_arguments(SCP_Interpreter *inter, LocalEnvironment *env, Expression *expr,
+                           FunctionDefinition *func, LocalEnvironment *local_env)
+{
+    ArgumentList        *arg_p;
+    ParameterList       *param_p;
 
     for(arg_p = expr->u.function_call_expression.argument, param_p = func->u.sicpy_f.parameter;
         arg_p; arg_p = arg_p->next, param_p = param_p->next) {
@@ -578,15 +946,74 @@ static SCP_Value call_sicpy_function(SCP_Interpreter *inter, LocalEnvironment *e
     if (param_p) {
         scp_runtime_error(expr->line_number, ARGUMENT_TOO_FEW_ERR, MESSAGE_ARGUMENT_END);
     }
-    StatementResult result = scp_execute_statement_list(inter, local_env,
-                                        func->u.sicpy_f.block->statement_list);
-    /* 如果是正常的return结果，存入value中，否则置空 */
-    if (result.type == RETURN_STATEMENT_RESULT) {
-        value = result.return_value;
-    } else {
-        value.type = SCP_NULL_VALUE;
+}
+
+/* 调用sicpy函数 */
+static SCP_Value call_sicpy_function(SCP_Interpreter *inter, LocalEnvironment *env,
+                      Expression *expr, FunctionDefinition *func)
+{
+    /* 初始化局部环境 */
+    LocalEnvironment    *local_env = alloc_local_environment();
+
+    scp_push_unwind_root(inter, NULL, 0, local_env, release_environment_root);
+    bind_arguments(inter, env, expr, func, local_env);
+    return scp_execute_sicpy_function(inter, local_env, func, expr->line_number);
+}
+
+/* 尾调用自身：在当前环境中计算实参，再清空当前环境的变量和global引用并绑定新的实参 */
+void scp_prepare_tail_call(SCP_Interpreter *inter, LocalEnvironment *env, Expression *expr)
+{
+    FunctionDefinition  *func = scp_search_function(expr->u.function_call_expression.identifier);
+    LocalEnvironment    new_env;
+
+    new_env.variable = NULL;
+    new_env.global_variable = NULL;
+    scp_push_unwind_root(inter, NULL, 0, &new_env, release_variables_root);
+    bind_arguments(inter, env, expr, func, &new_env);
+    SCP_POP_UNWIND_ROOT(inter);
+    release_local_variables(env);
+    env->variable = new_env.variable;
+}
+
+/* 以已计算好的实参调用函数，实参的引用转移给被调函数 */
+SCP_Value scp_call_function(SCP_Interpreter *inter, FunctionDefinition *func,
+                            int arg_count, SCP_Value *args, int line_number)
+{
+    SCP_Value   value;
+    ParameterList       *param_p;
+    LocalEnvironment    *local_env;
+    int i;
+
+    switch (func->type) {
+    case SICPY_FUNCTION_DEFINITION:
+        local_env = alloc_local_environment();
+        scp_push_unwind_root(inter, NULL, 0, local_env, release_environment_root);
+        for (i = 0, param_p = func->u.sicpy_f.parameter; i < arg_count;
+             i++, param_p = param_p->next) {
+            if (param_p == NULL) {
+                for (; i < arg_count; i++) {
+                    release_if_string(&args[i]);
+                }
+                scp_runtime_error(line_number, ARGUMENT_TOO_MANY_ERR, MESSAGE_ARGUMENT_END);
+            }
+            scp_add_local_variable(local_env, param_p->name, &args[i]);
+        }
+        if (param_p) {
+            scp_runtime_error(line_number, ARGUMENT_TOO_FEW_ERR, MESSAGE_ARGUMENT_END);
+        }
+        value = scp_execute_sicpy_function(inter, local_env, func, line_number);
+        break;
+    case NATIVE_FUNCTION_DEFINITION:
+        scp_push_unwind_root(inter, args, arg_count, NULL, NULL);
+        value = func->u.native_f.proc(inter, arg_count, args);
+        SCP_POP_UNWIND_ROOT(inter);
+        for (i = 0; i < arg_count; i++) {
+            release_if_string(&args[i]);
+        }
+        break;
+    default:
+        DBG_panic(("bad case..%d\n", func->type));
     }
-    dispose_local_environment(local_env);
 
     return value;
 }
@@ -621,9 +1048,31 @@ static SCP_Value eval_function_call_expression(SCP_Interpreter *inter, LocalEnvi
 }
 
 /* 计算表达式 */
+/*
+ * 循环不变表达式在每次进入循环后第一次求值时计算，之后取缓存；值只会是数值或布尔值，
+ * 不涉及引用计数。工作线程共享语法树，不使用缓存
+ */
+static SCP_Value eval_loop_invariant_expression(SCP_Interpreter *inter, LocalEnvironment *env,
+                                                LoopInvariantExpression *invariant)
+{
+    if (inter->parent != NULL)
+        return eval_expression(inter, env, invariant->operand);
+    if (invariant->epoch != *invariant->loop_epoch) {
+        invariant->value = eval_expression(inter, env, invariant->operand);
+        DBG_assert(invariant->value.type != SCP_STRING_VALUE, ("line %d\n",
+                                                               invariant->operand->line_number));
+        invariant->epoch = *invariant->loop_epoch;
+    }
+    return invariant->value;
+}
+
 static SCP_Value eval_expression(SCP_Interpreter *inter, LocalEnvironment *env, Expression *expr)
 {
     SCP_Value   v;
+#ifdef SCP_INSTRUMENT
+    InstrumentSpan span;
+    scp_instrument_begin(inter, &span);
+#endif
 
     /* 根据表达式类型计算 */
     switch (expr->type){
@@ -640,11 +1089,9 @@ static SCP_Value eval_expression(SCP_Interpreter *inter, LocalEnvironment *env,
         v.u.double_value = expr->u.double_value;
         break;
     case STRING_EXPRESSION:
+        /* 字面常量在编译期已创建，不进行引用计数 */
         v.type = SCP_STRING_VALUE;
-        /* 字符数组转scp字符串，引用计数=1 */
-        SCP_String *string = alloc_scp_string(expr->u.string_value, SCP_TRUE);
-        string->ref_count = 1;
-        v.u.string_value = string;      /* 字串赋值给v */
+        v.u.string_value = expr->u.string_value;
         break;
     case IDENTIFIER_EXPRESSION:
         v = get_identifier_value(inter, env, expr);
@@ -653,6 +1100,13 @@ static SCP_Value eval_expression(SCP_Interpreter *inter, LocalEnvironment *env,
         v = eval_assign_expression(inter, env, expr->u.assign_expression.variable,
                                    expr->u.assign_expression.operand);
         break;
+    case COMPOUND_ASSIGN_EXPRESSION:
+        v = eval_compound_assign_expression(inter, env, expr);
+        break;
+    case INCREMENT_EXPRESSION:
+    case DECREMENT_EXPRESSION:
+        v = eval_increment_expression(inter, env, expr);
+        break;
     
     /* 二元表达式计算 */
     case ADD_EXPRESSION:
@@ -666,6 +1120,15 @@ static SCP_Value eval_expression(SCP_Interpreter *inter, LocalEnvironment *env,
     case GE_EXPRESSION:
     case LT_EXPRESSION:
     case LE_EXPRESSION:
+        /* 两侧都被证明为int时走不检查类型的路径 */
+        if (expr->u.binary_expression.left->static_type == INFER_INT
+            && expr->u.binary_expression.right->static_type == INFER_INT) {
+            eval_binary_int(inter, expr->type,
+                            eval_int_expression(inter, env, expr->u.binary_expression.left),
+                            eval_int_expression(inter, env, expr->u.binary_expression.right),
+                            &v, expr->u.binary_expression.left->line_number);
+            break;
+        }
         v = scp_eval_binary_expression(inter, env, expr->type, expr->u.binary_expression.left,
                                        expr->u.binary_expression.right);
         break;
@@ -681,6 +1144,9 @@ static SCP_Value eval_expression(SCP_Interpreter *inter, LocalEnvironment *env,
     case FUNCTION_CALL_EXPRESSION:
         v = eval_function_call_expression(inter, env, expr);
         break;
+    case LOOP_INVARIANT_EXPRESSION:
+        v = eval_loop_invariant_expression(inter, env, expr->u.loop_invariant);
+        break;
     case NULL_EXPRESSION:
         v.type = SCP_NULL_VALUE;
         break;
@@ -688,6 +1154,9 @@ static SCP_Value eval_expression(SCP_Interpreter *inter, LocalEnvironment *env,
     default:
         DBG_panic(("bad case. type..%d\n", expr->type));
     }
+#ifdef SCP_INSTRUMENT
+    scp_instrument_end(inter, &span, INSTRUMENT_EXPRESSION_KIND(expr->type), expr->line_number);
+#endif
     return v;
 }
 
@@ -61,6 +61,17 @@ static StatementResult execute_global_statement(SCP_Interpreter *inter, LocalEnv
     return result;
 }
 
+/* 条件必须是布尔值，否则释放条件的值后报错 */
+static void check_condition(SCP_Value *cond, Expression *expr)
+{
+    if (cond->type == SCP_BOOLEAN_VALUE)
+        return;
+    if (cond->type == SCP_STRING_VALUE) {
+        scp_release_string(cond->u.string_value);
+    }
+    scp_runtime_error(expr->line_number, NOT_BOOLEAN_TYPE_ERR, MESSAGE_ARGUMENT_END);
+}
+
 /* 执行elif语句 */
 static StatementResult execute_elif(SCP_Interpreter *inter, LocalEnvironment *env,
               Elif *elif_list, SCP_Boolean *executed)
@@ -73,10 +84,7 @@ static StatementResult execute_elif(SCP_Interpreter *inter, LocalEnvironment *en
     /* 对于elif链表的每个元素，进行elif运算 */
     for (pos = elif_list; pos; pos = pos->next) {
         cond = scp_eval_expression(inter, env, pos->condition);
-        if (cond.type != SCP_BOOLEAN_VALUE) {
-            scp_runtime_error(pos->condition->line_number,
-                              NOT_BOOLEAN_TYPE_ERR, MESSAGE_ARGUMENT_END);
-        }
+        check_condition(&cond, pos->condition);
         if (cond.u.boolean_value) {
             result = scp_execute_statement_list(inter, env, pos->block->statement_list);
             *executed = SCP_TRUE;
@@ -95,10 +103,7 @@ static StatementResult execute_if_statement(SCP_Interpreter *inter, LocalEnviron
     SCP_Value   cond = scp_eval_expression(inter, env, statement->u.if_block.condition);
     result.type = NORMAL_STATEMENT_RESULT;
     /* 条件计算后不是布尔值报错 */
-    if (cond.type != SCP_BOOLEAN_VALUE) {
-        scp_runtime_error(statement->u.if_block.condition->line_number,
-                          NOT_BOOLEAN_TYPE_ERR, MESSAGE_ARGUMENT_END);
-    }
+    check_condition(&cond, statement->u.if_block.condition);
     DBG_assert(cond.type == SCP_BOOLEAN_VALUE, ("cond.type..%d", cond.type));
 
     /* 条件值为真，执行if语句链表 */
@@ -122,20 +127,40 @@ static StatementResult execute_if_statement(SCP_Interpreter *inter, LocalEnviron
     return result;
 }
 
+/*
+ * 进入循环时分配新的激活编号，循环不变表达式的缓存只在同一次激活中有效；
+ * 退出时恢复外层激活（递归调用中的同一循环）的编号，使其缓存失效后重新计算
+ */
+static unsigned long enter_loop(SCP_Interpreter *inter, unsigned long *epoch)
+{
+    unsigned long saved = *epoch;
+
+    if (inter->parent == NULL) {
+        *epoch = ++inter->loop_epoch;
+    }
+    return saved;
+}
+
+static void leave_loop(SCP_Interpreter *inter, unsigned long *epoch, unsigned long saved)
+{
+    if (inter->parent == NULL) {
+        *epoch = saved;
+    }
+}
+
 /* 执行while语句 */
 static StatementResult execute_while_statement(SCP_Interpreter *inter, LocalEnvironment *env,
                         Statement *statement)
 {
     StatementResult result;
     SCP_Value   cond;
+    unsigned long saved_epoch = enter_loop(inter, &statement->u.while_block.epoch);
 
     result.type = NORMAL_STATEMENT_RESULT;
     for (;;) {
+        SCP_LIMIT_TICK(inter, statement->line_number);
         cond = scp_eval_expression(inter, env, statement->u.while_block.condition);
-        if (cond.type != SCP_BOOLEAN_VALUE) {
-            scp_runtime_error(statement->u.while_block.condition->line_number,
-                              NOT_BOOLEAN_TYPE_ERR, MESSAGE_ARGUMENT_END);
-        }
+        check_condition(&cond, statement->u.while_block.condition);
         DBG_assert(cond.type == SCP_BOOLEAN_VALUE, ("cond.type..%d", cond.type));
         /* 条件非真值退出 */
         if (!cond.u.boolean_value)
@@ -144,7 +169,7 @@ static StatementResult execute_while_statement(SCP_Interpreter *inter, LocalEnvi
         result = scp_execute_statement_list(inter, env,
                                             statement->u.while_block.block ->statement_list);
         /* 执行return则退出 */
-        if (result.type == RETURN_STATEMENT_RESULT) {
+        if (result.type == RETURN_STATEMENT_RESULT || result.type == TAIL_CALL_STATEMENT_RESULT) {
             break;
         }
         /* 执行break则退出 */
@@ -154,6 +179,7 @@ static StatementResult execute_while_statement(SCP_Interpreter *inter, LocalEnvi
         }
     }
 
+    leave_loop(inter, &statement->u.while_block.epoch, saved_epoch);
     return result;
 }
 
@@ -163,6 +189,7 @@ static StatementResult execute_for_statement(SCP_Interpreter *inter, LocalEnviro
 {
     StatementResult result;
     SCP_Value   cond;
+    unsigned long saved_epoch;
 
     result.type = NORMAL_STATEMENT_RESULT;
 
@@ -170,13 +197,12 @@ static StatementResult execute_for_statement(SCP_Interpreter *inter, LocalEnviro
     if (statement->u.for_block.init) {
         scp_eval_expression(inter, env, statement->u.for_block.init);
     }
+    saved_epoch = enter_loop(inter, &statement->u.for_block.epoch);
     for (;;) {
+        SCP_LIMIT_TICK(inter, statement->line_number);
         if (statement->u.for_block.condition) {
             cond = scp_eval_expression(inter, env, statement->u.for_block.condition);
-            if (cond.type != SCP_BOOLEAN_VALUE) {
-                scp_runtime_error(statement->u.for_block.condition->line_number,
-                                  NOT_BOOLEAN_TYPE_ERR, MESSAGE_ARGUMENT_END);
-            }
+            check_condition(&cond, statement->u.for_block.condition);
             DBG_assert(cond.type == SCP_BOOLEAN_VALUE, ("cond.type..%d", cond.type));
             if (!cond.u.boolean_value)
                 break;
@@ -184,7 +210,7 @@ static StatementResult execute_for_statement(SCP_Interpreter *inter, LocalEnviro
         result = scp_execute_statement_list(inter, env,
                                             statement->u.for_block.block ->statement_list);
         /* 执行return或break则退出 */
-        if (result.type == RETURN_STATEMENT_RESULT) {
+        if (result.type == RETURN_STATEMENT_RESULT || result.type == TAIL_CALL_STATEMENT_RESULT) {
             break;
         }
         else if (result.type == BREAK_STATEMENT_RESULT) {
@@ -198,6 +224,137 @@ static StatementResult execute_for_statement(SCP_Interpreter *inter, LocalEnviro
         }
     }
 
+    leave_loop(inter, &statement->u.for_block.epoch, saved_epoch);
+    return result;
+}
+
+/* 计算range()的一个参数，省略时取默认值 */
+static long eval_range_argument(SCP_Interpreter *inter, LocalEnvironment *env,
+                                Expression *expr, long default_value)
+{
+    SCP_Value v;
+
+    if (expr == NULL)
+        return default_value;
+    v = scp_eval_expression(inter, env, expr);
+    if (v.type != SCP_INT_VALUE) {
+        if (v.type == SCP_STRING_VALUE) {
+            scp_release_string(v.u.string_value);
+        }
+        scp_runtime_error(expr->line_number, RANGE_ARGUMENT_TYPE_ERR, MESSAGE_ARGUMENT_END);
+    }
+    return v.u.int_value;
+}
+
+/* 在int分支的有序表中二分查找 */
+static Block * search_match_int(MatchBlock *match, int value)
+{
+    int low = 0, high = match->int_count - 1, middle;
+
+    while (low <= high) {
+        middle = low + (high - low) / 2;
+        if (match->int_table[middle].value == value) {
+            return match->int_table[middle].block;
+        } else if (match->int_table[middle].value < value) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return NULL;
+}
+
+/* 在string分支的散列表中查找，散列值相同时才比较字符串 */
+static Block * search_match_string(MatchBlock *match, SCP_String *str)
+{
+    MatchStringEntry *entry;
+    unsigned int hash, i;
+
+    if (match->string_table == NULL)
+        return NULL;
+    hash = scp_hash_string(str->string, str->length);
+    for (i = hash & match->string_mask; match->string_table[i].string;
+         i = (i + 1) & match->string_mask) {
+        entry = &match->string_table[i];
+        if (entry->hash == hash && entry->length == str->length
+            && !memcmp(entry->string, str->string, str->length)) {
+            return entry->block;
+        }
+    }
+    return NULL;
+}
+
+/* 执行match语句，按值的类型查表后只执行一个分支，没有匹配的分支时执行default */
+static StatementResult execute_match_statement(SCP_Interpreter *inter, LocalEnvironment *env,
+                                               Statement *statement)
+{
+    MatchBlock *match = &statement->u.match_block;
+    SCP_Value value = scp_eval_expression(inter, env, match->condition);
+    StatementResult result;
+    Block *block = NULL;
+
+    if (value.type == SCP_INT_VALUE) {
+        block = search_match_int(match, value.u.int_value);
+    } else if (value.type == SCP_STRING_VALUE) {
+        block = search_match_string(match, value.u.string_value);
+        scp_release_string(value.u.string_value);
+    }
+    if (block == NULL) {
+        block = match->default_block;
+    }
+    if (block == NULL) {
+        result.type = NORMAL_STATEMENT_RESULT;
+        return result;
+    }
+    return scp_execute_statement_list(inter, env, block->statement_list);
+}
+
+/* 执行for-in语句，range的参数只计算一次，计数器为C整数，每次循环直接写入循环变量 */
+static StatementResult execute_range_for_statement(SCP_Interpreter *inter, LocalEnvironment *env,
+                                                   Statement *statement)
+{
+    RangeForBlock *range = &statement->u.range_for_block;
+    StatementResult result;
+    Variable *var = NULL;
+    long start, end, step, i;
+    unsigned long saved_epoch;
+
+    result.type = NORMAL_STATEMENT_RESULT;
+    start = eval_range_argument(inter, env, range->start, 0);
+    end = eval_range_argument(inter, env, range->end, 0);
+    step = eval_range_argument(inter, env, range->step, 1);
+    if (step == 0) {
+        scp_runtime_error(statement->line_number, RANGE_STEP_ZERO_ERR, MESSAGE_ARGUMENT_END);
+    }
+
+    saved_epoch = enter_loop(inter, &range->epoch);
+
+    for (i = start; step > 0 ? i < end : i > end; i += step) {
+        SCP_LIMIT_TICK(inter, statement->line_number);
+        /* 循环变量在第一次循环时才绑定，空的range不改变它 */
+        if (var == NULL) {
+            var = scp_search_assign_target(inter, env, range->variable);
+        }
+        /* 循环体中可能给循环变量赋过字符串 */
+        if (var->value.type == SCP_STRING_VALUE) {
+            scp_release_string(var->value.u.string_value);
+        }
+        var->value.type = SCP_INT_VALUE;
+        var->value.u.int_value = (int)i;
+
+        result = scp_execute_statement_list(inter, env, range->block->statement_list);
+        /* 执行return或break则退出 */
+        if (result.type == RETURN_STATEMENT_RESULT || result.type == TAIL_CALL_STATEMENT_RESULT) {
+            break;
+        }
+        else if (result.type == BREAK_STATEMENT_RESULT) {
+            result.type = NORMAL_STATEMENT_RESULT;
+            break;
+        }
+        result.type = NORMAL_STATEMENT_RESULT;
+    }
+
+    leave_loop(inter, &range->epoch, saved_epoch);
     return result;
 }
 
@@ -206,6 +363,15 @@ static StatementResult execute_return_statement(SCP_Interpreter *inter, LocalEnv
                          Statement *statement)
 {
     StatementResult result;
+    Expression *expr = statement->u.return_expression;
+
+    /* 尾调用自身不递归，复用当前环境重新执行函数体 */
+    if (expr && expr->type == FUNCTION_CALL_EXPRESSION
+        && expr->u.function_call_expression.is_tail_call) {
+        scp_prepare_tail_call(inter, env, expr);
+        result.type = TAIL_CALL_STATEMENT_RESULT;
+        return result;
+    }
     result.type = RETURN_STATEMENT_RESULT;
     /* 有表达式则执行，否则返回空 */
     if (statement->u.return_expression) {
@@ -218,13 +384,43 @@ static StatementResult execute_return_statement(SCP_Interpreter *inter, LocalEnv
     return result;
 }
 
+/* 执行yield语句，挂起当前生成器帧，下次调用该函数时从这里继续 */
+static StatementResult execute_yield_statement(SCP_Interpreter *inter, LocalEnvironment *env,
+                         Statement *statement)
+{
+    StatementResult result;
+    SCP_Value value;
+
+    result.type = NORMAL_STATEMENT_RESULT;
+    /* 有表达式则执行，否则产出空 */
+    if (statement->u.yield_expression) {
+        value = scp_eval_expression(inter, env, statement->u.yield_expression);
+    }
+    else {
+        value.type = SCP_NULL_VALUE;
+    }
+    scp_generator_yield(inter, &value);
+
+    return result;
+}
+
 /* 执行语句 */
 static StatementResult execute_statement(SCP_Interpreter *inter, LocalEnvironment *env,
                   Statement *statement)
 {
     StatementResult result;
+#ifdef SCP_INSTRUMENT
+    InstrumentSpan span;
+    scp_instrument_begin(inter, &span);
+#endif
     result.type = NORMAL_STATEMENT_RESULT;
 
+    /* 期间到达的采样都计入上一条开始执行的语句，仅主解释器采样 */
+    if (scp_profile_pending && inter->profiler) {
+        scp_profile_sample(inter);
+    }
+    inter->current_line_number = statement->line_number;
+
     /* 根据语句类型执行语句 */
     switch (statement->type) {
     case EXPRESSION_STATEMENT:
@@ -251,10 +447,23 @@ static StatementResult execute_statement(SCP_Interpreter *inter, LocalEnvironmen
     case CONTINUE_STATEMENT:
         result.type = CONTINUE_STATEMENT_RESULT;
         break;
+    case YIELD_STATEMENT:
+        result = execute_yield_statement(inter, env, statement);
+        break;
+    case RANGE_FOR_STATEMENT:
+        result = execute_range_for_statement(inter, env, statement);
+        break;
+    case MATCH_STATEMENT:
+        result = execute_match_statement(inter, env, statement);
+        break;
     case STATEMENT_TYPE_COUNT_PLUS_1:   /* FALLTHRU */
     default:
         DBG_panic(("bad case...%d", statement->type));
     }
+#ifdef SCP_INSTRUMENT
+    scp_instrument_end(inter, &span, INSTRUMENT_STATEMENT_KIND(statement->type),
+                       statement->line_number);
+#endif
 
     return result;
 }
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <string.h>
+#include <ucontext.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+#define GENERATOR_STACK_SIZE    (1024 * 1024)   /* 每个生成器帧的C栈大小 */
+
+/*
+ * 生成器帧：每个生成器函数同一时间至多一个，在自己的C栈上执行，yield时切回调用方。
+ * 帧属于开始它的调用方函数，只有同一函数中的调用才恢复它，
+ * 其他函数在它挂起期间调用这个生成器函数是第二次激活，作为错误，不会与之混用
+ */
+struct GeneratorFrame_tag {
+    FunctionDefinition  *func;
+    FunctionDefinition  *owner;             /* 开始这个帧的调用方函数，顶层代码为NULL */
+    LocalEnvironment    *env;               /* 生成器的局部环境，挂起期间保留 */
+    ucontext_t          context;            /* 生成器自己的执行上下文 */
+    ucontext_t          caller_context;     /* 最近一次恢复它的调用方 */
+    char                *stack;
+    SCP_Value           value;              /* yield或return传出的值 */
+    SCP_Boolean         running;
+    SCP_Boolean         finished;
+#ifdef SCP_INSTRUMENT
+    InstrumentClock     clock;              /* 生成器自己的插桩计时上下文 */
+#endif
+    struct GeneratorFrame_tag *next;
+};
+
+/* 生成器帧的入口，执行函数体直到结束 */
+static void generator_entry(void)
+{
+    SCP_Interpreter *inter = scp_get_interpreter();
+    GeneratorFrame *frame = inter->current_generator;
+    StatementResult result;
+
+    result = scp_execute_statement_list(inter, frame->env,
+                                        frame->func->u.sicpy_f.block->statement_list);
+    /* return的值作为本次调用的结果，之后再调用则重新开始 */
+    if (result.type == RETURN_STATEMENT_RESULT) {
+        frame->value = result.return_value;
+    } else {
+        frame->value.type = SCP_NULL_VALUE;
+    }
+    scp_dispose_local_environment(frame->env);
+    frame->env = NULL;
+    frame->finished = SCP_TRUE;
+    setcontext(&frame->caller_context);
+}
+
+/* 查找函数对应的挂起帧 */
+static GeneratorFrame * search_generator(SCP_Interpreter *inter, FunctionDefinition *func)
+{
+    GeneratorFrame *pos;
+    for (pos = inter->generator_list; pos; pos = pos->next) {
+        if (pos->func == func)
+            return pos;
+    }
+    return NULL;
+}
+
+/* 新建生成器帧，env为首次调用时绑定好实参的局部环境 */
+static GeneratorFrame * create_generator(SCP_Interpreter *inter, FunctionDefinition *func,
+                                         FunctionDefinition *owner, LocalEnvironment *env)
+{
+    GeneratorFrame *frame = MEM_malloc(sizeof(GeneratorFrame));
+    frame->func = func;
+    frame->owner = owner;
+    frame->env = env;
+    frame->stack = MEM_malloc(GENERATOR_STACK_SIZE);
+    frame->running = SCP_FALSE;
+    frame->finished = SCP_FALSE;
+    frame->value.type = SCP_NULL_VALUE;
+#ifdef SCP_INSTRUMENT
+    scp_instrument_init_clock(&frame->clock);
+#endif
+
+    getcontext(&frame->context);
+    frame->context.uc_stack.ss_sp = frame->stack;
+    frame->context.uc_stack.ss_size = GENERATOR_STACK_SIZE;
+    frame->context.uc_link = NULL;
+    makecontext(&frame->context, generator_entry, 0);
+
+    /* 头插法加入解释器的生成器链表 */
+    frame->next = inter->generator_list;
+    inter->generator_list = frame;
+
+    return frame;
+}
+
+/* 从链表中移除并释放生成器帧 */
+static void dispose_generator(SCP_Interpreter *inter, GeneratorFrame *frame)
+{
+    GeneratorFrame **pos;
+    for (pos = &inter->generator_list; *pos; pos = &(*pos)->next) {
+        if (*pos == frame) {
+            *pos = frame->next;
+            break;
+        }
+    }
+    if (frame->env) {
+        scp_dispose_local_environment(frame->env);
+    }
+    MEM_free(frame->stack);
+    MEM_free(frame);
+}
+
+/* 调用方函数的名字，用于报错 */
+static char * caller_name(FunctionDefinition *caller)
+{
+    return caller ? caller->name : "<toplevel>";
+}
+
+/*
+ * 调用生成器函数：没有挂起的帧则以env新建一个帧从头执行，否则丢弃本次实参并恢复挂起的帧。
+ * 执行到yield时返回产出的值，函数结束时返回return的值并销毁帧。
+ * 调用栈顶是生成器函数自己，其下是调用方
+ */
+SCP_Value scp_resume_generator(SCP_Interpreter *inter, FunctionDefinition *func,
+                               LocalEnvironment *env, int line_number)
+{
+    GeneratorFrame *frame = search_generator(inter, func);
+    FunctionDefinition *caller = inter->call_stack_depth >= 2
+        ? inter->call_stack[inter->call_stack_depth - 2].func : NULL;
+    GeneratorFrame *caller_generator;
+    char *caller_stack_limit;
+    SCP_Value value;
+#ifdef SCP_INSTRUMENT
+    InstrumentClock *caller_clock;
+#endif
+
+    if (frame == NULL) {
+        frame = create_generator(inter, func, caller, env);
+    }
+    else {
+        scp_dispose_local_environment(env);
+        /* 生成器在自己的函数体中再次调用自己 */
+        if (frame->running) {
+            scp_runtime_error(line_number, GENERATOR_RUNNING_ERR,
+                              STRING_MESSAGE_ARGUMENT, "name", func->name, MESSAGE_ARGUMENT_END);
+        }
+        /* 另一个函数在帧挂起期间开始第二次激活，恢复挂起的帧会使两者交替取值 */
+        if (frame->owner != caller) {
+            scp_runtime_error(line_number, GENERATOR_ACTIVE_ERR,
+                              STRING_MESSAGE_ARGUMENT, "name", func->name,
+                              STRING_MESSAGE_ARGUMENT, "owner", caller_name(frame->owner),
+                              STRING_MESSAGE_ARGUMENT, "caller", caller_name(caller),
+                              MESSAGE_ARGUMENT_END);
+        }
+    }
+
+    caller_generator = inter->current_generator;
+    inter->current_generator = frame;
+    frame->running = SCP_TRUE;
+    /* 生成器在自己的C栈上执行，栈下限随之切换 */
+    caller_stack_limit = inter->stack_limit;
+    inter->stack_limit = frame->stack + SCP_STACK_MARGIN;
+#ifdef SCP_INSTRUMENT
+    caller_clock = scp_instrument_switch_clock(inter, &frame->clock);
+#endif
+    swapcontext(&frame->caller_context, &frame->context);
+#ifdef SCP_INSTRUMENT
+    scp_instrument_switch_clock(inter, caller_clock);
+#endif
+    inter->stack_limit = caller_stack_limit;
+    frame->running = SCP_FALSE;
+    inter->current_generator = caller_generator;
+
+    value = frame->value;
+    if (frame->finished) {
+        dispose_generator(inter, frame);
+    }
+
+    return value;
+}
+
+/* yield：保存产出的值并切回调用方，下次恢复时从这里返回 */
+void scp_generator_yield(SCP_Interpreter *inter, SCP_Value *value)
+{
+    GeneratorFrame *frame = inter->current_generator;
+
+    DBG_assert(frame != NULL, ("yield outside generator\n"));
+    frame->value = *value;
+    swapcontext(&frame->context, &frame->caller_context);
+}
+
+/* 任意一个挂起中的生成器函数的名字，没有挂起的帧时返回NULL */
+char * scp_suspended_generator_name(SCP_Interpreter *inter)
+{
+    return inter->generator_list ? inter->generator_list->func->name : NULL;
+}
+
+/* 销毁解释器中所有挂起的生成器帧 */
+void scp_dispose_generators(SCP_Interpreter *inter)
+{
+    while (inter->generator_list) {
+        dispose_generator(inter, inter->generator_list);
+    }
+}
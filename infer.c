@@ -0,0 +1,704 @@
+#include <stdio.h>
+#include <string.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+/*
+ * 静态类型推断：语法分析结束后，对每个函数和顶层语句做一次流敏感的抽象解释，
+ * 在每个表达式节点上记下它可能产生的值的类型（所有执行路径的并）。
+ * 分支汇合时合并变量的类型，循环反复分析到变量类型不再变化；
+ * 函数的返回值类型在所有函数之间迭代到不动点。
+ * 声明为global的变量可能被任何函数修改，始终视为ANY；形参、原生函数和生成器的结果也是ANY。
+ * 解释器对两侧都被证明为int的二元运算使用不检查类型的求值路径。
+ */
+
+/* 分析单元（一个函数或顶层）中出现的变量 */
+typedef struct {
+    char        **name;
+    InferType   *initial;       /* 进入单元时的类型 */
+    InferType   *summary;       /* 所有赋值的类型的并，用于输出 */
+    SCP_Boolean *is_global;
+    int         count;
+    int         alloc;
+} InferVariables;
+
+/* 程序某一点的抽象状态，下标不超过count的变量类型，其余取initial */
+typedef struct {
+    InferType   *type;
+    int         count;
+    SCP_Boolean reachable;
+} InferState;
+
+/* 当前所在循环中break和continue带出的状态 */
+typedef struct InferLoop_tag {
+    InferState  break_state;
+    InferState  continue_state;
+    struct InferLoop_tag *outer;
+} InferLoop;
+
+typedef struct {
+    SCP_Interpreter *inter;
+    InferVariables  variables;
+    InferType       return_type;
+    InferLoop       *loop;
+    SCP_Boolean     is_toplevel;
+    IdentifierList  *globals;           /* 视为global的名字，顶层为任一函数中声明过的 */
+} InferUnit;
+
+static char *st_type_name[] = {
+    "none",
+    "boolean",
+    "int",
+    "double",
+    "string",
+    "null",
+    "any",
+};
+
+/* 类型的并 */
+static InferType join_type(InferType a, InferType b)
+{
+    if (a == INFER_UNKNOWN)
+        return b;
+    if (b == INFER_UNKNOWN || a == b)
+        return a;
+    return INFER_ANY;
+}
+
+static SCP_Boolean is_number_type(InferType type)
+{
+    return type == INFER_INT || type == INFER_DOUBLE;
+}
+
+/* 取得变量的下标，第一次出现时登记 */
+static int variable_index(InferUnit *unit, char *name)
+{
+    InferVariables *vars = &unit->variables;
+    int i;
+
+    for (i = 0; i < vars->count; i++) {
+        if (!strcmp(vars->name[i], name))
+            return i;
+    }
+    if (vars->count >= vars->alloc) {
+        vars->alloc = vars->alloc ? vars->alloc * 2 : 16;
+        vars->name = MEM_realloc(vars->name, sizeof(char *) * vars->alloc);
+        vars->initial = MEM_realloc(vars->initial, sizeof(InferType) * vars->alloc);
+        vars->summary = MEM_realloc(vars->summary, sizeof(InferType) * vars->alloc);
+        vars->is_global = MEM_realloc(vars->is_global, sizeof(SCP_Boolean) * vars->alloc);
+    }
+    vars->name[i] = name;
+    vars->is_global[i] = scp_is_in_identifier_list(unit->globals, name);
+    /* 顶层可以读到解释器预先定义的全局变量，未赋值时类型未知；函数的局部变量未赋值时不可读 */
+    vars->initial[i] = (unit->is_toplevel || vars->is_global[i]) ? INFER_ANY : INFER_UNKNOWN;
+    vars->summary[i] = vars->is_global[i] ? INFER_ANY : INFER_UNKNOWN;
+    vars->count++;
+
+    return i;
+}
+
+static void init_state(InferState *state, SCP_Boolean reachable)
+{
+    state->type = NULL;
+    state->count = 0;
+    state->reachable = reachable;
+}
+
+static void dispose_state(InferState *state)
+{
+    MEM_free(state->type);
+    state->type = NULL;
+    state->count = 0;
+}
+
+static InferType get_type(InferUnit *unit, InferState *state, int index)
+{
+    if (index < state->count)
+        return state->type[index];
+    return unit->variables.initial[index];
+}
+
+/* 把状态扩展到当前登记的所有变量 */
+static void extend_state(InferUnit *unit, InferState *state)
+{
+    int i;
+
+    if (state->count >= unit->variables.count)
+        return;
+    state->type = MEM_realloc(state->type, sizeof(InferType) * unit->variables.count);
+    for (i = state->count; i < unit->variables.count; i++) {
+        state->type[i] = unit->variables.initial[i];
+    }
+    state->count = unit->variables.count;
+}
+
+/* 给变量赋上类型，global变量保持ANY */
+static void set_type(InferUnit *unit, InferState *state, int index, InferType type)
+{
+    if (unit->variables.is_global[index])
+        return;
+    extend_state(unit, state);
+    state->type[index] = type;
+    unit->variables.summary[index] = join_type(unit->variables.summary[index], type);
+}
+
+static void copy_state(InferUnit *unit, InferState *dest, InferState *src)
+{
+    dispose_state(dest);
+    dest->reachable = src->reachable;
+    if (src->count > 0) {
+        dest->type = MEM_malloc(sizeof(InferType) * src->count);
+        memcpy(dest->type, src->type, sizeof(InferType) * src->count);
+        dest->count = src->count;
+    }
+    extend_state(unit, dest);
+}
+
+/* dest与src合并，dest有变化时返回真 */
+static SCP_Boolean join_state(InferUnit *unit, InferState *dest, InferState *src)
+{
+    SCP_Boolean changed = SCP_FALSE;
+    InferType type;
+    int i;
+
+    if (!src->reachable)
+        return SCP_FALSE;
+    if (!dest->reachable) {
+        copy_state(unit, dest, src);
+        return SCP_TRUE;
+    }
+    extend_state(unit, dest);
+    for (i = 0; i < dest->count; i++) {
+        type = join_type(dest->type[i], get_type(unit, src, i));
+        if (type != dest->type[i]) {
+            dest->type[i] = type;
+            changed = SCP_TRUE;
+        }
+    }
+    return changed;
+}
+
+/* 记下表达式节点的类型，与之前的分析结果合并 */
+static InferType annotate(Expression *expr, InferType type)
+{
+    expr->static_type = join_type(expr->static_type, type);
+    return type;
+}
+
+/* 二元运算结果的类型，与eval_binary_value的分支对应 */
+static InferType binary_type(ExpressionType operator, InferType left, InferType right)
+{
+    if (left == INFER_UNKNOWN || right == INFER_UNKNOWN)
+        return INFER_UNKNOWN;
+    /* 比较运算的结果总是bool值，否则为运行错误 */
+    if (dkc_is_compare_operator(operator))
+        return INFER_BOOLEAN;
+    if (left == INFER_STRING && operator == ADD_EXPRESSION)
+        return INFER_STRING;
+    if (left == INFER_INT && right == INFER_INT)
+        return INFER_INT;
+    if (is_number_type(left) && is_number_type(right))
+        return INFER_DOUBLE;
+    return INFER_ANY;
+}
+
+static FunctionDefinition * search_function(SCP_Interpreter *inter, char *name)
+{
+    FunctionDefinition *pos;
+
+    for (pos = inter->function_list; pos; pos = pos->next) {
+        if (!strcmp(pos->name, name))
+            return pos;
+    }
+    return NULL;
+}
+
+static InferType infer_expression(InferUnit *unit, InferState *state, Expression *expr);
+
+static InferType infer_function_call(InferUnit *unit, InferState *state, Expression *expr)
+{
+    FunctionDefinition *func;
+    ArgumentList *arg;
+
+    for (arg = expr->u.function_call_expression.argument; arg; arg = arg->next) {
+        infer_expression(unit, state, arg->expression);
+    }
+    func = search_function(unit->inter, expr->u.function_call_expression.identifier);
+    if (func == NULL || func->type == NATIVE_FUNCTION_DEFINITION
+        || func->u.sicpy_f.is_generator) {
+        return INFER_ANY;
+    }
+    return func->u.sicpy_f.return_type;
+}
+
+static InferType infer_expression(InferUnit *unit, InferState *state, Expression *expr)
+{
+    InferState right_state;
+    InferType type, left, right;
+    int index;
+
+    switch (expr->type) {
+    case BOOLEAN_EXPRESSION:
+        type = INFER_BOOLEAN;
+        break;
+    case INT_EXPRESSION:
+        type = INFER_INT;
+        break;
+    case DOUBLE_EXPRESSION:
+        type = INFER_DOUBLE;
+        break;
+    case STRING_EXPRESSION:
+        type = INFER_STRING;
+        break;
+    case NULL_EXPRESSION:
+        type = INFER_NULL;
+        break;
+    case IDENTIFIER_EXPRESSION:
+        type = get_type(unit, state, variable_index(unit, expr->u.identifier));
+        break;
+    case ASSIGN_EXPRESSION:
+        type = infer_expression(unit, state, expr->u.assign_expression.operand);
+        index = variable_index(unit, expr->u.assign_expression.variable);
+        set_type(unit, state, index, type);
+        break;
+    case COMPOUND_ASSIGN_EXPRESSION:
+        /* 先计算右侧，再取变量 */
+        right = infer_expression(unit, state, expr->u.compound_assign_expression.operand);
+        index = variable_index(unit, expr->u.compound_assign_expression.variable);
+        type = binary_type(expr->u.compound_assign_expression.operator,
+                           get_type(unit, state, index), right);
+        set_type(unit, state, index, type);
+        break;
+    case INCREMENT_EXPRESSION:
+    case DECREMENT_EXPRESSION:
+        /* 只有数值能自增自减，变量的类型不变 */
+        type = get_type(unit, state, variable_index(unit, expr->u.identifier));
+        if (type != INFER_UNKNOWN && !is_number_type(type)) {
+            type = INFER_ANY;
+        }
+        break;
+    case ADD_EXPRESSION:
+    case SUB_EXPRESSION:
+    case MUL_EXPRESSION:
+    case DIV_EXPRESSION:
+    case MOD_EXPRESSION:
+    case EQ_EXPRESSION:
+    case NE_EXPRESSION:
+    case GT_EXPRESSION:
+    case GE_EXPRESSION:
+    case LT_EXPRESSION:
+    case LE_EXPRESSION:
+        left = infer_expression(unit, state, expr->u.binary_expression.left);
+        right = infer_expression(unit, state, expr->u.binary_expression.right);
+        type = binary_type(expr->type, left, right);
+        break;
+    case LOGICAL_AND_EXPRESSION:
+    case LOGICAL_OR_EXPRESSION:
+        /* 右侧可能被短路，之后的状态是两种情况的并 */
+        infer_expression(unit, state, expr->u.binary_expression.left);
+        init_state(&right_state, SCP_FALSE);
+        copy_state(unit, &right_state, state);
+        infer_expression(unit, &right_state, expr->u.binary_expression.right);
+        join_state(unit, state, &right_state);
+        dispose_state(&right_state);
+        type = INFER_BOOLEAN;
+        break;
+    case MINUS_EXPRESSION:
+        type = infer_expression(unit, state, expr->u.minus_expression);
+        if (type != INFER_UNKNOWN && !is_number_type(type)) {
+            type = INFER_ANY;
+        }
+        break;
+    case FUNCTION_CALL_EXPRESSION:
+        type = infer_function_call(unit, state, expr);
+        break;
+    case LOOP_INVARIANT_EXPRESSION:
+        type = infer_expression(unit, state, expr->u.loop_invariant->operand);
+        break;
+    case EXPRESSION_TYPE_COUNT_PLUS_1:
+    default:
+        DBG_panic(("bad case. type..%d\n", expr->type));
+    }
+
+    return annotate(expr, type);
+}
+
+static void infer_statement_list(InferUnit *unit, InferState *state, StatementList *list);
+
+/* 在新的循环上下文中分析循环体 */
+static void infer_loop_body(InferUnit *unit, InferState *state, InferLoop *loop, Block *block)
+{
+    init_state(&loop->break_state, SCP_FALSE);
+    init_state(&loop->continue_state, SCP_FALSE);
+    loop->outer = unit->loop;
+    unit->loop = loop;
+    infer_statement_list(unit, state, block->statement_list);
+    unit->loop = loop->outer;
+    join_state(unit, state, &loop->continue_state);
+}
+
+static void dispose_loop(InferLoop *loop)
+{
+    dispose_state(&loop->break_state);
+    dispose_state(&loop->continue_state);
+}
+
+static void infer_if_statement(InferUnit *unit, InferState *state, IfBlock *if_block)
+{
+    InferState result, branch;
+    Elif *elif;
+
+    init_state(&result, SCP_FALSE);
+    init_state(&branch, SCP_FALSE);
+
+    infer_expression(unit, state, if_block->condition);
+    copy_state(unit, &branch, state);
+    infer_statement_list(unit, &branch, if_block->then_block->statement_list);
+    join_state(unit, &result, &branch);
+    /* 每个elif的条件在前面的条件都为假之后计算 */
+    for (elif = if_block->elif_list; elif; elif = elif->next) {
+        infer_expression(unit, state, elif->condition);
+        copy_state(unit, &branch, state);
+        infer_statement_list(unit, &branch, elif->block->statement_list);
+        join_state(unit, &result, &branch);
+    }
+    if (if_block->else_block) {
+        infer_statement_list(unit, state, if_block->else_block->statement_list);
+    }
+    join_state(unit, &result, state);
+    copy_state(unit, state, &result);
+
+    dispose_state(&result);
+    dispose_state(&branch);
+}
+
+/* while和for：循环头的状态是进入时的状态与每次循环结束时的状态的并，分析到不再变化 */
+static void infer_loop_statement(InferUnit *unit, InferState *state, Expression *condition,
+                                 Expression *post, Block *block)
+{
+    InferState head, body, exit_state;
+    InferLoop loop;
+    SCP_Boolean changed;
+
+    init_state(&head, SCP_FALSE);
+    init_state(&body, SCP_FALSE);
+    init_state(&exit_state, SCP_FALSE);
+    copy_state(unit, &head, state);
+    do {
+        copy_state(unit, state, &head);
+        if (condition) {
+            infer_expression(unit, state, condition);
+            copy_state(unit, &exit_state, state);
+        }
+        else {
+            /* 没有条件的for只能由break退出 */
+            dispose_state(&exit_state);
+            exit_state.reachable = SCP_FALSE;
+        }
+        copy_state(unit, &body, state);
+        infer_loop_body(unit, &body, &loop, block);
+        if (post && body.reachable) {
+            infer_expression(unit, &body, post);
+        }
+        changed = join_state(unit, &head, &body);
+        join_state(unit, &exit_state, &loop.break_state);
+        dispose_loop(&loop);
+    } while (changed);
+    copy_state(unit, state, &exit_state);
+
+    dispose_state(&head);
+    dispose_state(&body);
+    dispose_state(&exit_state);
+}
+
+static void infer_range_for_statement(InferUnit *unit, InferState *state, RangeForBlock *range)
+{
+    InferState head, body;
+    InferLoop loop;
+    SCP_Boolean changed;
+    int index;
+
+    if (range->start) {
+        infer_expression(unit, state, range->start);
+    }
+    infer_expression(unit, state, range->end);
+    if (range->step) {
+        infer_expression(unit, state, range->step);
+    }
+    index = variable_index(unit, range->variable);
+
+    /* 空的range不改变循环变量，退出时的状态包括循环头 */
+    init_state(&head, SCP_FALSE);
+    init_state(&body, SCP_FALSE);
+    copy_state(unit, &head, state);
+    do {
+        copy_state(unit, &body, &head);
+        set_type(unit, &body, index, INFER_INT);
+        infer_loop_body(unit, &body, &loop, range->block);
+        changed = join_state(unit, &head, &body);
+        join_state(unit, state, &loop.break_state);
+        dispose_loop(&loop);
+    } while (changed);
+    join_state(unit, state, &head);
+
+    dispose_state(&head);
+    dispose_state(&body);
+}
+
+static void infer_match_statement(InferUnit *unit, InferState *state, MatchBlock *match)
+{
+    InferState result, branch;
+    MatchCase *match_case;
+
+    init_state(&result, SCP_FALSE);
+    init_state(&branch, SCP_FALSE);
+
+    infer_expression(unit, state, match->condition);
+    for (match_case = match->case_list; match_case; match_case = match_case->next) {
+        copy_state(unit, &branch, state);
+        infer_statement_list(unit, &branch, match_case->block->statement_list);
+        join_state(unit, &result, &branch);
+    }
+    /* 没有default时可能一个分支都不执行 */
+    if (match->default_block == NULL) {
+        join_state(unit, &result, state);
+    }
+    copy_state(unit, state, &result);
+
+    dispose_state(&result);
+    dispose_state(&branch);
+}
+
+static void infer_statement(InferUnit *unit, InferState *state, Statement *statement)
+{
+    Expression *expr;
+
+    switch (statement->type) {
+    case EXPRESSION_STATEMENT:
+        infer_expression(unit, state, statement->u.expression_s);
+        break;
+    case GLOBAL_STATEMENT:
+        /* global的名字在分析前已经收集 */
+        break;
+    case IF_STATEMENT:
+        infer_if_statement(unit, state, &statement->u.if_block);
+        break;
+    case WHILE_STATEMENT:
+        infer_loop_statement(unit, state, statement->u.while_block.condition, NULL,
+                             statement->u.while_block.block);
+        break;
+    case FOR_STATEMENT:
+        if (statement->u.for_block.init) {
+            infer_expression(unit, state, statement->u.for_block.init);
+        }
+        infer_loop_statement(unit, state, statement->u.for_block.condition,
+                             statement->u.for_block.post, statement->u.for_block.block);
+        break;
+    case RANGE_FOR_STATEMENT:
+        infer_range_for_statement(unit, state, &statement->u.range_for_block);
+        break;
+    case MATCH_STATEMENT:
+        infer_match_statement(unit, state, &statement->u.match_block);
+        break;
+    case RETURN_STATEMENT:
+        expr = statement->u.return_expression;
+        unit->return_type = join_type(unit->return_type,
+                                      expr ? infer_expression(unit, state, expr) : INFER_NULL);
+        state->reachable = SCP_FALSE;
+        break;
+    case BREAK_STATEMENT:
+        if (unit->loop) {
+            join_state(unit, &unit->loop->break_state, state);
+        }
+        state->reachable = SCP_FALSE;
+        break;
+    case CONTINUE_STATEMENT:
+        if (unit->loop) {
+            join_state(unit, &unit->loop->continue_state, state);
+        }
+        state->reachable = SCP_FALSE;
+        break;
+    case YIELD_STATEMENT:
+        infer_expression(unit, state, statement->u.yield_expression);
+        break;
+    case STATEMENT_TYPE_COUNT_PLUS_1:
+    default:
+        DBG_panic(("bad case...%d", statement->type));
+    }
+}
+
+static void infer_statement_list(InferUnit *unit, InferState *state, StatementList *list)
+{
+    StatementList *pos;
+
+    for (pos = list; pos && state->reachable; pos = pos->next) {
+        infer_statement(unit, state, pos->statement);
+    }
+}
+
+static void init_unit(InferUnit *unit, SCP_Interpreter *inter, IdentifierList *globals,
+                      SCP_Boolean is_toplevel)
+{
+    unit->inter = inter;
+    unit->variables.name = NULL;
+    unit->variables.initial = NULL;
+    unit->variables.summary = NULL;
+    unit->variables.is_global = NULL;
+    unit->variables.count = 0;
+    unit->variables.alloc = 0;
+    unit->return_type = INFER_UNKNOWN;
+    unit->loop = NULL;
+    unit->is_toplevel = is_toplevel;
+    unit->globals = globals;
+}
+
+static void dispose_unit(InferUnit *unit)
+{
+    MEM_free(unit->variables.name);
+    MEM_free(unit->variables.initial);
+    MEM_free(unit->variables.summary);
+    MEM_free(unit->variables.is_global);
+}
+
+/* 统计两侧都被证明为int、解释时不检查类型的二元运算，data为计数 */
+typedef struct {
+    int         specialized;
+    int         total;
+} SpecializedCount;
+
+static SCP_Boolean count_expression(Visitor *visitor, Expression *expr)
+{
+    SpecializedCount *count = visitor->data;
+
+    if (dkc_is_math_operator(expr->type) || dkc_is_compare_operator(expr->type)) {
+        count->total++;
+        if (expr->u.binary_expression.left->static_type == INFER_INT
+            && expr->u.binary_expression.right->static_type == INFER_INT) {
+            count->specialized++;
+        }
+    }
+    return SCP_TRUE;
+}
+
+/* 输出一个分析单元的结果 */
+static void dump_unit(InferUnit *unit, StatementList *list, FILE *dump)
+{
+    InferVariables *vars = &unit->variables;
+    SpecializedCount count;
+    Visitor visitor;
+    int i;
+
+    for (i = 0; i < vars->count; i++) {
+        if (vars->summary[i] == INFER_UNKNOWN)
+            continue;
+        fprintf(dump, "    %-20s %s%s\n", vars->name[i], st_type_name[vars->summary[i]],
+                vars->is_global[i] ? " (global)" : "");
+    }
+    count.specialized = 0;
+    count.total = 0;
+    visitor.statement = NULL;
+    visitor.expression = count_expression;
+    visitor.data = &count;
+    scp_visit_statement_list(&visitor, list);
+    fprintf(dump, "    -- %d/%d binary expressions specialized to int\n",
+            count.specialized, count.total);
+}
+
+/* 分析一个函数，返回值类型有变化时返回真 */
+static SCP_Boolean infer_function(SCP_Interpreter *inter, FunctionDefinition *func, FILE *dump)
+{
+    InferUnit unit;
+    InferState state;
+    ParameterList *param;
+    IdentifierList *globals;
+    SCP_Boolean changed;
+    int index;
+
+    globals = scp_collect_globals(func->u.sicpy_f.block->statement_list, NULL);
+    init_unit(&unit, inter, globals, SCP_FALSE);
+    /* 形参可以是任何类型 */
+    for (param = func->u.sicpy_f.parameter; param; param = param->next) {
+        index = variable_index(&unit, param->name);
+        unit.variables.initial[index] = INFER_ANY;
+        unit.variables.summary[index] = INFER_ANY;
+    }
+    init_state(&state, SCP_TRUE);
+    infer_statement_list(&unit, &state, func->u.sicpy_f.block->statement_list);
+    /* 执行到函数末尾时返回null */
+    if (state.reachable) {
+        unit.return_type = join_type(unit.return_type, INFER_NULL);
+    }
+    changed = unit.return_type != func->u.sicpy_f.return_type;
+    func->u.sicpy_f.return_type = unit.return_type;
+
+    if (dump) {
+        fprintf(dump, "function %s -> %s%s\n", func->name, st_type_name[unit.return_type],
+                func->u.sicpy_f.is_generator ? " (generator)" : "");
+        dump_unit(&unit, func->u.sicpy_f.block->statement_list, dump);
+    }
+    dispose_state(&state);
+    dispose_unit(&unit);
+    scp_dispose_identifier_list(globals);
+
+    return changed;
+}
+
+/*
+ * 推断所有函数和顶层语句中表达式的类型。dump不为NULL时输出每个函数的返回值类型、
+ * 变量的类型和被特化的二元运算个数。
+ */
+void scp_infer_types(SCP_Interpreter *inter, FILE *dump)
+{
+    FunctionDefinition *func;
+    IdentifierList *globals;
+    InferUnit unit;
+    InferState state;
+    SCP_Boolean changed;
+
+    /*
+     * 返回值类型从UNKNOWN开始单调增大，迭代到所有函数都不再变化；尚未分析的函数返回any。
+     * 导入的函数在编译模块时已经推断过，语法树为多个解释器共享，不再改写
+     */
+    do {
+        changed = SCP_FALSE;
+        for (func = inter->function_list; func; func = func->next) {
+            if (func->type == SICPY_FUNCTION_DEFINITION && func->u.sicpy_f.lazy == NULL
+                && func->u.sicpy_f.module == NULL && infer_function(inter, func, NULL)) {
+                changed = SCP_TRUE;
+            }
+        }
+    } while (changed);
+
+    if (dump) {
+        for (func = inter->function_list; func; func = func->next) {
+            if (func->type == SICPY_FUNCTION_DEFINITION && func->u.sicpy_f.lazy == NULL
+                && func->u.sicpy_f.module == NULL) {
+                infer_function(inter, func, dump);
+            }
+        }
+    }
+
+    /* 函数中声明为global的变量在顶层也可能被调用的函数修改 */
+    globals = scp_collect_function_globals(inter, NULL);
+    init_unit(&unit, inter, globals, SCP_TRUE);
+    init_state(&state, SCP_TRUE);
+    infer_statement_list(&unit, &state, inter->statement_list);
+    if (dump) {
+        fprintf(dump, "<toplevel>\n");
+        dump_unit(&unit, inter->statement_list, dump);
+    }
+    dispose_state(&state);
+    dispose_unit(&unit);
+    scp_dispose_identifier_list(globals);
+}
+
+/*
+ * --lazy时分析出函数体后单独推断该函数。调用的其他函数使用已有的返回值类型，
+ * 尚未分析的为any，所以结果总是可靠的
+ */
+void scp_infer_function_types(SCP_Interpreter *inter, FunctionDefinition *func)
+{
+    while (infer_function(inter, func, NULL))
+        ;
+}
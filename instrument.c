@@ -0,0 +1,295 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+#ifdef SCP_INSTRUMENT
+
+/*
+ * 插桩统计：按源码行统计每种表达式和语句的执行次数及自身耗时（不含子节点），
+ * 耗时以TSC周期计。只统计主解释器，pmap工作线程上下文不插桩。
+ * 生成器在自己的计时上下文中执行，挂起期间不计入生成器的节点，
+ * 调用方的函数调用节点也不计入生成器内的执行时间。
+ */
+
+#define INSTRUMENT_KIND_COUNT   (EXPRESSION_TYPE_COUNT_PLUS_1 + STATEMENT_TYPE_COUNT_PLUS_1)
+
+typedef struct {
+    unsigned long       count;
+    unsigned long       cycles;
+} InstrumentCounter;
+
+struct Instrument_tag {
+    InstrumentClock     main_clock;     /* 主流程的计时上下文 */
+    InstrumentCounter   *lines;         /* 每行INSTRUMENT_KIND_COUNT个计数器 */
+    int                 line_alloc;
+};
+
+/* 一条按行统计的记录，用于排序输出 */
+typedef struct {
+    int                 line_number;
+    int                 kind;
+    InstrumentCounter   counter;
+} InstrumentRecord;
+
+static Instrument *st_active_instrument = NULL;
+static SCP_Boolean st_atexit_registered = SCP_FALSE;
+
+/* 节点名称，须与ExpressionType的顺序一致 */
+static char *st_expression_name[] = {
+    "dummy",
+    "boolean",
+    "int",
+    "double",
+    "string",
+    "identifier",
+    "assign",
+    "add",
+    "sub",
+    "mul",
+    "div",
+    "mod",
+    "eq",
+    "ne",
+    "gt",
+    "ge",
+    "lt",
+    "le",
+    "logical_and",
+    "logical_or",
+    "minus",
+    "function_call",
+    "null",
+    "compound_assign",
+    "increment",
+    "decrement",
+    "loop_invariant",
+};
+
+/* 须与StatementType的顺序一致 */
+static char *st_statement_name[] = {
+    "dummy",
+    "expression_stmt",
+    "global_stmt",
+    "if_stmt",
+    "while_stmt",
+    "for_stmt",
+    "return_stmt",
+    "break_stmt",
+    "continue_stmt",
+    "yield_stmt",
+    "range_for_stmt",
+    "match_stmt",
+};
+
+/* 读取时间戳计数器 */
+static unsigned long read_tsc(void)
+{
+#if defined(__x86_64__)
+    unsigned int lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((unsigned long)hi << 32) | lo;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+#endif
+}
+
+static char * kind_name(int kind)
+{
+    if (kind < EXPRESSION_TYPE_COUNT_PLUS_1)
+        return st_expression_name[kind];
+    return st_statement_name[kind - EXPRESSION_TYPE_COUNT_PLUS_1];
+}
+
+/* 初始化计时上下文 */
+void scp_instrument_init_clock(InstrumentClock *clock)
+{
+    clock->child_cycles = 0;
+    clock->paused_cycles = 0;
+    clock->pause_start = read_tsc();
+}
+
+static void write_report(Instrument *instrument, FILE *out);
+
+/* 运行错误直接退出进程时，仍然输出已收集的统计 */
+static void report_at_exit(void)
+{
+    if (st_active_instrument) {
+        write_report(st_active_instrument, stderr);
+    }
+}
+
+/* 为主解释器创建插桩统计 */
+void scp_create_instrument(SCP_Interpreter *inter)
+{
+    Instrument *instrument = MEM_malloc(sizeof(Instrument));
+
+    instrument->lines = NULL;
+    instrument->line_alloc = 0;
+    scp_instrument_init_clock(&instrument->main_clock);
+    inter->instrument = instrument;
+    inter->instrument_clock = &instrument->main_clock;
+
+    if (!st_atexit_registered) {
+        atexit(report_at_exit);
+        st_atexit_registered = SCP_TRUE;
+    }
+    st_active_instrument = instrument;
+}
+
+/* 切换计时上下文，返回切换前的上下文；离开的上下文暂停计时 */
+InstrumentClock * scp_instrument_switch_clock(SCP_Interpreter *inter, InstrumentClock *clock)
+{
+    InstrumentClock *old_clock = inter->instrument_clock;
+    unsigned long now;
+
+    if (inter->instrument == NULL)
+        return NULL;
+    now = read_tsc();
+    old_clock->pause_start = now;
+    clock->paused_cycles += now - clock->pause_start;
+    inter->instrument_clock = clock;
+
+    return old_clock;
+}
+
+/* 节点开始执行 */
+void scp_instrument_begin(SCP_Interpreter *inter, InstrumentSpan *span)
+{
+    InstrumentClock *clock = inter->instrument_clock;
+
+    if (inter->instrument == NULL)
+        return;
+    span->start = read_tsc() - clock->paused_cycles;
+    span->saved_child = clock->child_cycles;
+    clock->child_cycles = 0;
+}
+
+/* 节点执行结束，自身耗时为总耗时减去其中子节点的耗时 */
+void scp_instrument_end(SCP_Interpreter *inter, InstrumentSpan *span, int kind, int line_number)
+{
+    Instrument *instrument = inter->instrument;
+    InstrumentClock *clock = inter->instrument_clock;
+    InstrumentCounter *counter;
+    unsigned long elapsed;
+    int new_alloc;
+
+    if (instrument == NULL)
+        return;
+    elapsed = read_tsc() - clock->paused_cycles - span->start;
+
+    if (line_number < 0) {
+        line_number = 0;
+    }
+    if (line_number >= instrument->line_alloc) {
+        new_alloc = instrument->line_alloc ? instrument->line_alloc : 256;
+        while (line_number >= new_alloc) {
+            new_alloc *= 2;
+        }
+        instrument->lines = MEM_realloc(instrument->lines,
+                                        sizeof(InstrumentCounter) * INSTRUMENT_KIND_COUNT * new_alloc);
+        memset(instrument->lines + INSTRUMENT_KIND_COUNT * instrument->line_alloc, 0,
+               sizeof(InstrumentCounter) * INSTRUMENT_KIND_COUNT
+               * (new_alloc - instrument->line_alloc));
+        instrument->line_alloc = new_alloc;
+    }
+    counter = &instrument->lines[INSTRUMENT_KIND_COUNT * line_number + kind];
+    counter->count++;
+    counter->cycles += elapsed - clock->child_cycles;
+    clock->child_cycles = span->saved_child + elapsed;
+}
+
+/* 按耗时降序 */
+static int compare_record(const void *a, const void *b)
+{
+    const InstrumentRecord *ra = a;
+    const InstrumentRecord *rb = b;
+
+    if (ra->counter.cycles != rb->counter.cycles)
+        return ra->counter.cycles < rb->counter.cycles ? 1 : -1;
+    return ra->line_number - rb->line_number;
+}
+
+/* 输出按节点种类汇总和按行的统计 */
+static void write_report(Instrument *instrument, FILE *out)
+{
+    InstrumentCounter total[INSTRUMENT_KIND_COUNT];
+    InstrumentCounter *counter;
+    InstrumentRecord *records;
+    unsigned long all_cycles = 0;
+    int record_count = 0, line, kind, i;
+
+    memset(total, 0, sizeof(total));
+    for (line = 0; line < instrument->line_alloc; line++) {
+        for (kind = 0; kind < INSTRUMENT_KIND_COUNT; kind++) {
+            counter = &instrument->lines[INSTRUMENT_KIND_COUNT * line + kind];
+            if (counter->count == 0)
+                continue;
+            total[kind].count += counter->count;
+            total[kind].cycles += counter->cycles;
+            all_cycles += counter->cycles;
+            record_count++;
+        }
+    }
+    if (all_cycles == 0) {
+        all_cycles = 1;
+    }
+
+    fprintf(out, "# sicpy instrument: self cycles per node kind\n");
+    fprintf(out, "# %-18s %14s %16s %10s %8s\n", "kind", "count", "cycles", "avg", "percent");
+    for (kind = 0; kind < INSTRUMENT_KIND_COUNT; kind++) {
+        if (total[kind].count == 0)
+            continue;
+        fprintf(out, "  %-18s %14lu %16lu %10.1f %7.2f%%\n", kind_name(kind),
+                total[kind].count, total[kind].cycles,
+                (double)total[kind].cycles / total[kind].count,
+                total[kind].cycles * 100.0 / all_cycles);
+    }
+
+    records = MEM_malloc(sizeof(InstrumentRecord) * (record_count > 0 ? record_count : 1));
+    record_count = 0;
+    for (line = 0; line < instrument->line_alloc; line++) {
+        for (kind = 0; kind < INSTRUMENT_KIND_COUNT; kind++) {
+            counter = &instrument->lines[INSTRUMENT_KIND_COUNT * line + kind];
+            if (counter->count == 0)
+                continue;
+            records[record_count].line_number = line;
+            records[record_count].kind = kind;
+            records[record_count].counter = *counter;
+            record_count++;
+        }
+    }
+    qsort(records, record_count, sizeof(InstrumentRecord), compare_record);
+
+    fprintf(out, "#\n# by line\n");
+    fprintf(out, "# %6s %-18s %14s %16s %8s\n", "line", "kind", "count", "cycles", "percent");
+    for (i = 0; i < record_count; i++) {
+        fprintf(out, "  %6d %-18s %14lu %16lu %7.2f%%\n", records[i].line_number,
+                kind_name(records[i].kind), records[i].counter.count,
+                records[i].counter.cycles, records[i].counter.cycles * 100.0 / all_cycles);
+    }
+    MEM_free(records);
+}
+
+/* 输出统计到标准错误并释放 */
+void scp_dispose_instrument(SCP_Interpreter *inter)
+{
+    Instrument *instrument = inter->instrument;
+
+    if (instrument == NULL)
+        return;
+    st_active_instrument = NULL;
+    write_report(instrument, stderr);
+    MEM_free(instrument->lines);
+    MEM_free(instrument);
+    inter->instrument = NULL;
+    inter->instrument_clock = NULL;
+}
+
+#endif /* SCP_INSTRUMENT */
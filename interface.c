@@ -11,6 +11,9 @@ static void add_native_functions(SCP_Interpreter *inter)
     SCP_add_native_function(inter, "fclose", scp_nv_fclose_proc);
     SCP_add_native_function(inter, "fread", scp_nv_fread_proc);
     SCP_add_native_function(inter, "fwrite", scp_nv_fwrite_proc);
+    SCP_add_native_function(inter, "pmap", scp_nv_pmap_proc);
+    SCP_add_native_function(inter, "memo_stats", scp_nv_memo_stats_proc);
+    SCP_add_native_function(inter, "snapshot", scp_nv_snapshot_proc);
 }
 
 /* 创建解释器 */
@@ -24,33 +27,329 @@ SCP_Interpreter * SCP_create_interpreter(void)
     interpreter->function_list = NULL;
     interpreter->statement_list = NULL;
     interpreter->current_line_number = 1;
+    interpreter->parent = NULL;
+    interpreter->thread_pool = NULL;
+    interpreter->generator_list = NULL;
+    interpreter->current_generator = NULL;
+    interpreter->call_stack = NULL;
+    interpreter->call_stack_depth = 0;
+    interpreter->call_stack_size = 0;
+    interpreter->profiler = NULL;
+    scp_init_stack(interpreter, (size_t)SCP_DEFAULT_MAX_STACK * 1024 * 1024);
+    interpreter->jit_list = NULL;
+    interpreter->loop_epoch = 0;
+    interpreter->compile_cache = NULL;
+    interpreter->lazy = SCP_FALSE;
+    interpreter->lazy_source.text = NULL;
+    interpreter->import_list = NULL;
+    interpreter->tree_shake = SCP_FALSE;
+    interpreter->tree_shake_report = NULL;
+    interpreter->tree_shake_removed = NULL;
+    interpreter->tree_shake_count = 0;
+    interpreter->limit = NULL;
+    interpreter->limit_clock_ticks = SCP_LIMIT_CLOCK_TICKS;
+    interpreter->unwind_root = NULL;
+    interpreter->unwind_root_count = 0;
+    interpreter->unwind_root_size = 0;
+    interpreter->error.message = NULL;
+    interpreter->source_hash = 0;
+    interpreter->snapshot = NULL;
+    interpreter->input = NULL;
+#ifdef SCP_INSTRUMENT
+    /* 插桩需要逐个节点计时，不使用JIT */
+    interpreter->jit_enabled = SCP_FALSE;
+    interpreter->instrument = NULL;
+    interpreter->instrument_clock = NULL;
+#else
+    interpreter->jit_enabled = SCP_TRUE;
+#endif
     scp_set_current_interpreter(interpreter);
     add_native_functions(interpreter);
 
     return interpreter;
 }
 
-/* 进行编译 */
-void SCP_compile(SCP_Interpreter *interpreter, FILE *fp)
+/* 创建工作线程的解释器上下文，共享父解释器已编译的函数定义链表，变量各自独立 */
+SCP_Interpreter * scp_create_worker_interpreter(SCP_Interpreter *parent)
+{
+    MEM_Storage storage = MEM_open_storage(0);
+    SCP_Interpreter *interpreter = MEM_storage_malloc(storage, sizeof(struct SCP_Interpreter_tag));
+    interpreter->interpreter_storage = storage;
+    interpreter->execute_storage = MEM_open_storage(0);
+    interpreter->variable = NULL;
+    interpreter->function_list = parent->function_list;
+    interpreter->statement_list = NULL;
+    interpreter->current_line_number = parent->current_line_number;
+    interpreter->parent = parent;
+    interpreter->thread_pool = NULL;
+    interpreter->generator_list = NULL;
+    interpreter->current_generator = NULL;
+    interpreter->call_stack = NULL;
+    interpreter->call_stack_depth = 0;
+    interpreter->call_stack_size = 0;
+    interpreter->profiler = NULL;
+    scp_init_stack(interpreter, parent->max_stack_bytes);
+    interpreter->jit_list = NULL;
+    interpreter->jit_enabled = SCP_FALSE;
+    interpreter->loop_epoch = 0;
+    interpreter->compile_cache = NULL;
+    interpreter->lazy = SCP_FALSE;
+    interpreter->lazy_source.text = NULL;
+    interpreter->import_list = NULL;
+    interpreter->tree_shake = SCP_FALSE;
+    interpreter->tree_shake_report = NULL;
+    interpreter->tree_shake_removed = NULL;
+    interpreter->tree_shake_count = 0;
+    /* 工作线程与主解释器共用燃料和截止时间 */
+    interpreter->limit = parent->limit;
+    interpreter->limit_clock_ticks = SCP_LIMIT_CLOCK_TICKS;
+    interpreter->unwind_root = NULL;
+    interpreter->unwind_root_count = 0;
+    interpreter->unwind_root_size = 0;
+    interpreter->error.message = NULL;
+    interpreter->source_hash = 0;
+    interpreter->snapshot = NULL;
+    interpreter->input = NULL;
+#ifdef SCP_INSTRUMENT
+    interpreter->instrument = NULL;
+    interpreter->instrument_clock = NULL;
+#endif
+    scp_add_std_fp(interpreter);
+
+    return interpreter;
+}
+
+/*
+ * 语法分析，之后导入import声明的模块，模块的编译也使用词法分析器和语法分析器。
+ * 编译错误跳出前关闭词法分析器并释放锁
+ */
+void scp_parse_program(SCP_Interpreter *interpreter, SourceText *source)
 {
     extern int yyparse(void);
-    extern FILE *yyin;
-    scp_set_current_interpreter(interpreter);
+    ErrorTrap caught, *old_trap;
 
-    yyin = fp;
+    scp_lock_parser();
+    old_trap = scp_set_error_trap(&caught);
+    if (setjmp(caught.environment)) {
+        scp_set_error_trap(old_trap);
+        scp_close_lex_source();
+        scp_reset_string_buffer();
+        scp_unlock_parser();
+        scp_raise_error(&caught);
+    }
+    scp_set_lex_source(source->text, source->length, interpreter->lazy);
+    /* 语法错误由yyerror报告，返回非0时为分析器自身中止 */
     if (yyparse()) {
-        fprintf(stderr, "Error ! Error ! Error !\n");
-        exit(1);
+        scp_compile_error(PARSE_ABORT_ERR, MESSAGE_ARGUMENT_END);
     }
+    scp_close_lex_source();
     scp_reset_string_buffer();
+    scp_set_error_trap(old_trap);
+    scp_unlock_parser();
+    scp_import_modules(interpreter);
+}
+
+/* 丢弃上一次编译或执行的错误 */
+static void clear_error(SCP_Interpreter *interpreter)
+{
+    MEM_free(interpreter->error.message);
+    interpreter->error.message = NULL;
+}
+
+/* 把陷阱捕获的错误交给宿主 */
+static SCP_Error * record_error(SCP_Interpreter *interpreter, ErrorTrap *trap)
+{
+    interpreter->error.type = trap->type;
+    interpreter->error.code = trap->code;
+    interpreter->error.line_number = trap->line_number;
+    interpreter->error.message = trap->message;
+
+    return &interpreter->error;
+}
+
+/* 进行编译，有编译错误时返回错误，此后解释器只能销毁 */
+SCP_Error * SCP_compile(SCP_Interpreter *interpreter, FILE *fp)
+{
+    SourceText source;
+    ErrorTrap trap, *old_trap;
+
+    clear_error(interpreter);
+    scp_set_current_interpreter(interpreter);
+    /* 源码整体映射或读入内存，词法分析器直接扫描 */
+    scp_open_source(fp, &source);
+    /* 预编译缓存和快照都以源码的散列值识别脚本 */
+    interpreter->source_hash = scp_hash_source(source.text, source.length);
+    /* 命中预编译缓存时直接装入优化后的程序 */
+    if (interpreter->compile_cache && scp_load_compile_cache(interpreter, &source)) {
+        scp_close_source(&source);
+        /* 被摘除的函数记录在缓存中，报告与编译时相同 */
+        if (interpreter->tree_shake) {
+            scp_report_tree_shake(interpreter, interpreter->tree_shake_report);
+        }
+        return NULL;
+    }
+    /* 未分析的函数体指向源码，保留到解释器销毁 */
+    if (interpreter->lazy) {
+        interpreter->lazy_source = source;
+    }
+    old_trap = scp_set_error_trap(&trap);
+    if (setjmp(trap.environment)) {
+        scp_set_error_trap(old_trap);
+        scp_set_current_interpreter(interpreter);
+        /* 源码可能已在出错前关闭 */
+        if (!interpreter->lazy && source.text) {
+            scp_close_source(&source);
+        }
+        return record_error(interpreter, &trap);
+    }
+    scp_parse_program(interpreter, &source);
+    if (!interpreter->lazy) {
+        scp_close_source(&source);
+    }
+    /* memo函数可以调用之后才定义的函数，全部定义完再检查 */
+    scp_check_memo_functions(interpreter);
+    /* 摘除不可达的函数后，之后的各遍和缓存只处理会执行的函数 */
+    if (interpreter->tree_shake) {
+        scp_tree_shake(interpreter);
+        scp_report_tree_shake(interpreter, interpreter->tree_shake_report);
+    }
+    scp_infer_types(interpreter, NULL);
+    /* 循环优化依据类型推断的结果 */
+    scp_optimize_loops(interpreter);
+    scp_save_compile_cache(interpreter);
+    scp_set_error_trap(old_trap);
+
+    return NULL;
+}
+
+static void release_global_strings(SCP_Interpreter *interpreter);
+
+/* 丢弃上一次执行的全局变量和生成器，编译结果、memo缓存和机器码保留 */
+static void reset_execution(SCP_Interpreter *interpreter)
+{
+#ifdef SCP_INSTRUMENT
+    scp_dispose_instrument(interpreter);
+#endif
+    scp_dispose_generators(interpreter);
+    release_global_strings(interpreter);
+    MEM_dispose_storage(interpreter->execute_storage);
+    interpreter->execute_storage = NULL;
+}
+
+static void finish_execution(SCP_Interpreter *interpreter)
+{
+    scp_stop_execution_limit(interpreter);
+    if (interpreter->profiler) {
+        scp_stop_profiler(interpreter->profiler);
+        interpreter->profiler = NULL;
+    }
 }
 
-/* 进行解释 */
-void SCP_interpret(SCP_Interpreter *interpreter)
+/*
+ * 进行解释，有运行错误时回卷执行状态并返回错误。
+ * 同一解释器可以再次调用，每次都从空的全局变量开始执行
+ */
+SCP_Error * SCP_interpret(SCP_Interpreter *interpreter)
 {
+    ErrorTrap trap, *old_trap;
+    StatementList *statement_list = interpreter->statement_list;
+
+    clear_error(interpreter);
+    scp_set_current_interpreter(interpreter);
+    if (interpreter->execute_storage) {
+        reset_execution(interpreter);
+    }
     interpreter->execute_storage = MEM_open_storage(0);
     scp_add_std_fp(interpreter);
-    scp_execute_statement_list(interpreter, NULL, interpreter->statement_list);
+    /* 装入了快照时恢复全局变量，从snapshot()的下一条语句开始执行 */
+    if (interpreter->snapshot) {
+        statement_list = scp_install_snapshot(interpreter);
+    }
+    if (interpreter->input) {
+        scp_add_input(interpreter);
+    }
+#ifdef SCP_INSTRUMENT
+    scp_create_instrument(interpreter);
+#endif
+    if (interpreter->profiler) {
+        scp_start_profiler(interpreter->profiler);
+    }
+    scp_start_execution_limit(interpreter);
+    old_trap = scp_set_error_trap(&trap);
+    if (setjmp(trap.environment)) {
+        scp_set_error_trap(old_trap);
+        scp_unwind(interpreter);
+        finish_execution(interpreter);
+        return record_error(interpreter, &trap);
+    }
+    scp_execute_statement_list(interpreter, NULL, statement_list);
+    scp_set_error_trap(old_trap);
+    finish_execution(interpreter);
+
+    return NULL;
+}
+
+/* 开启采样分析，解释结束后写出script_path.prof和script_path.folded */
+void SCP_enable_profile(SCP_Interpreter *interpreter, char *script_path)
+{
+    interpreter->profiler = scp_create_profiler(script_path);
+    /* 机器码不维护调用栈，采样时无法归属 */
+    interpreter->jit_enabled = SCP_FALSE;
+}
+
+/* 设置递归使用的栈段总大小上限，单位MB */
+void SCP_set_stack_limit(SCP_Interpreter *interpreter, int megabytes)
+{
+    interpreter->max_stack_bytes = (size_t)megabytes * 1024 * 1024;
+}
+
+/* 限制循环迭代和函数调用的总次数，超出时报运行错误 */
+void SCP_set_fuel(SCP_Interpreter *interpreter, long fuel)
+{
+    scp_get_execution_limit(interpreter)->fuel_limit = fuel;
+}
+
+/* 限制执行时间，单位秒 */
+void SCP_set_time_limit(SCP_Interpreter *interpreter, double seconds)
+{
+    scp_get_execution_limit(interpreter)->time_limit = seconds;
+}
+
+/* 限制执行期间经MEM层分配的内存总量，单位MB */
+void SCP_set_memory_limit(SCP_Interpreter *interpreter, int megabytes)
+{
+    scp_get_execution_limit(interpreter)->memory.limit = (size_t)megabytes * 1024 * 1024;
+}
+
+/* 函数体在第一次调用时才分析，须在SCP_compile之前调用 */
+void SCP_enable_lazy(SCP_Interpreter *interpreter)
+{
+    interpreter->lazy = SCP_TRUE;
+}
+
+/* 编译时摘除顶层语句不会调用到的函数，report不为NULL时输出被摘除的函数，须在SCP_compile之前调用 */
+void SCP_enable_tree_shake(SCP_Interpreter *interpreter, FILE *report)
+{
+    interpreter->tree_shake = SCP_TRUE;
+    interpreter->tree_shake_report = report;
+}
+
+/* 设置预编译缓存的目录，须在SCP_compile之前调用 */
+void SCP_set_cache_dir(SCP_Interpreter *interpreter, char *directory)
+{
+    scp_create_compile_cache(interpreter, directory);
+}
+
+/* 输出类型推断的结果 */
+void SCP_dump_types(SCP_Interpreter *interpreter, FILE *out)
+{
+    scp_infer_types(interpreter, out);
+}
+
+/* 关闭JIT，所有函数都解释执行 */
+void SCP_disable_jit(SCP_Interpreter *interpreter)
+{
+    interpreter->jit_enabled = SCP_FALSE;
 }
 
 
@@ -68,13 +367,37 @@ static void release_global_strings(SCP_Interpreter *interpreter) {
 /* 销毁解释器 */
 void SCP_dispose_interpreter(SCP_Interpreter *interpreter)
 {
+    /* 工作线程的限制属于主解释器 */
+    ExecutionLimit *limit = interpreter->parent ? NULL : interpreter->limit;
+
+#ifdef SCP_INSTRUMENT
+    scp_dispose_instrument(interpreter);
+#endif
+    scp_dispose_generators(interpreter);
     release_global_strings(interpreter);
 
+    if (interpreter->thread_pool) {
+        scp_dispose_thread_pool(interpreter->thread_pool);
+    }
     if (interpreter->execute_storage) {
         MEM_dispose_storage(interpreter->execute_storage);
     }
+    MEM_free(interpreter->call_stack);
+    scp_dispose_jit(interpreter);
+    scp_dispose_memo(interpreter);
+    scp_dispose_stack_segments(interpreter);
+    scp_dispose_compile_cache(interpreter);
+    if (interpreter->lazy_source.text) {
+        scp_close_source(&interpreter->lazy_source);
+    }
+    scp_dispose_unwind_roots(interpreter);
+    /* 全局变量中的字符串指向快照的映射，释放全局变量后再解除映射 */
+    scp_dispose_snapshot(interpreter);
+    MEM_free(interpreter->error.message);
 
     MEM_dispose_storage(interpreter->interpreter_storage);
+    /* 执行中分配的内存计入了限制中的内存预算，全部释放后才能释放预算 */
+    MEM_free(limit);
 }
 
 /* 新增scp原生函数 */
@@ -0,0 +1,1429 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+/*
+ * 模板JIT：函数调用次数达到JIT_CALL_THRESHOLD后，把函数体逐个节点翻译成x86-64机器码。
+ * 只编译纯整数/布尔函数：参数为int，局部变量类型固定，不使用global、字符串、实数、
+ * 原生函数，被调用的sicpy函数也须满足同样条件。因为这类函数没有副作用，
+ * 出现编译时无法确定的情况（除数为0、没有返回值等）时直接放弃本次机器码执行（去优化），
+ * 由解释器从头重新执行这次调用，结果与从未编译过完全一致。
+ * 去优化的跳转点、栈下限和节拍都是线程局部变量，多个线程上的解释器可以同时执行机器码；
+ * 机器码经fs段寄存器访问它们，相对线程指针的偏移在编译时确定。
+ */
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define JIT_CALL_THRESHOLD      (100)   /* 调用多少次后编译 */
+#define JIT_MAX_DEOPT           (64)    /* 去优化超过该次数后不再执行机器码 */
+#define JIT_MAX_PARAMETER       (16)
+#define JIT_LIMIT_BATCH         (1024)  /* 有执行限制时机器码每隔多少个节拍向解释器结算一次 */
+#define JIT_INT_MIN             (-2147483647 - 1)
+
+typedef enum {
+    JIT_COMPILING = 1,
+    JIT_COMPILED,
+    JIT_FAILED
+} JitState;
+
+typedef enum {
+    JIT_UNKNOWN_TYPE = 0,
+    JIT_INT_TYPE,
+    JIT_BOOLEAN_TYPE,
+    JIT_FAIL_TYPE
+} JitType;
+
+/* 机器码入口，参数按逆序存放在args中，每个占8字节 */
+typedef int JitEntry(long *args);
+
+struct JitInfo_tag {
+    JitState    state;
+    JitType     return_type;
+    int         parameter_count;
+    JitEntry    *entry;
+    void        *code;
+    size_t      code_size;
+    int         deopt_count;
+    long        thread_offset;      /* 编译时线程局部变量相对线程指针的偏移 */
+    struct JitInfo_tag *next;
+};
+
+/* 待回填的rel32位置 */
+typedef struct {
+    int         *position;
+    int         count;
+    int         alloc;
+} JitFixups;
+
+typedef struct {
+    char        *name;
+    JitType     type;
+} JitVariable;
+
+typedef struct JitLoop_tag {
+    JitFixups   break_fixups;
+    JitFixups   continue_fixups;
+    struct JitLoop_tag *outer;
+} JitLoop;
+
+typedef struct {
+    SCP_Interpreter     *inter;
+    FunctionDefinition  *func;
+    unsigned char       *code;
+    int                 size;
+    int                 alloc;
+    JitVariable         *variable;
+    int                 variable_count;
+    int                 variable_alloc;
+    int                 hidden_count;       /* 编译器自用的隐藏栈槽 */
+    char                *assigned;          /* 各变量在当前位置是否一定已赋值 */
+    int                 depth;              /* 表达式临时值压栈的个数 */
+    int                 frame_size_position;
+    int                 body_start;         /* 参数复制到栈槽之后，尾调用跳转到这里 */
+    int                 parameter_count;
+    JitLoop             *loop;
+    JitFixups           return_fixups;
+    JitFixups           deopt_fixups;
+    JitFixups           stack_fixups;
+    JitType             return_type;
+    JitType             self_return_type;   /* 递归调用自身时假定的返回类型 */
+    SCP_Boolean         self_called;
+    SCP_Boolean         failed;
+} JitCompiler;
+
+static __thread jmp_buf *st_deopt_environment = NULL;
+static __thread char *st_stack_limit = NULL;    /* 机器码的C栈下限，函数入口处检查 */
+static __thread long st_jit_ticks = 0;  /* 本批剩余的节拍，机器码在函数入口和循环开头减1 */
+static __thread SCP_Interpreter *st_jit_interpreter = NULL;
+
+static void compile_function_jit(SCP_Interpreter *inter, FunctionDefinition *func);
+
+/* 去优化：丢弃机器码的所有栈帧，回到scp_jit_execute */
+static void jit_deopt(void)
+{
+    longjmp(*st_deopt_environment, 1);
+}
+
+/* C栈将要用尽，同样回到scp_jit_execute */
+static void jit_stack_deopt(void)
+{
+    longjmp(*st_deopt_environment, 2);
+}
+
+/* 一批节拍用完，向解释器结算，超出限制时去优化，由解释器报错 */
+static void jit_limit_tick(void)
+{
+    RuntimeError error;
+
+    if (!scp_limit_charge(st_jit_interpreter, JIT_LIMIT_BATCH + 1, &error)) {
+        longjmp(*st_deopt_environment, 3);
+    }
+    st_jit_ticks = JIT_LIMIT_BATCH;
+}
+
+/*
+ * 线程局部变量相对线程指针（fs:0）的偏移。可执行文件和启动时装入的库的线程局部变量
+ * 在各线程中偏移相同，dlopen装入时可能不同，执行前须与编译时的偏移比较
+ */
+static long thread_offset(void *variable)
+{
+    char *thread_pointer;
+
+    __asm__("mov %%fs:0, %0" : "=r"(thread_pointer));
+    return (char *)variable - thread_pointer;
+}
+
+/* ---------------------------------------------------------------- 代码缓冲 */
+
+static void emit_byte(JitCompiler *c, int byte)
+{
+    if (c->size == c->alloc) {
+        c->alloc = c->alloc ? c->alloc * 2 : 256;
+        c->code = MEM_realloc(c->code, c->alloc);
+    }
+    c->code[c->size++] = (unsigned char)byte;
+}
+
+static void emit_bytes(JitCompiler *c, char *bytes, int count)
+{
+    int i;
+    for (i = 0; i < count; i++) {
+        emit_byte(c, (unsigned char)bytes[i]);
+    }
+}
+
+static void emit_int32(JitCompiler *c, int value)
+{
+    unsigned int v = (unsigned int)value;
+    emit_byte(c, v & 0xff);
+    emit_byte(c, (v >> 8) & 0xff);
+    emit_byte(c, (v >> 16) & 0xff);
+    emit_byte(c, (v >> 24) & 0xff);
+}
+
+static void emit_pointer(JitCompiler *c, void *pointer)
+{
+    unsigned long v = (unsigned long)pointer;
+    int i;
+    for (i = 0; i < 8; i++) {
+        emit_byte(c, (v >> (8 * i)) & 0xff);
+    }
+}
+
+/* rax设为当前线程中线程局部变量的地址 */
+static void emit_thread_variable(JitCompiler *c, void *variable)
+{
+    long offset = thread_offset(variable);
+
+    if (offset != (int)offset) {
+        c->failed = SCP_TRUE;
+        return;
+    }
+    emit_bytes(c, "\x64\x48\x8b\x04\x25", 5);   /* mov rax, fs:[0] */
+    emit_int32(c, 0);
+    emit_bytes(c, "\x48\x05", 2);                 /* add rax, imm32 */
+    emit_int32(c, (int)offset);
+}
+
+static void patch_int32(JitCompiler *c, int position, int value)
+{
+    unsigned int v = (unsigned int)value;
+    c->code[position] = v & 0xff;
+    c->code[position + 1] = (v >> 8) & 0xff;
+    c->code[position + 2] = (v >> 16) & 0xff;
+    c->code[position + 3] = (v >> 24) & 0xff;
+}
+
+static void add_fixup(JitFixups *fixups, int position)
+{
+    if (fixups->count == fixups->alloc) {
+        fixups->alloc = fixups->alloc ? fixups->alloc * 2 : 8;
+        fixups->position = MEM_realloc(fixups->position, sizeof(int) * fixups->alloc);
+    }
+    fixups->position[fixups->count++] = position;
+}
+
+/* 把所有待回填的跳转指向target */
+static void resolve_fixups(JitCompiler *c, JitFixups *fixups, int target)
+{
+    int i;
+    for (i = 0; i < fixups->count; i++) {
+        patch_int32(c, fixups->position[i], target - (fixups->position[i] + 4));
+    }
+    MEM_free(fixups->position);
+    fixups->position = NULL;
+    fixups->count = fixups->alloc = 0;
+}
+
+/* 发出jmp/jcc rel32，返回rel32的位置；condition为0表示无条件跳转 */
+static int emit_jump(JitCompiler *c, int condition)
+{
+    if (condition) {
+        emit_byte(c, 0x0f);
+        emit_byte(c, condition);
+    } else {
+        emit_byte(c, 0xe9);
+    }
+    emit_int32(c, 0);
+    return c->size - 4;
+}
+
+#define JIT_JO      (0x80)
+#define JIT_JE      (0x84)
+#define JIT_JNE     (0x85)
+#define JIT_JGE     (0x8d)
+#define JIT_JLE     (0x8e)
+
+static void emit_jump_to(JitCompiler *c, int condition, int target)
+{
+    int position = emit_jump(c, condition);
+    patch_int32(c, position, target - (position + 4));
+}
+
+/* 变量的栈槽位于rbp之下 */
+static int slot_offset(int slot)
+{
+    return -8 * (slot + 1);
+}
+
+static void emit_load_slot(JitCompiler *c, int slot)
+{
+    emit_bytes(c, "\x8b\x85", 2);           /* mov eax, [rbp+disp32] */
+    emit_int32(c, slot_offset(slot));
+}
+
+static void emit_store_slot(JitCompiler *c, int slot)
+{
+    emit_bytes(c, "\x89\x85", 2);           /* mov [rbp+disp32], eax */
+    emit_int32(c, slot_offset(slot));
+}
+
+static void emit_load_int(JitCompiler *c, int value)
+{
+    emit_byte(c, 0xb8);                     /* mov eax, imm32 */
+    emit_int32(c, value);
+}
+
+static void emit_push(JitCompiler *c)
+{
+    emit_byte(c, 0x50);                     /* push rax */
+    c->depth++;
+}
+
+/* 右操作数移入ecx，左操作数弹回eax */
+static void emit_pop_operands(JitCompiler *c)
+{
+    emit_bytes(c, "\x89\xc1", 2);           /* mov ecx, eax */
+    emit_byte(c, 0x58);                     /* pop rax */
+    c->depth--;
+}
+
+static void emit_deopt_jump(JitCompiler *c, int condition)
+{
+    add_fixup(&c->deopt_fixups, emit_jump(c, condition));
+}
+
+/*
+ * 有执行限制时计一个节拍，本批用完时对齐栈后调用jit_limit_tick。
+ * 只在函数体开头和循环开头插入，此时没有存活在寄存器中的值
+ */
+static void emit_limit_tick(JitCompiler *c)
+{
+    void (*function)(void) = jit_limit_tick;
+    unsigned char address[sizeof(function)];
+    int i;
+
+    if (c->inter->limit == NULL)
+        return;
+    emit_thread_variable(c, &st_jit_ticks);     /* rax = &st_jit_ticks */
+    emit_bytes(c, "\x48\x83\x28\x01", 4);       /* sub qword [rax], 1 */
+    emit_bytes(c, "\x79\x19", 2);               /* jns 跳过调用 */
+    emit_bytes(c, "\x48\x89\xe0", 3);           /* mov rax, rsp */
+    emit_bytes(c, "\x48\x83\xe4\xf0", 4);       /* and rsp, -16 */
+    emit_bytes(c, "\x50\x50\x48\xb8", 4);       /* push rax; push rax; mov rax, imm64 */
+    memcpy(address, &function, sizeof(function));
+    for (i = 0; i < (int)sizeof(function); i++) {
+        emit_byte(c, address[i]);
+    }
+    emit_bytes(c, "\xff\xd0", 2);               /* call rax */
+    emit_bytes(c, "\x48\x8b\x24\x24", 4);       /* mov rsp, [rsp] */
+}
+
+/* ---------------------------------------------------------------- 变量 */
+
+static int search_variable(JitCompiler *c, char *name)
+{
+    int i;
+    for (i = 0; i < c->variable_count; i++) {
+        if (!strcmp(c->variable[i].name, name))
+            return i;
+    }
+    return -1;
+}
+
+static int add_variable(JitCompiler *c, char *name)
+{
+    int index = search_variable(c, name);
+
+    if (index >= 0)
+        return index;
+    if (c->variable_count == c->variable_alloc) {
+        c->variable_alloc = c->variable_alloc ? c->variable_alloc * 2 : 16;
+        c->variable = MEM_realloc(c->variable, sizeof(JitVariable) * c->variable_alloc);
+    }
+    c->variable[c->variable_count].name = name;
+    c->variable[c->variable_count].type = JIT_UNKNOWN_TYPE;
+    return c->variable_count++;
+}
+
+static void collect_statement_list(JitCompiler *c, StatementList *list);
+
+/* 收集赋值过的变量名 */
+static void collect_expression(JitCompiler *c, Expression *expr)
+{
+    ArgumentList *arg;
+
+    if (expr == NULL)
+        return;
+    switch (expr->type) {
+    case ASSIGN_EXPRESSION:
+        add_variable(c, expr->u.assign_expression.variable);
+        collect_expression(c, expr->u.assign_expression.operand);
+        break;
+    case COMPOUND_ASSIGN_EXPRESSION:
+        add_variable(c, expr->u.compound_assign_expression.variable);
+        collect_expression(c, expr->u.compound_assign_expression.operand);
+        break;
+    case INCREMENT_EXPRESSION:
+    case DECREMENT_EXPRESSION:
+        add_variable(c, expr->u.identifier);
+        break;
+    case ADD_EXPRESSION:
+    case SUB_EXPRESSION:
+    case MUL_EXPRESSION:
+    case DIV_EXPRESSION:
+    case MOD_EXPRESSION:
+    case EQ_EXPRESSION:
+    case NE_EXPRESSION:
+    case GT_EXPRESSION:
+    case GE_EXPRESSION:
+    case LT_EXPRESSION:
+    case LE_EXPRESSION:
+    case LOGICAL_AND_EXPRESSION:
+    case LOGICAL_OR_EXPRESSION:
+        collect_expression(c, expr->u.binary_expression.left);
+        collect_expression(c, expr->u.binary_expression.right);
+        break;
+    case MINUS_EXPRESSION:
+        collect_expression(c, expr->u.minus_expression);
+        break;
+    case LOOP_INVARIANT_EXPRESSION:
+        collect_expression(c, expr->u.loop_invariant->operand);
+        break;
+    case FUNCTION_CALL_EXPRESSION:
+        for (arg = expr->u.function_call_expression.argument; arg; arg = arg->next) {
+            collect_expression(c, arg->expression);
+        }
+        break;
+    case BOOLEAN_EXPRESSION:
+    case INT_EXPRESSION:
+    case DOUBLE_EXPRESSION:
+    case STRING_EXPRESSION:
+    case IDENTIFIER_EXPRESSION:
+    case NULL_EXPRESSION:
+        break;
+    case EXPRESSION_TYPE_COUNT_PLUS_1:
+    default:
+        c->failed = SCP_TRUE;
+    }
+}
+
+static void collect_statement_list(JitCompiler *c, StatementList *list)
+{
+    StatementList *pos;
+    Statement *st;
+    Elif *elif;
+
+    for (pos = list; pos; pos = pos->next) {
+        st = pos->statement;
+        switch (st->type) {
+        case EXPRESSION_STATEMENT:
+            collect_expression(c, st->u.expression_s);
+            break;
+        case IF_STATEMENT:
+            collect_expression(c, st->u.if_block.condition);
+            collect_statement_list(c, st->u.if_block.then_block->statement_list);
+            for (elif = st->u.if_block.elif_list; elif; elif = elif->next) {
+                collect_expression(c, elif->condition);
+                collect_statement_list(c, elif->block->statement_list);
+            }
+            if (st->u.if_block.else_block) {
+                collect_statement_list(c, st->u.if_block.else_block->statement_list);
+            }
+            break;
+        case WHILE_STATEMENT:
+            collect_expression(c, st->u.while_block.condition);
+            collect_statement_list(c, st->u.while_block.block->statement_list);
+            break;
+        case FOR_STATEMENT:
+            collect_expression(c, st->u.for_block.init);
+            collect_expression(c, st->u.for_block.condition);
+            collect_expression(c, st->u.for_block.post);
+            collect_statement_list(c, st->u.for_block.block->statement_list);
+            break;
+        case RANGE_FOR_STATEMENT:
+            add_variable(c, st->u.range_for_block.variable);
+            collect_expression(c, st->u.range_for_block.start);
+            collect_expression(c, st->u.range_for_block.end);
+            collect_expression(c, st->u.range_for_block.step);
+            collect_statement_list(c, st->u.range_for_block.block->statement_list);
+            break;
+        case RETURN_STATEMENT:
+            collect_expression(c, st->u.return_expression);
+            break;
+        case BREAK_STATEMENT:
+        case CONTINUE_STATEMENT:
+            break;
+        /* 访问全局变量、生成器和match不编译 */
+        case GLOBAL_STATEMENT:
+        case YIELD_STATEMENT:
+        case MATCH_STATEMENT:
+        case STATEMENT_TYPE_COUNT_PLUS_1:
+        default:
+            c->failed = SCP_TRUE;
+        }
+    }
+}
+
+/* 已赋值状态的副本 */
+static char * copy_assigned(JitCompiler *c)
+{
+    char *copy = MEM_malloc(c->variable_count + 1);
+    memcpy(copy, c->assigned, c->variable_count + 1);
+    return copy;
+}
+
+/* 之后的代码不可达，视为所有变量都已赋值 */
+static void set_unreachable(JitCompiler *c)
+{
+    memset(c->assigned, 1, c->variable_count + 1);
+}
+
+/* ---------------------------------------------------------------- 表达式 */
+
+static JitType compile_expression(JitCompiler *c, Expression *expr);
+
+static JitType fail(JitCompiler *c)
+{
+    c->failed = SCP_TRUE;
+    return JIT_FAIL_TYPE;
+}
+
+static JitType compile_identifier(JitCompiler *c, Expression *expr)
+{
+    int index = search_variable(c, expr->u.identifier);
+
+    /* 未赋值就读取会产生运行错误，交给解释器 */
+    if (index < 0 || !c->assigned[index] || c->variable[index].type == JIT_UNKNOWN_TYPE)
+        return fail(c);
+    emit_load_slot(c, index);
+    return c->variable[index].type;
+}
+
+static JitType compile_assign(JitCompiler *c, Expression *expr)
+{
+    JitType type = compile_expression(c, expr->u.assign_expression.operand);
+    int index = search_variable(c, expr->u.assign_expression.variable);
+
+    if (type == JIT_FAIL_TYPE || index < 0)
+        return fail(c);
+    /* 变量的类型在整个函数中必须一致 */
+    if (c->variable[index].type == JIT_UNKNOWN_TYPE) {
+        c->variable[index].type = type;
+    } else if (c->variable[index].type != type) {
+        return fail(c);
+    }
+    emit_store_slot(c, index);
+    c->assigned[index] = 1;
+    return type;
+}
+
+/* eax = eax / ecx，除数为0或INT_MIN/-1时去优化 */
+static void emit_division(JitCompiler *c, SCP_Boolean is_mod)
+{
+    int not_minus_one;
+
+    emit_bytes(c, "\x85\xc9", 2);           /* test ecx, ecx */
+    emit_deopt_jump(c, JIT_JE);
+    emit_bytes(c, "\x83\xf9\xff", 3);       /* cmp ecx, -1 */
+    not_minus_one = emit_jump(c, JIT_JNE);
+    emit_byte(c, 0x3d);                     /* cmp eax, INT_MIN */
+    emit_int32(c, JIT_INT_MIN);
+    emit_deopt_jump(c, JIT_JE);
+    patch_int32(c, not_minus_one, c->size - (not_minus_one + 4));
+    emit_bytes(c, "\x99\xf7\xf9", 3);       /* cdq; idiv ecx */
+    if (is_mod) {
+        emit_bytes(c, "\x89\xd0", 2);       /* mov eax, edx */
+    }
+}
+
+/* eax = eax op ecx */
+static void emit_arithmetic(JitCompiler *c, ExpressionType operator)
+{
+    if (operator == ADD_EXPRESSION) {
+        emit_bytes(c, "\x01\xc8", 2);       /* add eax, ecx */
+    } else if (operator == SUB_EXPRESSION) {
+        emit_bytes(c, "\x29\xc8", 2);       /* sub eax, ecx */
+    } else if (operator == MUL_EXPRESSION) {
+        emit_bytes(c, "\x0f\xaf\xc1", 3);   /* imul eax, ecx */
+    } else {
+        emit_division(c, operator == MOD_EXPRESSION);
+    }
+}
+
+static void emit_compare(JitCompiler *c, ExpressionType operator)
+{
+    int setcc;
+
+    if (operator == EQ_EXPRESSION) {
+        setcc = 0x94;
+    } else if (operator == NE_EXPRESSION) {
+        setcc = 0x95;
+    } else if (operator == GT_EXPRESSION) {
+        setcc = 0x9f;
+    } else if (operator == GE_EXPRESSION) {
+        setcc = 0x9d;
+    } else if (operator == LT_EXPRESSION) {
+        setcc = 0x9c;
+    } else {
+        setcc = 0x9e;
+    }
+    emit_bytes(c, "\x39\xc8", 2);           /* cmp eax, ecx */
+    emit_byte(c, 0x0f);                     /* setcc al */
+    emit_byte(c, setcc);
+    emit_byte(c, 0xc0);
+    emit_bytes(c, "\x0f\xb6\xc0", 3);       /* movzx eax, al */
+}
+
+static JitType compile_binary(JitCompiler *c, Expression *expr)
+{
+    JitType left, right;
+
+    left = compile_expression(c, expr->u.binary_expression.left);
+    emit_push(c);
+    right = compile_expression(c, expr->u.binary_expression.right);
+    emit_pop_operands(c);
+    if (left == JIT_FAIL_TYPE || right == JIT_FAIL_TYPE)
+        return fail(c);
+
+    /* 布尔值只能比较相等 */
+    if (left == JIT_BOOLEAN_TYPE && right == JIT_BOOLEAN_TYPE) {
+        if (expr->type != EQ_EXPRESSION && expr->type != NE_EXPRESSION)
+            return fail(c);
+        emit_compare(c, expr->type);
+        return JIT_BOOLEAN_TYPE;
+    }
+    if (left != JIT_INT_TYPE || right != JIT_INT_TYPE)
+        return fail(c);
+
+    switch (expr->type) {
+    case ADD_EXPRESSION:
+    case SUB_EXPRESSION:
+    case MUL_EXPRESSION:
+    case DIV_EXPRESSION:
+    case MOD_EXPRESSION:
+        emit_arithmetic(c, expr->type);
+        return JIT_INT_TYPE;
+    case EQ_EXPRESSION:
+    case NE_EXPRESSION:
+    case GT_EXPRESSION:
+    case GE_EXPRESSION:
+    case LT_EXPRESSION:
+    case LE_EXPRESSION:
+        emit_compare(c, expr->type);
+        return JIT_BOOLEAN_TYPE;
+    case BOOLEAN_EXPRESSION:
+    case INT_EXPRESSION:
+    case DOUBLE_EXPRESSION:
+    case STRING_EXPRESSION:
+    case IDENTIFIER_EXPRESSION:
+    case ASSIGN_EXPRESSION:
+    case COMPOUND_ASSIGN_EXPRESSION:
+    case INCREMENT_EXPRESSION:
+    case DECREMENT_EXPRESSION:
+    case LOOP_INVARIANT_EXPRESSION:
+    case LOGICAL_AND_EXPRESSION:
+    case LOGICAL_OR_EXPRESSION:
+    case MINUS_EXPRESSION:
+    case FUNCTION_CALL_EXPRESSION:
+    case NULL_EXPRESSION:
+    case EXPRESSION_TYPE_COUNT_PLUS_1:
+    default:
+        return fail(c);
+    }
+}
+
+/* 复合赋值，目标变量必须已赋值为int；与解释器相同，先计算右边再读取变量 */
+static JitType compile_compound_assign(JitCompiler *c, Expression *expr)
+{
+    JitType right = compile_expression(c, expr->u.compound_assign_expression.operand);
+    int index = search_variable(c, expr->u.compound_assign_expression.variable);
+
+    if (right != JIT_INT_TYPE || index < 0 || !c->assigned[index]
+        || c->variable[index].type != JIT_INT_TYPE)
+        return fail(c);
+    emit_bytes(c, "\x89\xc1", 2);           /* mov ecx, eax */
+    emit_load_slot(c, index);
+    emit_arithmetic(c, expr->u.compound_assign_expression.operator);
+    emit_store_slot(c, index);
+    return JIT_INT_TYPE;
+}
+
+/* 自增自减，eax中为改变之前的值 */
+static JitType compile_increment(JitCompiler *c, Expression *expr)
+{
+    int index = search_variable(c, expr->u.identifier);
+
+    if (index < 0 || !c->assigned[index] || c->variable[index].type != JIT_INT_TYPE)
+        return fail(c);
+    emit_load_slot(c, index);
+    /* add/sub dword [rbp+disp32], 1 */
+    emit_bytes(c, expr->type == INCREMENT_EXPRESSION ? "\x83\x85" : "\x83\xad", 2);
+    emit_int32(c, slot_offset(index));
+    emit_byte(c, 1);
+    return JIT_INT_TYPE;
+}
+
+/* 逻辑与或，短路时eax中的左值即为结果 */
+static JitType compile_logical(JitCompiler *c, Expression *expr)
+{
+    JitType left, right;
+    char *saved;
+    int end;
+
+    left = compile_expression(c, expr->u.binary_expression.left);
+    if (left != JIT_BOOLEAN_TYPE)
+        return fail(c);
+    emit_bytes(c, "\x85\xc0", 2);           /* test eax, eax */
+    end = emit_jump(c, expr->type == LOGICAL_AND_EXPRESSION ? JIT_JE : JIT_JNE);
+
+    /* 右侧不一定执行，其中的赋值不计入 */
+    saved = copy_assigned(c);
+    right = compile_expression(c, expr->u.binary_expression.right);
+    memcpy(c->assigned, saved, c->variable_count + 1);
+    MEM_free(saved);
+    if (right != JIT_BOOLEAN_TYPE)
+        return fail(c);
+    patch_int32(c, end, c->size - (end + 4));
+
+    return JIT_BOOLEAN_TYPE;
+}
+
+static JitType compile_call(JitCompiler *c, Expression *expr)
+{
+    FunctionDefinition *callee = scp_search_function(expr->u.function_call_expression.identifier);
+    ArgumentList *arg;
+    ParameterList *param;
+    JitType return_type;
+    int arg_count = 0, pad;
+
+    if (callee == NULL || callee->type != SICPY_FUNCTION_DEFINITION)
+        return fail(c);
+    /* 直接调用的函数与调用方一起编译，尚未分析的先分析 */
+    if (callee->u.sicpy_f.lazy) {
+        scp_compile_lazy_function(c->inter, callee);
+    }
+    for (arg = expr->u.function_call_expression.argument, param = callee->u.sicpy_f.parameter;
+         arg && param; arg = arg->next, param = param->next) {
+        arg_count++;
+    }
+    if (arg || param)
+        return fail(c);
+
+    if (callee == c->func) {
+        /* 递归调用自身，返回类型在编译结束后验证 */
+        c->self_called = SCP_TRUE;
+        return_type = c->self_return_type;
+    } else {
+        if (callee->u.sicpy_f.jit == NULL) {
+            compile_function_jit(c->inter, callee);
+        }
+        if (callee->u.sicpy_f.jit->state != JIT_COMPILED)
+            return fail(c);
+        return_type = callee->u.sicpy_f.jit->return_type;
+    }
+
+    /* 实参依次压栈，被调函数从rdi指向的位置逆序读取 */
+    for (arg = expr->u.function_call_expression.argument; arg; arg = arg->next) {
+        if (compile_expression(c, arg->expression) != JIT_INT_TYPE)
+            return fail(c);
+        emit_push(c);
+    }
+    /* 调用前rsp须16字节对齐 */
+    pad = c->depth % 2;
+    if (pad) {
+        emit_bytes(c, "\x48\x83\xec\x08", 4);       /* sub rsp, 8 */
+        emit_bytes(c, "\x48\x8d\x7c\x24\x08", 5);   /* lea rdi, [rsp+8] */
+    } else {
+        emit_bytes(c, "\x48\x89\xe7", 3);           /* mov rdi, rsp */
+    }
+    if (callee == c->func) {
+        emit_byte(c, 0xe8);                         /* call rel32 */
+        emit_int32(c, 0 - (c->size + 4));
+    } else {
+        emit_bytes(c, "\x48\xb8", 2);               /* mov rax, imm64 */
+        emit_pointer(c, callee->u.sicpy_f.jit->code);
+        emit_bytes(c, "\xff\xd0", 2);               /* call rax */
+    }
+    emit_bytes(c, "\x48\x81\xc4", 3);               /* add rsp, imm32 */
+    emit_int32(c, 8 * (arg_count + pad));
+    c->depth -= arg_count;
+
+    return return_type;
+}
+
+static JitType compile_expression(JitCompiler *c, Expression *expr)
+{
+    JitType type;
+
+    if (c->failed)
+        return JIT_FAIL_TYPE;
+
+    switch (expr->type) {
+    case BOOLEAN_EXPRESSION:
+        emit_load_int(c, expr->u.boolean_value ? 1 : 0);
+        type = JIT_BOOLEAN_TYPE;
+        break;
+    case INT_EXPRESSION:
+        emit_load_int(c, expr->u.int_value);
+        type = JIT_INT_TYPE;
+        break;
+    case IDENTIFIER_EXPRESSION:
+        type = compile_identifier(c, expr);
+        break;
+    case ASSIGN_EXPRESSION:
+        type = compile_assign(c, expr);
+        break;
+    case COMPOUND_ASSIGN_EXPRESSION:
+        type = compile_compound_assign(c, expr);
+        break;
+    case INCREMENT_EXPRESSION:
+    case DECREMENT_EXPRESSION:
+        type = compile_increment(c, expr);
+        break;
+    case ADD_EXPRESSION:
+    case SUB_EXPRESSION:
+    case MUL_EXPRESSION:
+    case DIV_EXPRESSION:
+    case MOD_EXPRESSION:
+    case EQ_EXPRESSION:
+    case NE_EXPRESSION:
+    case GT_EXPRESSION:
+    case GE_EXPRESSION:
+    case LT_EXPRESSION:
+    case LE_EXPRESSION:
+        type = compile_binary(c, expr);
+        break;
+    case LOGICAL_AND_EXPRESSION:
+    case LOGICAL_OR_EXPRESSION:
+        type = compile_logical(c, expr);
+        break;
+    case MINUS_EXPRESSION:
+        type = compile_expression(c, expr->u.minus_expression);
+        if (type != JIT_INT_TYPE)
+            return fail(c);
+        emit_bytes(c, "\xf7\xd8", 2);       /* neg eax */
+        break;
+    case FUNCTION_CALL_EXPRESSION:
+        type = compile_call(c, expr);
+        break;
+    /* 机器码中重新计算的代价很小，不使用缓存 */
+    case LOOP_INVARIANT_EXPRESSION:
+        type = compile_expression(c, expr->u.loop_invariant->operand);
+        break;
+    /* 实数、字符串和null交给解释器 */
+    case DOUBLE_EXPRESSION:
+    case STRING_EXPRESSION:
+    case NULL_EXPRESSION:
+    case EXPRESSION_TYPE_COUNT_PLUS_1:
+    default:
+        type = fail(c);
+    }
+
+    return c->failed ? JIT_FAIL_TYPE : type;
+}
+
+/* 条件表达式，结果必须是布尔值，为假时跳转，返回rel32位置 */
+static int compile_condition(JitCompiler *c, Expression *expr)
+{
+    if (compile_expression(c, expr) != JIT_BOOLEAN_TYPE) {
+        fail(c);
+    }
+    emit_bytes(c, "\x85\xc0", 2);           /* test eax, eax */
+    return emit_jump(c, JIT_JE);
+}
+
+/* ---------------------------------------------------------------- 语句 */
+
+static SCP_Boolean compile_statement_list(JitCompiler *c, StatementList *list);
+
+static SCP_Boolean compile_if(JitCompiler *c, Statement *st)
+{
+    IfBlock *block = &st->u.if_block;
+    char *after_condition, *then_out;
+    SCP_Boolean then_completes, else_completes = SCP_TRUE;
+    JitFixups end_fixups;
+    Elif *elif;
+    int else_jump, next_jump, executed_slot;
+
+    memset(&end_fixups, 0, sizeof(end_fixups));
+    else_jump = compile_condition(c, block->condition);
+    after_condition = copy_assigned(c);
+
+    then_completes = compile_statement_list(c, block->then_block->statement_list);
+    then_out = copy_assigned(c);
+    if (then_completes) {
+        add_fixup(&end_fixups, emit_jump(c, 0));
+    }
+    patch_int32(c, else_jump, c->size - (else_jump + 4));
+    memcpy(c->assigned, after_condition, c->variable_count + 1);
+
+    if (block->elif_list) {
+        /* 与解释器一致：依次判断所有elif，执行过任一elif则不执行else */
+        executed_slot = c->variable_count + c->hidden_count++;
+        emit_load_int(c, 0);
+        emit_store_slot(c, executed_slot);
+        for (elif = block->elif_list; elif; elif = elif->next) {
+            next_jump = compile_condition(c, elif->condition);
+            if (compile_statement_list(c, elif->block->statement_list)) {
+                emit_load_int(c, 1);
+                emit_store_slot(c, executed_slot);
+            }
+            patch_int32(c, next_jump, c->size - (next_jump + 4));
+            memcpy(c->assigned, after_condition, c->variable_count + 1);
+        }
+        if (block->else_block) {
+            emit_load_slot(c, executed_slot);
+            emit_bytes(c, "\x85\xc0", 2);           /* test eax, eax */
+            add_fixup(&end_fixups, emit_jump(c, JIT_JNE));
+            compile_statement_list(c, block->else_block->statement_list);
+        }
+        memcpy(c->assigned, after_condition, c->variable_count + 1);
+        then_completes = SCP_TRUE;
+    }
+    else if (block->else_block) {
+        int i;
+        else_completes = compile_statement_list(c, block->else_block->statement_list);
+        /* 两个分支都赋值过的变量才一定已赋值 */
+        for (i = 0; i <= c->variable_count; i++) {
+            c->assigned[i] = c->assigned[i] && then_out[i];
+        }
+    }
+    else {
+        memcpy(c->assigned, after_condition, c->variable_count + 1);
+    }
+    resolve_fixups(c, &end_fixups, c->size);
+    MEM_free(after_condition);
+    MEM_free(then_out);
+
+    if (!then_completes && !else_completes) {
+        set_unreachable(c);
+        return SCP_FALSE;
+    }
+    return SCP_TRUE;
+}
+
+/* 循环体，continue跳到continue_target，为-1时之后回填 */
+static void compile_loop_body(JitCompiler *c, JitLoop *loop, Block *block)
+{
+    loop->outer = c->loop;
+    c->loop = loop;
+    compile_statement_list(c, block->statement_list);
+    c->loop = loop->outer;
+}
+
+static SCP_Boolean is_true_literal(Expression *expr)
+{
+    return expr == NULL || (expr->type == BOOLEAN_EXPRESSION && expr->u.boolean_value);
+}
+
+static SCP_Boolean compile_while(JitCompiler *c, Statement *st)
+{
+    JitLoop loop;
+    char *after_condition;
+    int top = c->size, exit_jump;
+    SCP_Boolean has_break;
+
+    memset(&loop, 0, sizeof(loop));
+    emit_limit_tick(c);
+    exit_jump = compile_condition(c, st->u.while_block.condition);
+    after_condition = copy_assigned(c);
+
+    compile_loop_body(c, &loop, st->u.while_block.block);
+    emit_jump_to(c, 0, top);
+    resolve_fixups(c, &loop.continue_fixups, top);
+    patch_int32(c, exit_jump, c->size - (exit_jump + 4));
+    has_break = loop.break_fixups.count > 0;
+    resolve_fixups(c, &loop.break_fixups, c->size);
+
+    memcpy(c->assigned, after_condition, c->variable_count + 1);
+    MEM_free(after_condition);
+    /* while (true)且没有break，只能通过return离开 */
+    if (is_true_literal(st->u.while_block.condition) && !has_break) {
+        set_unreachable(c);
+        return SCP_FALSE;
+    }
+    return SCP_TRUE;
+}
+
+static SCP_Boolean compile_for(JitCompiler *c, Statement *st)
+{
+    ForBlock *block = &st->u.for_block;
+    JitLoop loop;
+    char *after_condition;
+    int top, exit_jump = -1;
+    SCP_Boolean has_break;
+
+    memset(&loop, 0, sizeof(loop));
+    if (block->init) {
+        compile_expression(c, block->init);
+    }
+    top = c->size;
+    emit_limit_tick(c);
+    if (block->condition) {
+        exit_jump = compile_condition(c, block->condition);
+    }
+    after_condition = copy_assigned(c);
+
+    compile_loop_body(c, &loop, block->block);
+    resolve_fixups(c, &loop.continue_fixups, c->size);
+    /* post在continue之后也会执行，只依赖条件之前已赋值的变量 */
+    memcpy(c->assigned, after_condition, c->variable_count + 1);
+    if (block->post) {
+        compile_expression(c, block->post);
+    }
+    emit_jump_to(c, 0, top);
+    if (exit_jump >= 0) {
+        patch_int32(c, exit_jump, c->size - (exit_jump + 4));
+    }
+    has_break = loop.break_fixups.count > 0;
+    resolve_fixups(c, &loop.break_fixups, c->size);
+
+    memcpy(c->assigned, after_condition, c->variable_count + 1);
+    MEM_free(after_condition);
+    if (is_true_literal(block->condition) && !has_break) {
+        set_unreachable(c);
+        return SCP_FALSE;
+    }
+    return SCP_TRUE;
+}
+
+/* 尾调用自身：计算实参后写入参数栈槽，跳回函数体开头 */
+static void compile_tail_call(JitCompiler *c, Expression *expr)
+{
+    ArgumentList *arg;
+    int arg_count = 0, i;
+
+    for (arg = expr->u.function_call_expression.argument; arg; arg = arg->next) {
+        if (compile_expression(c, arg->expression) != JIT_INT_TYPE) {
+            fail(c);
+            return;
+        }
+        emit_push(c);
+        arg_count++;
+    }
+    if (arg_count != c->parameter_count) {
+        fail(c);
+        return;
+    }
+    for (i = arg_count - 1; i >= 0; i--) {
+        emit_byte(c, 0x58);                 /* pop rax */
+        c->depth--;
+        emit_store_slot(c, i);
+    }
+    emit_jump_to(c, 0, c->body_start);
+}
+
+/* for-in：步长须为常量，计数器和终值放在隐藏栈槽中，每次循环写入循环变量的栈槽 */
+static SCP_Boolean compile_range_for(JitCompiler *c, Statement *st)
+{
+    RangeForBlock *range = &st->u.range_for_block;
+    int index = search_variable(c, range->variable);
+    int counter_slot, end_slot, step = 1, top, exit_jump, overflow_jump;
+    JitLoop loop;
+    char *before_loop;
+
+    if (range->step) {
+        if (range->step->type != INT_EXPRESSION || range->step->u.int_value == 0) {
+            fail(c);
+            return SCP_TRUE;
+        }
+        step = range->step->u.int_value;
+    }
+    if (c->variable[index].type == JIT_UNKNOWN_TYPE) {
+        c->variable[index].type = JIT_INT_TYPE;
+    } else if (c->variable[index].type != JIT_INT_TYPE) {
+        fail(c);
+        return SCP_TRUE;
+    }
+    counter_slot = c->variable_count + c->hidden_count++;
+    end_slot = c->variable_count + c->hidden_count++;
+
+    if (range->start == NULL) {
+        emit_load_int(c, 0);
+    } else if (compile_expression(c, range->start) != JIT_INT_TYPE) {
+        fail(c);
+    }
+    emit_store_slot(c, counter_slot);
+    if (compile_expression(c, range->end) != JIT_INT_TYPE) {
+        fail(c);
+    }
+    emit_store_slot(c, end_slot);
+    before_loop = copy_assigned(c);
+
+    memset(&loop, 0, sizeof(loop));
+    top = c->size;
+    emit_limit_tick(c);
+    emit_load_slot(c, counter_slot);
+    emit_bytes(c, "\x8b\x8d", 2);           /* mov ecx, [rbp+disp32] */
+    emit_int32(c, slot_offset(end_slot));
+    emit_bytes(c, "\x39\xc8", 2);           /* cmp eax, ecx */
+    exit_jump = emit_jump(c, step > 0 ? JIT_JGE : JIT_JLE);
+    emit_store_slot(c, index);
+    c->assigned[index] = 1;
+
+    compile_loop_body(c, &loop, range->block);
+    resolve_fixups(c, &loop.continue_fixups, c->size);
+    emit_load_slot(c, counter_slot);
+    emit_byte(c, 0x05);                     /* add eax, imm32 */
+    emit_int32(c, step);
+    overflow_jump = emit_jump(c, JIT_JO);   /* 越过int范围即结束 */
+    emit_store_slot(c, counter_slot);
+    emit_jump_to(c, 0, top);
+    patch_int32(c, exit_jump, c->size - (exit_jump + 4));
+    patch_int32(c, overflow_jump, c->size - (overflow_jump + 4));
+    resolve_fixups(c, &loop.break_fixups, c->size);
+
+    memcpy(c->assigned, before_loop, c->variable_count + 1);
+    MEM_free(before_loop);
+    return SCP_TRUE;
+}
+
+static void compile_return(JitCompiler *c, Statement *st)
+{
+    JitType type;
+
+    if (st->u.return_expression
+        && st->u.return_expression->type == FUNCTION_CALL_EXPRESSION
+        && st->u.return_expression->u.function_call_expression.is_tail_call) {
+        compile_tail_call(c, st->u.return_expression);
+        return;
+    }
+
+    /* 返回null的路径交给解释器 */
+    if (st->u.return_expression == NULL) {
+        emit_deopt_jump(c, 0);
+        return;
+    }
+    type = compile_expression(c, st->u.return_expression);
+    if (type == JIT_FAIL_TYPE)
+        return;
+    if (c->return_type == JIT_UNKNOWN_TYPE) {
+        c->return_type = type;
+    } else if (c->return_type != type) {
+        fail(c);
+        return;
+    }
+    add_fixup(&c->return_fixups, emit_jump(c, 0));
+}
+
+/* 编译一条语句，返回执行后是否可能继续执行下一条 */
+static SCP_Boolean compile_statement(JitCompiler *c, Statement *st)
+{
+    switch (st->type) {
+    case EXPRESSION_STATEMENT:
+        compile_expression(c, st->u.expression_s);
+        return SCP_TRUE;
+    case IF_STATEMENT:
+        return compile_if(c, st);
+    case WHILE_STATEMENT:
+        return compile_while(c, st);
+    case FOR_STATEMENT:
+        return compile_for(c, st);
+    case RANGE_FOR_STATEMENT:
+        return compile_range_for(c, st);
+    case RETURN_STATEMENT:
+        compile_return(c, st);
+        break;
+    /* 循环外的break和continue使函数返回null，交给解释器 */
+    case BREAK_STATEMENT:
+        if (c->loop) {
+            add_fixup(&c->loop->break_fixups, emit_jump(c, 0));
+        } else {
+            emit_deopt_jump(c, 0);
+        }
+        break;
+    case CONTINUE_STATEMENT:
+        if (c->loop) {
+            add_fixup(&c->loop->continue_fixups, emit_jump(c, 0));
+        } else {
+            emit_deopt_jump(c, 0);
+        }
+        break;
+    case GLOBAL_STATEMENT:
+    case YIELD_STATEMENT:
+    case MATCH_STATEMENT:
+    case STATEMENT_TYPE_COUNT_PLUS_1:
+    default:
+        fail(c);
+    }
+    set_unreachable(c);
+    return SCP_FALSE;
+}
+
+static SCP_Boolean compile_statement_list(JitCompiler *c, StatementList *list)
+{
+    StatementList *pos;
+
+    for (pos = list; pos && !c->failed; pos = pos->next) {
+        /* 之后的语句不可达，与解释器一样不执行 */
+        if (!compile_statement(c, pos->statement))
+            return SCP_FALSE;
+    }
+    return SCP_TRUE;
+}
+
+/* ---------------------------------------------------------------- 函数 */
+
+static void dispose_compiler(JitCompiler *c)
+{
+    MEM_free(c->code);
+    MEM_free(c->variable);
+    MEM_free(c->assigned);
+    MEM_free(c->return_fixups.position);
+    MEM_free(c->deopt_fixups.position);
+    MEM_free(c->stack_fixups.position);
+}
+
+/* 对齐栈后调用不返回的C函数 */
+static void emit_call_stub(JitCompiler *c, void (*function)(void))
+{
+    unsigned char address[sizeof(function)];
+    int i;
+
+    emit_bytes(c, "\x48\x83\xe4\xf0\x48\xb8", 6);   /* and rsp, -16; mov rax, imm64 */
+    memcpy(address, &function, sizeof(function));
+    for (i = 0; i < (int)sizeof(function); i++) {
+        emit_byte(c, address[i]);
+    }
+    emit_bytes(c, "\xff\xd0\x0f\x0b", 4);           /* call rax; ud2 */
+}
+
+/* 编译一次函数体，self_return_type为递归调用自身时假定的返回类型 */
+static void compile_body(JitCompiler *c, SCP_Interpreter *inter, FunctionDefinition *func,
+                         JitType self_return_type)
+{
+    ParameterList *param;
+    int param_count = 0, i, frame_size;
+
+    memset(c, 0, sizeof(JitCompiler));
+    c->inter = inter;
+    c->func = func;
+    c->self_return_type = self_return_type;
+
+    /* 参数占前面的栈槽，其余为函数中赋值过的变量 */
+    for (param = func->u.sicpy_f.parameter; param; param = param->next) {
+        if (search_variable(c, param->name) >= 0 || param_count == JIT_MAX_PARAMETER) {
+            c->failed = SCP_TRUE;
+            return;
+        }
+        add_variable(c, param->name);
+        c->variable[param_count++].type = JIT_INT_TYPE;
+    }
+    collect_statement_list(c, func->u.sicpy_f.block->statement_list);
+    if (c->failed)
+        return;
+    c->assigned = MEM_malloc(c->variable_count + 1);
+    memset(c->assigned, 0, c->variable_count + 1);
+
+    /* push rbp; mov rbp, rsp */
+    emit_bytes(c, "\x55\x48\x89\xe5", 4);
+    /* rax = &st_stack_limit; cmp rsp, [rax]; jb 栈用尽出口 */
+    emit_thread_variable(c, &st_stack_limit);
+    emit_bytes(c, "\x48\x3b\x20", 3);
+    add_fixup(&c->stack_fixups, emit_jump(c, 0x82));
+    /* sub rsp, imm32（栈帧大小最后回填） */
+    emit_bytes(c, "\x48\x81\xec", 3);
+    c->frame_size_position = c->size;
+    emit_int32(c, 0);
+    for (i = 0; i < param_count; i++) {
+        emit_bytes(c, "\x8b\x87", 2);       /* mov eax, [rdi+disp32] */
+        emit_int32(c, 8 * (param_count - 1 - i));
+        emit_store_slot(c, i);
+        c->assigned[i] = 1;
+    }
+    c->parameter_count = param_count;
+    c->body_start = c->size;
+    emit_limit_tick(c);
+
+    /* 执行到函数末尾时返回null，交给解释器 */
+    if (compile_statement_list(c, func->u.sicpy_f.block->statement_list)) {
+        emit_deopt_jump(c, 0);
+    }
+    if (c->failed)
+        return;
+
+    /* 函数出口：mov rsp, rbp; pop rbp; ret */
+    resolve_fixups(c, &c->return_fixups, c->size);
+    emit_bytes(c, "\x48\x89\xec\x5d\xc3", 5);
+    /* 去优化出口：and rsp, -16; mov rax, jit_deopt; call rax; ud2 */
+    resolve_fixups(c, &c->deopt_fixups, c->size);
+    emit_call_stub(c, jit_deopt);
+    resolve_fixups(c, &c->stack_fixups, c->size);
+    emit_call_stub(c, jit_stack_deopt);
+
+    frame_size = 8 * (c->variable_count + c->hidden_count);
+    frame_size = (frame_size + 15) & ~15;
+    patch_int32(c, c->frame_size_position, frame_size);
+}
+
+/* 把机器码复制到可执行页中 */
+static SCP_Boolean install_code(JitInfo *jit, JitCompiler *c)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = (c->size + page - 1) / page * page;
+    void *code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (code == MAP_FAILED)
+        return SCP_FALSE;
+    memcpy(code, c->code, c->size);
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, size);
+        return SCP_FALSE;
+    }
+    jit->code = code;
+    jit->code_size = size;
+    memcpy(&jit->entry, &code, sizeof(code));
+
+    return SCP_TRUE;
+}
+
+/* 编译函数，结果记录在func->u.sicpy_f.jit中 */
+static void compile_function_jit(SCP_Interpreter *inter, FunctionDefinition *func)
+{
+    JitInfo *jit = MEM_malloc(sizeof(JitInfo));
+    JitCompiler c;
+    JitType assumption[2];
+    SCP_Boolean compiled = SCP_FALSE;
+    int i;
+
+    jit->state = JIT_COMPILING;
+    jit->return_type = JIT_UNKNOWN_TYPE;
+    jit->entry = NULL;
+    jit->code = NULL;
+    jit->code_size = 0;
+    jit->deopt_count = 0;
+    jit->thread_offset = thread_offset(&st_jit_ticks);
+    jit->next = inter->jit_list;
+    inter->jit_list = jit;
+    func->u.sicpy_f.jit = jit;
+
+    /* 先假定递归调用返回int，不成立时再假定返回布尔值；memo函数的调用须经过缓存，不编译 */
+    assumption[0] = JIT_INT_TYPE;
+    assumption[1] = JIT_BOOLEAN_TYPE;
+    for (i = 0; i < 2 && !compiled && func->u.sicpy_f.memo == NULL; i++) {
+        compile_body(&c, inter, func, assumption[i]);
+        if (!c.failed && c.return_type != JIT_UNKNOWN_TYPE
+            && (!c.self_called || c.return_type == assumption[i])) {
+            compiled = install_code(jit, &c);
+        }
+        if (!compiled) {
+            dispose_compiler(&c);
+        }
+    }
+    if (compiled) {
+        ParameterList *param;
+        jit->parameter_count = 0;
+        for (param = func->u.sicpy_f.parameter; param; param = param->next) {
+            jit->parameter_count++;
+        }
+        jit->return_type = c.return_type;
+        jit->state = JIT_COMPILED;
+        dispose_compiler(&c);
+    } else {
+        jit->state = JIT_FAILED;
+    }
+}
+
+/* 结算本批已用的节拍，超出限制时解释器的下一个节拍报错 */
+static void settle_limit_ticks(SCP_Interpreter *inter)
+{
+    RuntimeError error;
+
+    if (inter->limit && st_jit_ticks < JIT_LIMIT_BATCH) {
+        scp_limit_charge(inter, JIT_LIMIT_BATCH - st_jit_ticks, &error);
+    }
+}
+
+/*
+ * 以机器码执行函数调用，实参已绑定在env中。
+ * 返回SCP_FALSE表示没有执行（未编译、实参类型不符或去优化），调用方继续解释执行。
+ */
+SCP_Boolean scp_jit_execute(SCP_Interpreter *inter, FunctionDefinition *func,
+                            LocalEnvironment *env, SCP_Value *result)
+{
+    JitInfo *jit = func->u.sicpy_f.jit;
+    long args[JIT_MAX_PARAMETER];
+    ParameterList *param;
+    Variable *var;
+    jmp_buf environment;
+    jmp_buf *old_environment;
+    int i, value, deopt;
+
+    if (jit == NULL) {
+        if (++func->u.sicpy_f.call_count < JIT_CALL_THRESHOLD)
+            return SCP_FALSE;
+        compile_function_jit(inter, func);
+        jit = func->u.sicpy_f.jit;
+    }
+    if (jit->state != JIT_COMPILED || jit->thread_offset != thread_offset(&st_jit_ticks))
+        return SCP_FALSE;
+
+    /* 入口守卫：实参都必须是int */
+    for (i = 0, param = func->u.sicpy_f.parameter; param; param = param->next, i++) {
+        var = scp_search_local_variable(env, param->name);
+        if (var == NULL || var->value.type != SCP_INT_VALUE)
+            return SCP_FALSE;
+        args[jit->parameter_count - 1 - i] = var->value.u.int_value;
+    }
+
+    old_environment = st_deopt_environment;
+    st_deopt_environment = &environment;
+    st_stack_limit = inter->stack_limit;
+    /* 解释器已为这次调用计过节拍，函数入口处的第一个节拍不再计 */
+    if (inter->limit) {
+        st_jit_interpreter = inter;
+        st_jit_ticks = JIT_LIMIT_BATCH + 1;
+    }
+    deopt = setjmp(environment);
+    if (deopt) {
+        st_deopt_environment = old_environment;
+        /* 超出执行限制时由解释器报错，不算作去优化 */
+        if (deopt == 3)
+            return SCP_FALSE;
+        settle_limit_ticks(inter);
+        /* 递归深度超出C栈的函数以后都解释执行，由栈段承接 */
+        if (deopt == 2 || ++jit->deopt_count > JIT_MAX_DEOPT) {
+            jit->state = JIT_FAILED;
+        }
+        return SCP_FALSE;
+    }
+    value = jit->entry(args);
+    st_deopt_environment = old_environment;
+    settle_limit_ticks(inter);
+
+    if (jit->return_type == JIT_INT_TYPE) {
+        result->type = SCP_INT_VALUE;
+        result->u.int_value = value;
+    } else {
+        result->type = SCP_BOOLEAN_VALUE;
+        result->u.boolean_value = value ? SCP_TRUE : SCP_FALSE;
+    }
+    return SCP_TRUE;
+}
+
+/* 释放所有机器码 */
+void scp_dispose_jit(SCP_Interpreter *inter)
+{
+    JitInfo *jit;
+
+    while (inter->jit_list) {
+        jit = inter->jit_list;
+        inter->jit_list = jit->next;
+        if (jit->code) {
+            munmap(jit->code, jit->code_size);
+        }
+        MEM_free(jit);
+    }
+}
+
+#else /* 其他平台不编译，始终解释执行 */
+
+SCP_Boolean scp_jit_execute(SCP_Interpreter *inter, FunctionDefinition *func,
+                            LocalEnvironment *env, SCP_Value *result)
+{
+    return SCP_FALSE;
+}
+
+void scp_dispose_jit(SCP_Interpreter *inter)
+{
+}
+
+#endif /* __x86_64__ && __linux__ */
@@ -0,0 +1,104 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+/*
+ * 函数体的延迟分析：--lazy时词法分析器跳过函数体，只记录它在源码中的范围。
+ * 函数第一次执行前再单独对函数体进行语法分析、类型推断和循环优化，
+ * 从未调用的函数不占用分析时间和语法树的内存。
+ * 词法分析器和语法分析器使用全局状态，pmap的工作线程也可能同时第一次调用函数，
+ * 所以分析在语法分析的锁中进行；分析结果分配在主解释器的内存中。
+ */
+
+static Block *st_lazy_block = NULL;    /* 语法分析器分析出的函数体 */
+
+/* 语法分析器分析完函数体后调用 */
+void scp_set_lazy_block(Block *block)
+{
+    st_lazy_block = block;
+}
+
+/*
+ * 在主解释器中分析函数体，调用方持有锁。
+ * 函数体有编译错误时关闭词法分析器、释放锁，错误记录在caught中，返回SCP_FALSE
+ */
+static SCP_Boolean parse_body(SCP_Interpreter *root, FunctionDefinition *func,
+                              ErrorTrap *caught)
+{
+    extern int yyparse(void);
+    LazyBody *body = func->u.sicpy_f.lazy;
+    int line_number = root->current_line_number;
+    ErrorTrap *old_trap = scp_set_error_trap(caught);
+
+    if (setjmp(caught->environment)) {
+        scp_set_error_trap(old_trap);
+        scp_close_lex_source();
+        scp_reset_string_buffer();
+        root->current_line_number = line_number;
+        scp_unlock_parser();
+        return SCP_FALSE;
+    }
+    /* 行号从函数体的起始行开始计算，分析完后恢复为执行中的行号 */
+    root->current_line_number = body->line_number;
+    scp_set_lex_function_body(body->text, body->length);
+    st_lazy_block = NULL;
+    /* 语法错误由yyerror报告，返回非0时为分析器自身中止 */
+    if (yyparse()) {
+        scp_compile_error(PARSE_ABORT_ERR, MESSAGE_ARGUMENT_END);
+    }
+    scp_close_lex_source();
+    scp_reset_string_buffer();
+    scp_set_error_trap(old_trap);
+    DBG_assert(st_lazy_block != NULL, ("function body not parsed\n"));
+    scp_finish_lazy_function(func, st_lazy_block);
+    root->current_line_number = line_number;
+
+    return SCP_TRUE;
+}
+
+/* 编译期（memo函数的检查中）分析函数体，之后的类型推断和循环优化照常进行 */
+void scp_parse_lazy_function(FunctionDefinition *func)
+{
+    ErrorTrap caught;
+
+    scp_lock_parser();
+    if (func->u.sicpy_f.lazy) {
+        if (!parse_body(scp_get_interpreter(), func, &caught)) {
+            scp_raise_error(&caught);
+        }
+        func->u.sicpy_f.lazy = NULL;
+    }
+    scp_unlock_parser();
+}
+
+/* 第一次执行函数前分析函数体，并对它进行类型推断和循环优化 */
+void scp_compile_lazy_function(SCP_Interpreter *inter, FunctionDefinition *func)
+{
+    SCP_Interpreter *root = inter;
+    /* 分析函数体属于编译，不计入内存预算 */
+    MEM_Budget *budget = MEM_set_budget(NULL);
+    ErrorTrap caught;
+
+    while (root->parent) {
+        root = root->parent;
+    }
+    scp_lock_parser();
+    if (func->u.sicpy_f.lazy) {
+        scp_set_current_interpreter(root);
+        if (!parse_body(root, func, &caught)) {
+            scp_set_current_interpreter(inter);
+            MEM_set_budget(budget);
+            scp_raise_error(&caught);
+        }
+        scp_infer_function_types(root, func);
+        scp_optimize_function_loops(root, func);
+        scp_set_current_interpreter(inter);
+        /* 其他线程看到lazy为NULL时，函数体和分析结果都已写好 */
+        __atomic_store_n(&func->u.sicpy_f.lazy, NULL, __ATOMIC_RELEASE);
+    }
+    scp_unlock_parser();
+    MEM_set_budget(budget);
+}
@@ -0,0 +1,134 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <time.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+/*
+ * 执行限制，供运行不受信任的脚本时使用：
+ * 燃料在循环的每次迭代和每次sicpy函数调用时扣减1，耗尽时报运行错误；
+ * 时间限制每隔SCP_LIMIT_CLOCK_TICKS个节拍读一次单调时钟；
+ * 内存上限由MEM层的预算计数，执行期间主线程和pmap工作线程的分配都计入，
+ * 与燃料一样在节拍处检查：分配内存的位置持有的临时值还没有压入回卷根，不能在那里报错。
+ * 内存计数只在创建时清零，多次执行之间累计：之前的执行中计入而仍然存活的内存
+ * （memo表项、驻留的字符串等）释放时会扣回，若每次执行都清零，计数会变为负数。
+ * 没有设置任何限制时interpreter->limit为NULL，节拍处只有一次判断，机器码中也不插入检查。
+ */
+
+static double monotonic_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* 取得解释器的执行限制，第一次设置限制时创建 */
+ExecutionLimit * scp_get_execution_limit(SCP_Interpreter *inter)
+{
+    ExecutionLimit *limit = inter->limit;
+
+    if (limit == NULL) {
+        limit = MEM_malloc(sizeof(ExecutionLimit));
+        limit->fuel_limit = 0;
+        limit->fuel = 0;
+        limit->time_limit = 0;
+        limit->deadline = 0;
+        limit->memory.limit = 0;
+        limit->memory.used = 0;
+        inter->limit = limit;
+    }
+    return limit;
+}
+
+/* 开始执行：装满燃料、计算截止时间，并把内存预算设置到当前线程 */
+void scp_start_execution_limit(SCP_Interpreter *inter)
+{
+    ExecutionLimit *limit = inter->limit;
+
+    if (limit == NULL)
+        return;
+    limit->fuel = limit->fuel_limit;
+    if (limit->time_limit > 0) {
+        limit->deadline = monotonic_seconds() + limit->time_limit;
+    }
+    inter->limit_clock_ticks = SCP_LIMIT_CLOCK_TICKS;
+    if (limit->memory.limit) {
+        MEM_set_budget(&limit->memory);
+    }
+}
+
+void scp_stop_execution_limit(SCP_Interpreter *inter)
+{
+    if (inter->limit && inter->limit->memory.limit) {
+        MEM_set_budget(NULL);
+    }
+}
+
+/*
+ * 扣减ticks个节拍，超出燃料、时间或内存限制时在error中返回错误类型并返回SCP_FALSE。
+ * 燃料耗尽后保持为负，之后的每次扣减都失败
+ */
+SCP_Boolean scp_limit_charge(SCP_Interpreter *inter, long ticks, RuntimeError *error)
+{
+    ExecutionLimit *limit = inter->limit;
+
+    if (limit->fuel_limit
+        && __atomic_sub_fetch(&limit->fuel, ticks, __ATOMIC_RELAXED) < 0) {
+        *error = FUEL_EXHAUSTED_ERR;
+        return SCP_FALSE;
+    }
+    if (limit->time_limit > 0) {
+        inter->limit_clock_ticks -= ticks;
+        if (inter->limit_clock_ticks <= 0) {
+            inter->limit_clock_ticks = SCP_LIMIT_CLOCK_TICKS;
+            if (monotonic_seconds() >= limit->deadline) {
+                /* 之后的每次检查都读时钟，工作线程也能立即发现超时 */
+                inter->limit_clock_ticks = 0;
+                *error = TIME_LIMIT_ERR;
+                return SCP_FALSE;
+            }
+        }
+    }
+    if (limit->memory.limit
+        && __atomic_load_n(&limit->memory.used, __ATOMIC_RELAXED) > (long)limit->memory.limit) {
+        *error = MEMORY_LIMIT_ERR;
+        return SCP_FALSE;
+    }
+    return SCP_TRUE;
+}
+
+/* 超出限制时报运行错误 */
+void scp_limit_error(SCP_Interpreter *inter, int line_number, RuntimeError error)
+{
+    char buf[LINE_BUF_SIZE];
+
+    if (error == FUEL_EXHAUSTED_ERR) {
+        sprintf(buf, "%ld", inter->limit->fuel_limit);
+        scp_runtime_error(line_number, FUEL_EXHAUSTED_ERR,
+                          STRING_MESSAGE_ARGUMENT, "fuel", buf, MESSAGE_ARGUMENT_END);
+    }
+    if (error == MEMORY_LIMIT_ERR) {
+        /* 报错的过程中还会分配内存，先撤下预算 */
+        MEM_set_budget(NULL);
+        scp_runtime_error(line_number, MEMORY_LIMIT_ERR,
+                          INT_MESSAGE_ARGUMENT, "limit",
+                          (int)(inter->limit->memory.limit / (1024 * 1024)),
+                          MESSAGE_ARGUMENT_END);
+    }
+    DBG_assert(error == TIME_LIMIT_ERR, ("error..%d\n", error));
+    sprintf(buf, "%g", inter->limit->time_limit);
+    scp_runtime_error(line_number, TIME_LIMIT_ERR,
+                      STRING_MESSAGE_ARGUMENT, "seconds", buf, MESSAGE_ARGUMENT_END);
+}
+
+/* 一个节拍，经SCP_LIMIT_TICK调用 */
+void scp_limit_tick(SCP_Interpreter *inter, int line_number)
+{
+    RuntimeError error;
+
+    if (!scp_limit_charge(inter, 1, &error)) {
+        scp_limit_error(inter, line_number, error);
+    }
+}
@@ -0,0 +1,392 @@
+#include <stdio.h>
+#include <string.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+/*
+ * 循环优化，在类型推断之后进行：
+ * 1. 循环不变表达式：由循环中没有被赋值的变量、常量和对纯函数的调用组成的子表达式，
+ *    类型推断证明其值为int、double或bool时，包装成LOOP_INVARIANT_EXPRESSION，
+ *    每次进入循环后只在第一次用到时计算。第一次计算仍在原来的位置进行，
+ *    循环一次都不执行或者计算出错时，行为与优化前相同。
+ * 2. 归纳变量：int变量的v = v + e、v = v - e、v = v * e改写为复合赋值，
+ *    直接修改变量中的值，省去一次变量查找。
+ * 循环中调用了函数或者yield时，声明为global的变量可能被别处改写，不视为循环不变。
+ */
+
+typedef struct {
+    SCP_Interpreter     *inter;
+    IdentifierList      *globals;           /* 程序中所有声明为global的名字 */
+    char                **written;          /* 当前循环中被赋值的变量 */
+    int                 written_count;
+    int                 written_alloc;
+    SCP_Boolean         has_call;           /* 当前循环中有函数调用或yield */
+    unsigned long       *epoch;             /* 当前循环的激活编号 */
+} LoopOptimizer;
+
+static void add_written(LoopOptimizer *opt, char *name)
+{
+    int i;
+
+    for (i = 0; i < opt->written_count; i++) {
+        if (!strcmp(opt->written[i], name))
+            return;
+    }
+    if (opt->written_count == opt->written_alloc) {
+        opt->written_alloc = opt->written_alloc ? opt->written_alloc * 2 : 16;
+        opt->written = MEM_realloc(opt->written, sizeof(char *) * opt->written_alloc);
+    }
+    opt->written[opt->written_count++] = name;
+}
+
+static SCP_Boolean is_written(LoopOptimizer *opt, char *name)
+{
+    int i;
+
+    for (i = 0; i < opt->written_count; i++) {
+        if (!strcmp(opt->written[i], name))
+            return SCP_TRUE;
+    }
+    return SCP_FALSE;
+}
+
+/* ---------------------------------------------------------------- 收集循环中的赋值 */
+
+static SCP_Boolean scan_expression(Visitor *visitor, Expression *expr)
+{
+    LoopOptimizer *opt = visitor->data;
+
+    switch (expr->type) {
+    case ASSIGN_EXPRESSION:
+        add_written(opt, expr->u.assign_expression.variable);
+        break;
+    case COMPOUND_ASSIGN_EXPRESSION:
+        add_written(opt, expr->u.compound_assign_expression.variable);
+        break;
+    case INCREMENT_EXPRESSION:
+    case DECREMENT_EXPRESSION:
+        add_written(opt, expr->u.identifier);
+        break;
+    case FUNCTION_CALL_EXPRESSION:
+        opt->has_call = SCP_TRUE;
+        break;
+    case BOOLEAN_EXPRESSION:
+    case INT_EXPRESSION:
+    case DOUBLE_EXPRESSION:
+    case STRING_EXPRESSION:
+    case IDENTIFIER_EXPRESSION:
+    case ADD_EXPRESSION:
+    case SUB_EXPRESSION:
+    case MUL_EXPRESSION:
+    case DIV_EXPRESSION:
+    case MOD_EXPRESSION:
+    case EQ_EXPRESSION:
+    case NE_EXPRESSION:
+    case GT_EXPRESSION:
+    case GE_EXPRESSION:
+    case LT_EXPRESSION:
+    case LE_EXPRESSION:
+    case LOGICAL_AND_EXPRESSION:
+    case LOGICAL_OR_EXPRESSION:
+    case MINUS_EXPRESSION:
+    case LOOP_INVARIANT_EXPRESSION:
+    case NULL_EXPRESSION:
+        break;
+    case EXPRESSION_TYPE_COUNT_PLUS_1:
+    default:
+        DBG_panic(("bad case...%d", expr->type));
+    }
+    return SCP_TRUE;
+}
+
+static SCP_Boolean scan_statement(Visitor *visitor, Statement *st)
+{
+    LoopOptimizer *opt = visitor->data;
+
+    switch (st->type) {
+    case GLOBAL_STATEMENT:
+        opt->globals = scp_add_identifiers(opt->globals, st->u.global_identifier_list);
+        break;
+    case RANGE_FOR_STATEMENT:
+        add_written(opt, st->u.range_for_block.variable);
+        break;
+    case YIELD_STATEMENT:
+        /* 挂起期间其他代码可能改写global变量 */
+        opt->has_call = SCP_TRUE;
+        break;
+    case EXPRESSION_STATEMENT:
+    case IF_STATEMENT:
+    case WHILE_STATEMENT:
+    case FOR_STATEMENT:
+    case MATCH_STATEMENT:
+    case RETURN_STATEMENT:
+    case BREAK_STATEMENT:
+    case CONTINUE_STATEMENT:
+        break;
+    case STATEMENT_TYPE_COUNT_PLUS_1:
+    default:
+        DBG_panic(("bad case...%d", st->type));
+    }
+    return SCP_TRUE;
+}
+
+/* ---------------------------------------------------------------- 改写循环中的表达式 */
+
+/* 表达式的值在当前循环的一次执行中不变 */
+static SCP_Boolean is_invariant(LoopOptimizer *opt, Expression *expr)
+{
+    FunctionDefinition *func;
+    ArgumentList *arg;
+
+    switch (expr->type) {
+    case BOOLEAN_EXPRESSION:
+    case INT_EXPRESSION:
+    case DOUBLE_EXPRESSION:
+    case STRING_EXPRESSION:
+    case NULL_EXPRESSION:
+    case LOOP_INVARIANT_EXPRESSION:     /* 外层循环中不变，在内层循环中也不变 */
+        return SCP_TRUE;
+    case IDENTIFIER_EXPRESSION:
+        if (is_written(opt, expr->u.identifier))
+            return SCP_FALSE;
+        return !(opt->has_call && scp_is_in_identifier_list(opt->globals, expr->u.identifier));
+    case ADD_EXPRESSION:
+    case SUB_EXPRESSION:
+    case MUL_EXPRESSION:
+    case DIV_EXPRESSION:
+    case MOD_EXPRESSION:
+    case EQ_EXPRESSION:
+    case NE_EXPRESSION:
+    case GT_EXPRESSION:
+    case GE_EXPRESSION:
+    case LT_EXPRESSION:
+    case LE_EXPRESSION:
+    case LOGICAL_AND_EXPRESSION:
+    case LOGICAL_OR_EXPRESSION:
+        return is_invariant(opt, expr->u.binary_expression.left)
+            && is_invariant(opt, expr->u.binary_expression.right);
+    case MINUS_EXPRESSION:
+        return is_invariant(opt, expr->u.minus_expression);
+    case FUNCTION_CALL_EXPRESSION:
+        /* 纯函数的结果只取决于实参 */
+        func = scp_search_function(expr->u.function_call_expression.identifier);
+        if (func == NULL || !scp_is_pure_function(func))
+            return SCP_FALSE;
+        for (arg = expr->u.function_call_expression.argument; arg; arg = arg->next) {
+            if (!is_invariant(opt, arg->expression))
+                return SCP_FALSE;
+        }
+        return SCP_TRUE;
+    case ASSIGN_EXPRESSION:
+    case COMPOUND_ASSIGN_EXPRESSION:
+    case INCREMENT_EXPRESSION:
+    case DECREMENT_EXPRESSION:
+        return SCP_FALSE;
+    case EXPRESSION_TYPE_COUNT_PLUS_1:
+    default:
+        DBG_panic(("bad case...%d", expr->type));
+    }
+    return SCP_FALSE;
+}
+
+/* 有计算量且值不需要引用计数的表达式才值得缓存 */
+static SCP_Boolean is_worth_hoisting(Expression *expr)
+{
+    if (expr->static_type != INFER_INT && expr->static_type != INFER_DOUBLE
+        && expr->static_type != INFER_BOOLEAN)
+        return SCP_FALSE;
+    return dkc_is_math_operator(expr->type) || dkc_is_compare_operator(expr->type)
+        || dkc_is_logical_operator(expr->type) || expr->type == MINUS_EXPRESSION
+        || expr->type == FUNCTION_CALL_EXPRESSION;
+}
+
+/* 把表达式原地改为循环不变表达式，原来的内容移到新节点中 */
+static void wrap_invariant(LoopOptimizer *opt, Expression *expr)
+{
+    LoopInvariantExpression *invariant = scp_malloc(sizeof(LoopInvariantExpression));
+    Expression *operand = scp_malloc(sizeof(Expression));
+
+    *operand = *expr;
+    invariant->operand = operand;
+    invariant->loop_epoch = opt->epoch;
+    invariant->epoch = 0;
+    invariant->value.type = SCP_NULL_VALUE;
+    expr->type = LOOP_INVARIANT_EXPRESSION;
+    expr->u.loop_invariant = invariant;
+}
+
+/* v = v op e改写为v op= e：先计算e再读取v，e须为不改变变量的简单表达式 */
+static void reduce_induction(Expression *expr)
+{
+    char *variable = expr->u.assign_expression.variable;
+    Expression *operand = expr->u.assign_expression.operand;
+    Expression *left, *right, *step;
+
+    if (expr->static_type != INFER_INT
+        || (operand->type != ADD_EXPRESSION && operand->type != SUB_EXPRESSION
+            && operand->type != MUL_EXPRESSION))
+        return;
+    left = operand->u.binary_expression.left;
+    right = operand->u.binary_expression.right;
+    if (left->type == IDENTIFIER_EXPRESSION && !strcmp(left->u.identifier, variable)) {
+        step = right;
+    } else if (operand->type != SUB_EXPRESSION && right->type == IDENTIFIER_EXPRESSION
+               && !strcmp(right->u.identifier, variable)) {
+        step = left;
+    } else {
+        return;
+    }
+    if (step->static_type != INFER_INT
+        || (step->type != INT_EXPRESSION && step->type != IDENTIFIER_EXPRESSION
+            && step->type != LOOP_INVARIANT_EXPRESSION))
+        return;
+
+    expr->type = COMPOUND_ASSIGN_EXPRESSION;
+    expr->u.compound_assign_expression.variable = variable;
+    expr->u.compound_assign_expression.operator = operand->type;
+    expr->u.compound_assign_expression.operand = step;
+}
+
+static SCP_Boolean optimize_expression(Visitor *visitor, Expression *expr)
+{
+    LoopOptimizer *opt = visitor->data;
+
+    if (is_invariant(opt, expr)) {
+        if (is_worth_hoisting(expr)) {
+            wrap_invariant(opt, expr);
+        }
+        return SCP_FALSE;
+    }
+    /* 右侧改写完之后才能判断步长是否为循环不变 */
+    if (expr->type == ASSIGN_EXPRESSION) {
+        scp_visit_expression(visitor, expr->u.assign_expression.operand);
+        reduce_induction(expr);
+        return SCP_FALSE;
+    }
+    return SCP_TRUE;
+}
+
+/* ---------------------------------------------------------------- 查找循环 */
+
+static void optimize_statement_list(LoopOptimizer *opt, StatementList *list);
+
+/*
+ * 优化一个循环：收集其中被赋值的变量后改写表达式，再处理内层循环。
+ * init和range的参数在进入循环前只计算一次，不属于循环
+ */
+static void optimize_loop(LoopOptimizer *opt, Statement *loop, unsigned long *epoch,
+                          Expression *condition, Expression *post, Block *block)
+{
+    Visitor visitor;
+
+    opt->written_count = 0;
+    opt->has_call = SCP_FALSE;
+    opt->epoch = epoch;
+    if (loop->type == RANGE_FOR_STATEMENT) {
+        add_written(opt, loop->u.range_for_block.variable);
+    }
+    visitor.statement = scan_statement;
+    visitor.expression = scan_expression;
+    visitor.data = opt;
+    scp_visit_expression(&visitor, condition);
+    scp_visit_expression(&visitor, post);
+    scp_visit_statement_list(&visitor, block->statement_list);
+
+    /* 改写循环中（包括内层循环中）的所有表达式 */
+    visitor.statement = NULL;
+    visitor.expression = optimize_expression;
+    scp_visit_expression(&visitor, condition);
+    scp_visit_expression(&visitor, post);
+    scp_visit_statement_list(&visitor, block->statement_list);
+
+    optimize_statement_list(opt, block->statement_list);
+}
+
+/* 内层循环在optimize_loop中处理 */
+static SCP_Boolean find_loop(Visitor *visitor, Statement *st)
+{
+    LoopOptimizer *opt = visitor->data;
+
+    switch (st->type) {
+    case WHILE_STATEMENT:
+        optimize_loop(opt, st, &st->u.while_block.epoch, st->u.while_block.condition,
+                      NULL, st->u.while_block.block);
+        return SCP_FALSE;
+    case FOR_STATEMENT:
+        optimize_loop(opt, st, &st->u.for_block.epoch, st->u.for_block.condition,
+                      st->u.for_block.post, st->u.for_block.block);
+        return SCP_FALSE;
+    case RANGE_FOR_STATEMENT:
+        optimize_loop(opt, st, &st->u.range_for_block.epoch, NULL, NULL,
+                      st->u.range_for_block.block);
+        return SCP_FALSE;
+    case EXPRESSION_STATEMENT:
+    case GLOBAL_STATEMENT:
+    case IF_STATEMENT:
+    case MATCH_STATEMENT:
+    case RETURN_STATEMENT:
+    case BREAK_STATEMENT:
+    case CONTINUE_STATEMENT:
+    case YIELD_STATEMENT:
+        return SCP_TRUE;
+    case STATEMENT_TYPE_COUNT_PLUS_1:
+    default:
+        DBG_panic(("bad case...%d", st->type));
+    }
+    return SCP_TRUE;
+}
+
+static void optimize_statement_list(LoopOptimizer *opt, StatementList *list)
+{
+    Visitor visitor;
+
+    visitor.statement = find_loop;
+    visitor.expression = NULL;
+    visitor.data = opt;
+    scp_visit_statement_list(&visitor, list);
+}
+
+/* 收集所有函数中声明为global的名字，尚未分析的函数体使用词法分析时记录的名字 */
+static void init_optimizer(LoopOptimizer *opt, SCP_Interpreter *inter)
+{
+    opt->inter = inter;
+    opt->globals = scp_collect_function_globals(inter, NULL);
+    opt->written = NULL;
+    opt->written_count = 0;
+    opt->written_alloc = 0;
+}
+
+static void dispose_optimizer(LoopOptimizer *opt)
+{
+    scp_dispose_identifier_list(opt->globals);
+    MEM_free(opt->written);
+}
+
+/* 优化所有函数和顶层语句中的循环 */
+void scp_optimize_loops(SCP_Interpreter *inter)
+{
+    LoopOptimizer opt;
+    FunctionDefinition *func;
+
+    init_optimizer(&opt, inter);
+    for (func = inter->function_list; func; func = func->next) {
+        /* 导入的函数的语法树为多个解释器共享，不能缓存循环不变表达式 */
+        if (func->type == SICPY_FUNCTION_DEFINITION && func->u.sicpy_f.lazy == NULL
+            && func->u.sicpy_f.module == NULL) {
+            optimize_statement_list(&opt, func->u.sicpy_f.block->statement_list);
+        }
+    }
+    optimize_statement_list(&opt, inter->statement_list);
+    dispose_optimizer(&opt);
+}
+
+/* --lazy时分析出函数体后单独优化该函数中的循环 */
+void scp_optimize_function_loops(SCP_Interpreter *inter, FunctionDefinition *func)
+{
+    LoopOptimizer opt;
+
+    init_optimizer(&opt, inter);
+    optimize_statement_list(&opt, func->u.sicpy_f.block->statement_list);
+    dispose_optimizer(&opt);
+}
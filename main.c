@@ -1,28 +1,207 @@
+#define _XOPEN_SOURCE 600
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
 #include "sicpy.h"
 #include "MEM.h"
 
+static void usage(char *program)
+{
+    fprintf(stderr, "usage:%s [--profile] [--mem-stats] [--no-jit] [--dump-types] [--max-stack MB] [--cache-dir DIR] [--lazy] [--tree-shake] [--fuel N] [--time-limit SEC] [--max-memory MB] [--server SOCKET] [--restore FILE] filename\n       %s [options] -j N filename -- inputs...\n       %s --client SOCKET", program, program, program);
+    exit(1);
+}
+
+/* 输出峰值常驻内存和分配统计，供bench/run.sh收集 */
+static void print_mem_stats(void)
+{
+    struct rusage usage;
+    MEM_Stats stats;
+
+    getrusage(RUSAGE_SELF, &usage);
+    MEM_get_stats(&stats);
+    fflush(stdout);
+    fprintf(stderr, "peak_rss_kb %ld\n", usage.ru_maxrss);
+    fprintf(stderr, "alloc_count %lu\n", stats.alloc_count);
+    fprintf(stderr, "alloc_bytes %lu\n", stats.alloc_bytes);
+}
+
+/* 输出编译或运行错误后退出 */
+static void report_error(SCP_Error *error)
+{
+    fprintf(stderr, "%3d:%s\n", error->line_number, error->message);
+    exit(1);
+}
+
 /* main函数 */
 int main(int argc, char **argv)
 {
+    char *filename = NULL;
+    SCP_Boolean profile = SCP_FALSE;
+    SCP_Boolean mem_stats = SCP_FALSE;
+    SCP_Boolean no_jit = SCP_FALSE;
+    SCP_Boolean dump_types = SCP_FALSE;
+    SCP_Boolean lazy = SCP_FALSE;
+    SCP_Boolean tree_shake = SCP_FALSE;
+    char *cache_dir = NULL;
+    char *server_path = NULL;
+    char *client_path = NULL;
+    char *snapshot_path = NULL;
+    int max_stack = 0;
+    long fuel = 0;
+    double time_limit = 0;
+    int max_memory = 0;
+    int jobs = 0;
+    char **inputs = NULL;
+    int input_count = 0;
+    int status;
+    SCP_Error *error;
+    int i;
 
-    if (argc != 2) {
-        fprintf(stderr, "usage:%s filename", argv[0]);
-        exit(1);
+    /* 解析命令行选项 */
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--profile") == 0) {
+            profile = SCP_TRUE;
+        } else if (strcmp(argv[i], "--mem-stats") == 0) {
+            mem_stats = SCP_TRUE;
+        } else if (strcmp(argv[i], "--no-jit") == 0) {
+            no_jit = SCP_TRUE;
+        } else if (strcmp(argv[i], "--dump-types") == 0) {
+            dump_types = SCP_TRUE;
+        } else if (strcmp(argv[i], "--max-stack") == 0 && i + 1 < argc) {
+            max_stack = atoi(argv[++i]);
+            if (max_stack <= 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--fuel") == 0 && i + 1 < argc) {
+            fuel = atol(argv[++i]);
+            if (fuel <= 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--time-limit") == 0 && i + 1 < argc) {
+            time_limit = atof(argv[++i]);
+            if (time_limit <= 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--max-memory") == 0 && i + 1 < argc) {
+            max_memory = atoi(argv[++i]);
+            if (max_memory <= 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--lazy") == 0) {
+            lazy = SCP_TRUE;
+        } else if (strcmp(argv[i], "--tree-shake") == 0) {
+            tree_shake = SCP_TRUE;
+        } else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+            server_path = argv[++i];
+        } else if (strcmp(argv[i], "--client") == 0 && i + 1 < argc) {
+            client_path = argv[++i];
+        } else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+            snapshot_path = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+            if (jobs <= 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--") == 0) {
+            /* 之后的参数都是批量执行的输入 */
+            inputs = &argv[i + 1];
+            input_count = argc - i - 1;
+            break;
+        } else if (argv[i][0] == '-' || filename) {
+            usage(argv[0]);
+        } else {
+            filename = argv[i];
+        }
+    }
+    /* 客户端只把标准输入输出交给服务，不编译脚本 */
+    if (client_path) {
+        if (filename) {
+            usage(argv[0]);
+        }
+        status = SCP_run_client(client_path);
+        if (status < 0) {
+            fprintf(stderr, "cannot connect to %s.\n", client_path);
+            exit(1);
+        }
+        return status;
+    }
+    if (filename == NULL || (jobs && inputs == NULL) || (inputs && server_path)) {
+        usage(argv[0]);
     }
 
     /* 打开代码文件 */
-    FILE *fp = fopen(argv[1], "r");
+    FILE *fp = fopen(filename, "r");
     if (fp == NULL) {
-        fprintf(stderr, "%s not found.\n", argv[1]);
+        fprintf(stderr, "%s not found.\n", filename);
         exit(1);
     }
     /* 新建解释器，编译、解释、销毁 */
     SCP_Interpreter *interpreter = SCP_create_interpreter();
-    SCP_compile(interpreter, fp);
-    SCP_interpret(interpreter);
+    if (cache_dir) {
+        SCP_set_cache_dir(interpreter, cache_dir);
+    }
+    if (lazy) {
+        SCP_enable_lazy(interpreter);
+    }
+    if (tree_shake) {
+        SCP_enable_tree_shake(interpreter, stderr);
+    }
+    error = SCP_compile(interpreter, fp);
+    if (error) {
+        report_error(error);
+    }
+    /* 只输出类型推断的结果，不执行 */
+    if (dump_types) {
+        SCP_dump_types(interpreter, stdout);
+        SCP_dispose_interpreter(interpreter);
+        return 0;
+    }
+    /* 从快照恢复初始化后的全局变量，跳过初始化 */
+    if (snapshot_path && SCP_restore_snapshot(interpreter, snapshot_path) != 0) {
+        fprintf(stderr, "cannot restore snapshot %s.\n", snapshot_path);
+        exit(1);
+    }
+    if (max_stack) {
+        SCP_set_stack_limit(interpreter, max_stack);
+    }
+    if (fuel) {
+        SCP_set_fuel(interpreter, fuel);
+    }
+    if (time_limit) {
+        SCP_set_time_limit(interpreter, time_limit);
+    }
+    if (max_memory) {
+        SCP_set_memory_limit(interpreter, max_memory);
+    }
+    if (no_jit) {
+        SCP_disable_jit(interpreter);
+    }
+    if (profile) {
+        SCP_enable_profile(interpreter, filename);
+    }
+    /* 常驻并为每个请求fork子进程执行，正常情况下不返回 */
+    if (server_path) {
+        SCP_serve(interpreter, server_path);
+        fprintf(stderr, "cannot listen on %s.\n", server_path);
+        exit(1);
+    }
+    /* 每个输入fork一个子进程执行，按输入的顺序输出 */
+    if (inputs) {
+        status = SCP_run_batch(interpreter, jobs ? jobs : 1, input_count, inputs);
+        SCP_dispose_interpreter(interpreter);
+        return status;
+    }
+    error = SCP_interpret(interpreter);
+    if (error) {
+        report_error(error);
+    }
     SCP_dispose_interpreter(interpreter);
-
+    if (mem_stats) {
+        print_mem_stats();
+    }
 
     return 0;
 }
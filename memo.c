@@ -0,0 +1,465 @@
+#include <stdio.h>
+#include <string.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+/*
+ * memo函数的结果缓存：以实参的值为键，每个函数一张散列表，所有项串成LRU链表，
+ * 项数达到MEMO_CACHE_SIZE时淘汰最久未用的项。缓存只在主解释器中使用，
+ * pmap工作线程直接执行函数。memo函数须为纯函数，语法分析结束后检查。
+ */
+
+#define MEMO_CACHE_SIZE         (65536)
+#define MEMO_INITIAL_BUCKETS    (64)
+
+struct MemoEntry_tag {
+    unsigned int        hash;
+    int                 arg_count;
+    SCP_Value           *args;
+    SCP_Value           result;
+    struct MemoEntry_tag *hash_next;
+    struct MemoEntry_tag *lru_prev;     /* 更近使用的项 */
+    struct MemoEntry_tag *lru_next;     /* 更久未用的项 */
+};
+
+struct MemoCache_tag {
+    MemoEntry           **bucket;
+    unsigned int        bucket_count;
+    int                 entry_count;
+    MemoEntry           *lru_head;      /* 最近使用 */
+    MemoEntry           *lru_tail;      /* 最久未用 */
+    unsigned long       hits;
+    unsigned long       misses;
+    unsigned long       evictions;
+};
+
+MemoCache * scp_create_memo_cache(void)
+{
+    MemoCache *cache = MEM_malloc(sizeof(MemoCache));
+
+    cache->bucket = NULL;
+    cache->bucket_count = 0;
+    cache->entry_count = 0;
+    cache->lru_head = NULL;
+    cache->lru_tail = NULL;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->evictions = 0;
+
+    return cache;
+}
+
+/* 单个值的散列，不同类型的相同位模式也区分开 */
+static unsigned int hash_value(SCP_Value *v)
+{
+    unsigned int hash = (unsigned int)v->type * 2654435761u;
+
+    switch (v->type) {
+    case SCP_BOOLEAN_VALUE:
+        hash ^= v->u.boolean_value;
+        break;
+    case SCP_INT_VALUE:
+        hash ^= (unsigned int)v->u.int_value * 2246822519u;
+        break;
+    case SCP_DOUBLE_VALUE:
+        hash ^= scp_hash_string((char *)&v->u.double_value, sizeof(double));
+        break;
+    case SCP_STRING_VALUE:
+        hash ^= scp_hash_string(v->u.string_value->string, v->u.string_value->length);
+        break;
+    case SCP_NULL_VALUE:
+        break;
+    case SCP_NATIVE_POINTER_VALUE:
+    default:
+        DBG_panic(("bad case...%d", v->type));
+    }
+    return hash;
+}
+
+static SCP_Boolean equal_value(SCP_Value *a, SCP_Value *b)
+{
+    if (a->type != b->type)
+        return SCP_FALSE;
+    switch (a->type) {
+    case SCP_BOOLEAN_VALUE:
+        return a->u.boolean_value == b->u.boolean_value;
+    case SCP_INT_VALUE:
+        return a->u.int_value == b->u.int_value;
+    case SCP_DOUBLE_VALUE:
+        return a->u.double_value == b->u.double_value;
+    case SCP_STRING_VALUE:
+        return a->u.string_value->length == b->u.string_value->length
+            && !memcmp(a->u.string_value->string, b->u.string_value->string,
+                       a->u.string_value->length);
+    case SCP_NULL_VALUE:
+        return SCP_TRUE;
+    case SCP_NATIVE_POINTER_VALUE:
+    default:
+        DBG_panic(("bad case...%d", a->type));
+    }
+    return SCP_FALSE;
+}
+
+/* 从LRU链表中摘下 */
+static void lru_unlink(MemoCache *cache, MemoEntry *entry)
+{
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        cache->lru_head = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        cache->lru_tail = entry->lru_prev;
+    }
+}
+
+static void lru_push_front(MemoCache *cache, MemoEntry *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head) {
+        cache->lru_head->lru_prev = entry;
+    } else {
+        cache->lru_tail = entry;
+    }
+    cache->lru_head = entry;
+}
+
+static void dispose_entry(MemoEntry *entry)
+{
+    int i;
+
+    for (i = 0; i < entry->arg_count; i++) {
+        if (entry->args[i].type == SCP_STRING_VALUE) {
+            scp_release_string(entry->args[i].u.string_value);
+        }
+    }
+    if (entry->result.type == SCP_STRING_VALUE) {
+        scp_release_string(entry->result.u.string_value);
+    }
+    MEM_free(entry->args);
+    MEM_free(entry);
+}
+
+/* 项数超过桶数时桶数加倍 */
+static void grow_buckets(MemoCache *cache)
+{
+    unsigned int new_count = cache->bucket_count ? cache->bucket_count * 2 : MEMO_INITIAL_BUCKETS;
+    MemoEntry **new_bucket = MEM_malloc(sizeof(MemoEntry *) * new_count);
+    MemoEntry *entry, *next;
+    unsigned int i;
+
+    memset(new_bucket, 0, sizeof(MemoEntry *) * new_count);
+    for (i = 0; i < cache->bucket_count; i++) {
+        for (entry = cache->bucket[i]; entry; entry = next) {
+            next = entry->hash_next;
+            entry->hash_next = new_bucket[entry->hash & (new_count - 1)];
+            new_bucket[entry->hash & (new_count - 1)] = entry;
+        }
+    }
+    MEM_free(cache->bucket);
+    cache->bucket = new_bucket;
+    cache->bucket_count = new_count;
+}
+
+/* 淘汰最久未用的项 */
+static void evict_entry(MemoCache *cache)
+{
+    MemoEntry *entry = cache->lru_tail;
+    MemoEntry **pos;
+
+    for (pos = &cache->bucket[entry->hash & (cache->bucket_count - 1)]; *pos != entry;
+         pos = &(*pos)->hash_next);
+    *pos = entry->hash_next;
+    lru_unlink(cache, entry);
+    dispose_entry(entry);
+    cache->entry_count--;
+    cache->evictions++;
+}
+
+/*
+ * 以env中绑定好的形参查找缓存。命中时value为缓存的结果（已增加引用），返回SCP_TRUE；
+ * 未命中时*pending为新建的键，函数执行完后交给scp_memo_store，实参中有原生指针时不缓存，*pending为NULL。
+ */
+SCP_Boolean scp_memo_lookup(FunctionDefinition *func, LocalEnvironment *env,
+                            SCP_Value *value, MemoEntry **pending)
+{
+    MemoCache *cache = func->u.sicpy_f.memo;
+    ParameterList *param;
+    MemoEntry *entry;
+    SCP_Value *args;
+    unsigned int hash = 2166136261u;
+    int arg_count = 0, i;
+
+    *pending = NULL;
+    for (param = func->u.sicpy_f.parameter; param; param = param->next) {
+        arg_count++;
+    }
+    args = MEM_malloc(sizeof(SCP_Value) * (arg_count > 0 ? arg_count : 1));
+    for (i = 0, param = func->u.sicpy_f.parameter; param; i++, param = param->next) {
+        args[i] = scp_search_local_variable(env, param->name)->value;
+        if (args[i].type == SCP_NATIVE_POINTER_VALUE) {
+            MEM_free(args);
+            return SCP_FALSE;
+        }
+        hash = (hash ^ hash_value(&args[i])) * 16777619u;
+    }
+
+    if (cache->bucket_count) {
+        for (entry = cache->bucket[hash & (cache->bucket_count - 1)]; entry;
+             entry = entry->hash_next) {
+            if (entry->hash != hash)
+                continue;
+            for (i = 0; i < arg_count && equal_value(&entry->args[i], &args[i]); i++);
+            if (i < arg_count)
+                continue;
+            MEM_free(args);
+            lru_unlink(cache, entry);
+            lru_push_front(cache, entry);
+            cache->hits++;
+            *value = entry->result;
+            if (value->type == SCP_STRING_VALUE) {
+                scp_refer_string(value->u.string_value);
+            }
+            return SCP_TRUE;
+        }
+    }
+    cache->misses++;
+
+    /* 键持有实参字符串的引用 */
+    for (i = 0; i < arg_count; i++) {
+        if (args[i].type == SCP_STRING_VALUE) {
+            scp_refer_string(args[i].u.string_value);
+        }
+    }
+    entry = MEM_malloc(sizeof(MemoEntry));
+    entry->hash = hash;
+    entry->arg_count = arg_count;
+    entry->args = args;
+    *pending = entry;
+
+    return SCP_FALSE;
+}
+
+/* 保存函数的结果，缓存持有结果的一个引用 */
+void scp_memo_store(FunctionDefinition *func, MemoEntry *entry, SCP_Value *value)
+{
+    MemoCache *cache = func->u.sicpy_f.memo;
+    unsigned int index;
+
+    if (cache->entry_count >= MEMO_CACHE_SIZE) {
+        evict_entry(cache);
+    }
+    if ((unsigned int)cache->entry_count >= cache->bucket_count) {
+        grow_buckets(cache);
+    }
+    entry->result = *value;
+    if (value->type == SCP_STRING_VALUE) {
+        scp_refer_string(value->u.string_value);
+    }
+    index = entry->hash & (cache->bucket_count - 1);
+    entry->hash_next = cache->bucket[index];
+    cache->bucket[index] = entry;
+    lru_push_front(cache, entry);
+    cache->entry_count++;
+}
+
+/* 丢弃执行出错、未能保存结果的键 */
+void scp_memo_discard(MemoEntry *entry)
+{
+    entry->result.type = SCP_NULL_VALUE;
+    dispose_entry(entry);
+}
+
+/* 缓存的统计信息，形如"hits=3 misses=5 evictions=0 entries=5" */
+SCP_String * scp_memo_stats(FunctionDefinition *func)
+{
+    MemoCache *cache = func->u.sicpy_f.memo;
+    char buf[LINE_BUF_SIZE];
+
+    sprintf(buf, "hits=%lu misses=%lu evictions=%lu entries=%d",
+            cache->hits, cache->misses, cache->evictions, cache->entry_count);
+    return scp_create_sicpy_string(MEM_strdup(buf));
+}
+
+void scp_dispose_memo_cache(MemoCache *cache)
+{
+    MemoEntry *entry, *next;
+
+    for (entry = cache->lru_head; entry; entry = next) {
+        next = entry->lru_next;
+        dispose_entry(entry);
+    }
+    MEM_free(cache->bucket);
+    MEM_free(cache);
+}
+
+/* 释放所有memo函数的缓存 */
+void scp_dispose_memo(SCP_Interpreter *inter)
+{
+    FunctionDefinition *func;
+
+    for (func = inter->function_list; func; func = func->next) {
+        if (func->type != SICPY_FUNCTION_DEFINITION || func->u.sicpy_f.memo == NULL)
+            continue;
+        scp_dispose_memo_cache(func->u.sicpy_f.memo);
+        func->u.sicpy_f.memo = NULL;
+    }
+}
+
+/* ---------------------------------------------------------------- 纯函数检查 */
+
+/* 检查过程中已访问的函数；memo_func为NULL时只判断是否为纯函数，不报错 */
+typedef struct PurityCheck_tag {
+    FunctionDefinition  *memo_func;
+    FunctionDefinition  *func;          /* 正在检查的函数 */
+    SCP_Boolean         pure;
+    FunctionDefinition  **visited;
+    int                 visited_count;
+    int                 visited_alloc;
+} PurityCheck;
+
+static void check_function(PurityCheck *check, FunctionDefinition *func);
+
+/* 报告编译错误前释放已访问的函数表，scp_compile_error不返回 */
+static void release_check(PurityCheck *check)
+{
+    MEM_free(check->visited);
+    check->visited = NULL;
+}
+
+static SCP_Boolean check_expression(Visitor *visitor, Expression *expr)
+{
+    PurityCheck *check = visitor->data;
+    FunctionDefinition *callee;
+
+    if (expr->type != FUNCTION_CALL_EXPRESSION)
+        return SCP_TRUE;
+    /* 找不到的函数在运行时报错 */
+    callee = scp_search_function(expr->u.function_call_expression.identifier);
+    if (callee == NULL) {
+        check->pure = SCP_FALSE;
+        return SCP_TRUE;
+    }
+    /* 原生函数都有读写文件、输出等副作用 */
+    if (callee->type == NATIVE_FUNCTION_DEFINITION) {
+        check->pure = SCP_FALSE;
+        if (check->memo_func == NULL)
+            return SCP_TRUE;
+        release_check(check);
+        scp_compile_error(MEMO_NATIVE_CALL_ERR,
+                          STRING_MESSAGE_ARGUMENT, "name", check->memo_func->name,
+                          STRING_MESSAGE_ARGUMENT, "function", check->func->name,
+                          STRING_MESSAGE_ARGUMENT, "native", callee->name,
+                          MESSAGE_ARGUMENT_END);
+    }
+    check_function(check, callee);
+    return SCP_TRUE;
+}
+
+static SCP_Boolean check_statement(Visitor *visitor, Statement *st)
+{
+    PurityCheck *check = visitor->data;
+
+    if (st->type != GLOBAL_STATEMENT)
+        return SCP_TRUE;
+    check->pure = SCP_FALSE;
+    if (check->memo_func == NULL)
+        return SCP_TRUE;
+    release_check(check);
+    scp_compile_error(MEMO_GLOBAL_ERR,
+                      STRING_MESSAGE_ARGUMENT, "name", check->memo_func->name,
+                      STRING_MESSAGE_ARGUMENT, "function", check->func->name,
+                      MESSAGE_ARGUMENT_END);
+    return SCP_TRUE;
+}
+
+/* 检查函数及其调用的所有sicpy函数，每个函数只检查一次 */
+static void check_function(PurityCheck *check, FunctionDefinition *func)
+{
+    Visitor visitor;
+    FunctionDefinition *caller;
+    int i;
+
+    for (i = 0; i < check->visited_count; i++) {
+        if (check->visited[i] == func)
+            return;
+    }
+    if (check->visited_count == check->visited_alloc) {
+        check->visited_alloc = check->visited_alloc ? check->visited_alloc * 2 : 16;
+        check->visited = MEM_realloc(check->visited,
+                                     sizeof(FunctionDefinition *) * check->visited_alloc);
+    }
+    check->visited[check->visited_count++] = func;
+
+    /* 尚未分析的函数体：检查memo函数时先分析，仅查询时视为不纯 */
+    if (func->u.sicpy_f.lazy) {
+        if (check->memo_func == NULL) {
+            check->pure = SCP_FALSE;
+            return;
+        }
+        scp_parse_lazy_function(func);
+    }
+    /* 生成器每次调用的结果取决于挂起的状态 */
+    if (func->u.sicpy_f.is_generator) {
+        check->pure = SCP_FALSE;
+        if (check->memo_func == NULL)
+            return;
+        release_check(check);
+        scp_compile_error(MEMO_GENERATOR_ERR,
+                          STRING_MESSAGE_ARGUMENT, "name", check->memo_func->name,
+                          STRING_MESSAGE_ARGUMENT, "function", func->name,
+                          MESSAGE_ARGUMENT_END);
+    }
+    visitor.statement = check_statement;
+    visitor.expression = check_expression;
+    visitor.data = check;
+    caller = check->func;
+    check->func = func;
+    scp_visit_statement_list(&visitor, func->u.sicpy_f.block->statement_list);
+    check->func = caller;
+}
+
+/* 语法分析结束后检查所有memo函数：不能使用global、不能是生成器、不能直接或间接调用原生函数 */
+void scp_check_memo_functions(SCP_Interpreter *inter)
+{
+    FunctionDefinition *func;
+    PurityCheck check;
+
+    for (func = inter->function_list; func; func = func->next) {
+        /* 导入的函数在编译模块时已经检查过 */
+        if (func->type != SICPY_FUNCTION_DEFINITION || func->u.sicpy_f.memo == NULL
+            || func->u.sicpy_f.module)
+            continue;
+        check.memo_func = func;
+        check.func = NULL;
+        check.pure = SCP_TRUE;
+        check.visited = NULL;
+        check.visited_count = 0;
+        check.visited_alloc = 0;
+        check_function(&check, func);
+        MEM_free(check.visited);
+    }
+}
+
+/* 函数及其调用的所有函数都不使用global、不是生成器、不调用原生函数时为纯函数 */
+SCP_Boolean scp_is_pure_function(FunctionDefinition *func)
+{
+    PurityCheck check;
+
+    if (func->type != SICPY_FUNCTION_DEFINITION)
+        return SCP_FALSE;
+    check.memo_func = NULL;
+    check.func = NULL;
+    check.pure = SCP_TRUE;
+    check.visited = NULL;
+    check.visited_count = 0;
+    check.visited_alloc = 0;
+    check_function(&check, func);
+    MEM_free(check.visited);
+
+    return check.pure;
+}
@@ -2,11 +2,54 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <malloc.h>
 #include "MEM.h"
 
 #define CELL_SIZE               (sizeof(Cell))
 #define DEFAULT_PAGE_SIZE       (1024)  /* cell num */
 
+/* 分配统计，多个线程同时分配，使用relaxed原子操作 */
+static unsigned long st_alloc_count = 0;
+static unsigned long st_alloc_bytes = 0;
+
+#define count_allocation(size) \
+    (__atomic_add_fetch(&st_alloc_count, 1, __ATOMIC_RELAXED),\
+     __atomic_add_fetch(&st_alloc_bytes, (size), __ATOMIC_RELAXED))
+
+/* 当前线程的内存预算，未设置时分配和释放只多一次判断 */
+static __thread MEM_Budget *st_budget = NULL;
+
+/*
+ * 每块内存前的头部，记下分配时计入的预算。释放可能发生在别的线程或预算已经换掉之后，
+ * 只扣回分配时的预算。头部按long double对齐，之后的内存仍满足malloc的对齐要求
+ */
+typedef union {
+    MEM_Budget  *budget;
+    long double ld_dummy;
+} Header;
+
+#define HEADER_SIZE             (sizeof(Header))
+#define header_of(ptr)          ((Header *)((char *)(ptr) - HEADER_SIZE))
+#define block_of(header)        ((void *)((char *)(header) + HEADER_SIZE))
+
+/* 按malloc实际占用的大小计入当前线程的预算，释放时同样按实际大小扣回，两者一致 */
+static void charge_budget(Header *header)
+{
+    header->budget = st_budget;
+    if (st_budget) {
+        __atomic_add_fetch(&st_budget->used, (long)malloc_usable_size(header),
+                           __ATOMIC_RELAXED);
+    }
+}
+
+static void refund_budget(Header *header)
+{
+    if (header->budget) {
+        __atomic_sub_fetch(&header->budget->used, (long)malloc_usable_size(header),
+                           __ATOMIC_RELAXED);
+    }
+}
+
 /* 开辟空间 */
 MEM_Storage MEM_open_storage_func(char *filename, int line, int page_size)
 {
@@ -82,20 +125,28 @@ static void error_handler(char *filename, int line, char *msg)
 /* 分配内存空间 */
 void* MEM_malloc_func(char *filename, int line, size_t size)
 {
-    size_t alloc_size = size;
-    void *ptr = malloc(alloc_size);     /* 使用malloc返回指定大小的内存指针 */
-    if (ptr == NULL) {
+    size_t alloc_size = size + HEADER_SIZE;
+    Header *header = malloc(alloc_size);   /* 使用malloc返回指定大小的内存指针 */
+    if (header == NULL) {
         error_handler(filename, line, "malloc");
     }
-    return ptr;
+    count_allocation(size);
+    charge_budget(header);
+    return block_of(header);
 }
 
 /* realloc函数 */
 void* MEM_realloc_func(char *filename, int line, void *ptr, size_t size)
 {
-    size_t  alloc_size = size;
-    void *real_ptr = ptr;
-    void *new_ptr = realloc(real_ptr, alloc_size);
+    size_t  alloc_size = size + HEADER_SIZE;
+    Header *real_ptr = ptr ? header_of(ptr) : NULL;
+    Header *new_ptr;
+
+    if (real_ptr) {
+        refund_budget(real_ptr);
+    }
+    new_ptr = realloc(real_ptr, alloc_size);
+    count_allocation(size);
 
     if (new_ptr == NULL) {
         if (ptr == NULL) {
@@ -105,17 +156,23 @@ void* MEM_realloc_func(char *filename, int line, void *ptr, size_t size)
             free(real_ptr);
         }
     }
-    return(new_ptr);
+    /* 新的内存块计入当前线程的预算 */
+    charge_budget(new_ptr);
+    return block_of(new_ptr);
 }
 
 /* 传入字串常量，返回字串指针 */
 char * MEM_strdup_func(char *filename, int line, char *str)
 {
     size_t alloc_size = strlen(str) + 1;;
-    char *ptr = malloc(alloc_size);
-    if (ptr == NULL) {
+    Header *header = malloc(alloc_size + HEADER_SIZE);
+    char *ptr;
+    if (header == NULL) {
         error_handler(filename, line, "strdup");
     }
+    count_allocation(alloc_size);
+    charge_budget(header);
+    ptr = block_of(header);
     strcpy(ptr, str);
     return(ptr);
 }
@@ -125,7 +182,22 @@ void MEM_free(void *ptr)
 {
     if (ptr == NULL)
         return;
-    void *real_ptr = ptr;
+    Header *real_ptr = header_of(ptr);
+    refund_budget(real_ptr);
     free(real_ptr);
 }
 
+/* 获取分配统计，realloc也计为一次分配 */
+void MEM_get_stats(MEM_Stats *stats)
+{
+    stats->alloc_count = __atomic_load_n(&st_alloc_count, __ATOMIC_RELAXED);
+    stats->alloc_bytes = __atomic_load_n(&st_alloc_bytes, __ATOMIC_RELAXED);
+}
+
+/* 设置当前线程的内存预算，NULL为不计入，返回之前的预算以便恢复 */
+MEM_Budget * MEM_set_budget(MEM_Budget *budget)
+{
+    MEM_Budget *old = st_budget;
+    st_budget = budget;
+    return old;
+}
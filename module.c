@@ -0,0 +1,188 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+/*
+ * 模块导入：import "path";声明的模块在进程中只编译一次，编译结果保存在进程范围的模块表中，
+ * 之后任何脚本、任何解释器导入同一文件（按realpath判断）时直接取用。
+ * 导入时把模块（及其导入的模块）的函数定义复制到导入方的函数链表，函数体的语法树共享，
+ * 调用次数、JIT结果和memo缓存等执行状态各自独立。
+ * 模块中只能有函数定义和import，语法树在多个解释器间共享，所以不做循环优化
+ * （循环不变表达式的缓存在语法树上），类型推断和memo函数的检查在编译模块时完成。
+ * 模块表在进程结束前一直保留。
+ */
+
+struct Module_tag {
+    char            *path;          /* realpath规范化后的路径 */
+    SCP_Interpreter *interpreter;   /* 编译模块用的解释器，保存模块的函数定义 */
+    SCP_Boolean     compiling;      /* 正在编译，此时再次导入即为循环导入 */
+    Module          *next;
+};
+
+/* 模块表由语法分析的锁保护，编译模块时会导入它依赖的模块，同一线程中再次加锁 */
+static Module *st_module_list = NULL;
+
+/* 语法分析器遇到import声明时调用，按出现的顺序记录 */
+void scp_add_import(Expression *path)
+{
+    SCP_Interpreter *inter = scp_get_interpreter();
+    ImportList *import = scp_malloc(sizeof(ImportList));
+    ImportList *pos;
+
+    import->path = path->u.string_value->string;
+    import->line_number = path->line_number;
+    import->next = NULL;
+    if (inter->import_list == NULL) {
+        inter->import_list = import;
+    } else {
+        for (pos = inter->import_list; pos->next; pos = pos->next)
+            ;
+        pos->next = import;
+    }
+}
+
+/* 在新的解释器中编译模块，编译完成后恢复导入方为当前解释器 */
+static void compile_module(SCP_Interpreter *inter, ImportList *import, Module *module,
+                           SourceText *source)
+{
+    module->interpreter = SCP_create_interpreter();
+    scp_parse_program(module->interpreter, source);
+    if (module->interpreter->statement_list) {
+        scp_set_current_interpreter(inter);
+        inter->current_line_number = import->line_number;
+        scp_compile_error(MODULE_STATEMENT_ERR,
+                          STRING_MESSAGE_ARGUMENT, "path", import->path, MESSAGE_ARGUMENT_END);
+    }
+    scp_check_memo_functions(module->interpreter);
+    scp_infer_types(module->interpreter, NULL);
+    scp_set_current_interpreter(inter);
+}
+
+/* 从模块表中摘除并释放编译失败的模块 */
+static void discard_module(Module *module)
+{
+    Module **pos;
+
+    for (pos = &st_module_list; *pos != module; pos = &(*pos)->next)
+        ;
+    *pos = module->next;
+    if (module->interpreter) {
+        SCP_dispose_interpreter(module->interpreter);
+    }
+    free(module->path);
+    MEM_free(module);
+}
+
+/* 取得已编译的模块，第一次导入时编译，调用方持有锁 */
+static Module * get_module(SCP_Interpreter *inter, ImportList *import)
+{
+    char *path = realpath(import->path, NULL);
+    Module *module;
+    FILE *fp;
+    SourceText source;
+    ErrorTrap caught, *old_trap;
+
+    inter->current_line_number = import->line_number;
+    if (path == NULL) {
+        scp_compile_error(IMPORT_NOT_FOUND_ERR,
+                          STRING_MESSAGE_ARGUMENT, "path", import->path, MESSAGE_ARGUMENT_END);
+    }
+    for (module = st_module_list; module; module = module->next) {
+        if (!strcmp(module->path, path)) {
+            free(path);
+            if (module->compiling) {
+                scp_compile_error(IMPORT_CYCLE_ERR,
+                                  STRING_MESSAGE_ARGUMENT, "path", import->path,
+                                  MESSAGE_ARGUMENT_END);
+            }
+            return module;
+        }
+    }
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        scp_compile_error(IMPORT_NOT_FOUND_ERR,
+                          STRING_MESSAGE_ARGUMENT, "path", import->path, MESSAGE_ARGUMENT_END);
+    }
+    scp_open_source(fp, &source);
+    fclose(fp);
+    module = MEM_malloc(sizeof(Module));
+    module->path = path;
+    module->interpreter = NULL;
+    module->compiling = SCP_TRUE;
+    module->next = st_module_list;
+    st_module_list = module;
+    /* 模块有编译错误时从模块表中摘除，之后再导入时重新编译 */
+    old_trap = scp_set_error_trap(&caught);
+    if (setjmp(caught.environment)) {
+        scp_set_error_trap(old_trap);
+        scp_close_source(&source);
+        discard_module(module);
+        scp_set_current_interpreter(inter);
+        scp_raise_error(&caught);
+    }
+    compile_module(inter, import, module, &source);
+    scp_set_error_trap(old_trap);
+    scp_close_source(&source);
+    module->compiling = SCP_FALSE;
+
+    return module;
+}
+
+/* 把模块的函数定义复制到导入方，经由不同模块重复导入的同一函数只复制一次 */
+static void merge_functions(SCP_Interpreter *inter, ImportList *import, Module *module)
+{
+    FunctionDefinition *func, *old, *copy;
+
+    for (func = module->interpreter->function_list; func; func = func->next) {
+        if (func->type != SICPY_FUNCTION_DEFINITION)
+            continue;
+        old = scp_search_function(func->name);
+        if (old) {
+            if (old->type == SICPY_FUNCTION_DEFINITION
+                && old->u.sicpy_f.block == func->u.sicpy_f.block)
+                continue;
+            inter->current_line_number = import->line_number;
+            scp_compile_error(FUNCTION_MULTIPLE_DEFINE_ERR,
+                              STRING_MESSAGE_ARGUMENT, "name", func->name, MESSAGE_ARGUMENT_END);
+        }
+        copy = scp_malloc(sizeof(FunctionDefinition));
+        *copy = *func;
+        copy->u.sicpy_f.call_count = 0;
+        copy->u.sicpy_f.jit = NULL;
+        copy->u.sicpy_f.memo = func->u.sicpy_f.memo ? scp_create_memo_cache() : NULL;
+        if (copy->u.sicpy_f.module == NULL) {
+            copy->u.sicpy_f.module = module;
+        }
+        copy->next = inter->function_list;
+        inter->function_list = copy;
+    }
+}
+
+/* 语法分析结束后导入所有import声明的模块 */
+void scp_import_modules(SCP_Interpreter *inter)
+{
+    ImportList *pos;
+    Module *module;
+    ErrorTrap caught, *old_trap;
+
+    if (inter->import_list == NULL)
+        return;
+    scp_lock_parser();
+    /* 编译错误跳出前释放锁，锁可重入，每层导入各释放一次 */
+    old_trap = scp_set_error_trap(&caught);
+    if (setjmp(caught.environment)) {
+        scp_set_error_trap(old_trap);
+        scp_unlock_parser();
+        scp_raise_error(&caught);
+    }
+    for (pos = inter->import_list; pos; pos = pos->next) {
+        module = get_module(inter, pos);
+        merge_functions(inter, pos, module);
+    }
+    scp_set_error_trap(old_trap);
+    scp_unlock_parser();
+}
@@ -177,6 +177,76 @@ SCP_Value scp_nv_fwrite_proc(SCP_Interpreter *interpreter, int arg_count, SCP_Va
     return value;
 }
 
+/* SCP原生并行map函数，形如pmap("func", records)或pmap("func", records, context) */
+SCP_Value scp_nv_pmap_proc(SCP_Interpreter *interpreter, int arg_count, SCP_Value *args)
+{
+    FunctionDefinition *func;
+
+    /* 参数应为2个或3个 */
+    if (arg_count < 2) {
+        scp_runtime_error(-1, ARGUMENT_TOO_FEW_ERR, MESSAGE_ARGUMENT_END);
+    }
+    else if (arg_count > 3) {
+        scp_runtime_error(-1, ARGUMENT_TOO_MANY_ERR, MESSAGE_ARGUMENT_END);
+    }
+    /* 函数名和记录都必须是字符串 */
+    if (args[0].type != SCP_STRING_VALUE || args[1].type != SCP_STRING_VALUE) {
+        scp_runtime_error(-1, PMAP_ARGUMENT_TYPE_ERR, MESSAGE_ARGUMENT_END);
+    }
+    func = scp_search_function(args[0].u.string_value->string);
+    if (func == NULL) {
+        scp_runtime_error(-1, FUNCTION_NOT_FOUND_ERR, STRING_MESSAGE_ARGUMENT,
+                          "name", args[0].u.string_value->string, MESSAGE_ARGUMENT_END);
+    }
+
+    return scp_parallel_map(interpreter, func, args[1].u.string_value,
+                            arg_count == 3 ? &args[2] : NULL);
+}
+
+/* memo函数的缓存统计，传入函数名，返回形如"hits=3 misses=5 evictions=0 entries=5"的字符串 */
+SCP_Value scp_nv_memo_stats_proc(SCP_Interpreter *interpreter, int arg_count, SCP_Value *args)
+{
+    FunctionDefinition *func = NULL;
+    SCP_Value value;
+
+    if (arg_count < 1) {
+        scp_runtime_error(-1, ARGUMENT_TOO_FEW_ERR, MESSAGE_ARGUMENT_END);
+    }
+    else if (arg_count > 1) {
+        scp_runtime_error(-1, ARGUMENT_TOO_MANY_ERR, MESSAGE_ARGUMENT_END);
+    }
+    if (args[0].type == SCP_STRING_VALUE) {
+        func = scp_search_function(args[0].u.string_value->string);
+    }
+    if (func == NULL || func->type != SICPY_FUNCTION_DEFINITION || func->u.sicpy_f.memo == NULL) {
+        scp_runtime_error(-1, MEMO_STATS_ARGUMENT_ERR, MESSAGE_ARGUMENT_END);
+    }
+    value.type = SCP_STRING_VALUE;
+    value.u.string_value = scp_memo_stats(func);
+
+    return value;
+}
+
+/* 把此刻的全局变量写入快照文件，只能作为顶层的一条语句调用，返回null */
+SCP_Value scp_nv_snapshot_proc(SCP_Interpreter *interpreter, int arg_count, SCP_Value *args)
+{
+    SCP_Value value;
+
+    if (arg_count < 1) {
+        scp_runtime_error(-1, ARGUMENT_TOO_FEW_ERR, MESSAGE_ARGUMENT_END);
+    }
+    else if (arg_count > 1) {
+        scp_runtime_error(-1, ARGUMENT_TOO_MANY_ERR, MESSAGE_ARGUMENT_END);
+    }
+    if (args[0].type != SCP_STRING_VALUE) {
+        scp_runtime_error(-1, SNAPSHOT_ARGUMENT_ERR, MESSAGE_ARGUMENT_END);
+    }
+    scp_write_snapshot(interpreter, args[0].u.string_value->string);
+    value.type = SCP_NULL_VALUE;
+
+    return value;
+}
+
 /* 添加标准指针 */
 void scp_add_std_fp(SCP_Interpreter *inter)
 {
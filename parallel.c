@@ -0,0 +1,374 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+#define PMAP_MAX_THREADS        (64)    /* 工作线程数上限 */
+
+/* 单条记录的处理状态 */
+typedef enum {
+    PMAP_TASK_PENDING = 1,      /* 尚未被领取 */
+    PMAP_TASK_RUNNING,          /* 已被工作线程领取 */
+    PMAP_TASK_DONE              /* 已完成，结果有效 */
+} PmapTaskState;
+
+/* 一次pmap调用的批次，记录按下标分发，结果按下标存放以保证顺序 */
+typedef struct {
+    FunctionDefinition  *func;
+    FunctionDefinition  *function_list;     /* 调用方的函数定义链表 */
+    SCP_Value           context;            /* 每次调用的第二个实参 */
+    SCP_Boolean         has_context;
+    int                 count;              /* 记录数量 */
+    SCP_Value           *args;              /* 每条记录对应的实参 */
+    SCP_Value           *results;           /* 每条记录对应的结果 */
+    PmapTaskState       *state;
+    int                 next;               /* 下一条待领取的记录 */
+    int                 active;             /* 正在处理的记录数 */
+    int                 error_line;
+    char                *error_message;     /* 第一条出错记录的信息 */
+} PmapBatch;
+
+/* 固定大小的工作线程池 */
+struct ThreadPool_tag {
+    SCP_Interpreter     *parent;
+    pthread_mutex_t     mutex;
+    pthread_cond_t      task_cond;          /* 有新批次或需要退出 */
+    pthread_cond_t      done_cond;          /* 批次处理完毕 */
+    pthread_t           *threads;
+    int                 thread_count;
+    PmapBatch           *batch;             /* 当前批次，同一时间只有一个 */
+    SCP_Boolean         shutdown;
+};
+
+/* 组装一条记录的实参 */
+static int setup_task_args(PmapBatch *batch, int index, SCP_Value *args)
+{
+    args[0] = batch->args[index];
+    if (batch->has_context) {
+        /* 上下文字符串已发布，各线程的引用计数为原子操作 */
+        args[1] = batch->context;
+        if (args[1].type == SCP_STRING_VALUE) {
+            scp_refer_string(args[1].u.string_value);
+        }
+        return 2;
+    }
+    return 1;
+}
+
+/* 在工作线程的解释器上下文中处理一条记录，出错时返回假并在trap中带回错误信息 */
+static SCP_Boolean run_task(SCP_Interpreter *inter, PmapBatch *batch, int index,
+                            SCP_Value *result, ErrorTrap *trap)
+{
+    SCP_Value   args[2];
+    int         arg_count = setup_task_args(batch, index, args);
+    ErrorTrap   *old_trap = scp_set_error_trap(trap);
+    /* 工作线程的分配计入主解释器的内存预算 */
+    MEM_Budget  *old_budget = MEM_set_budget(inter->limit && inter->limit->memory.limit
+                                             ? &inter->limit->memory : NULL);
+
+    if (setjmp(trap->environment)) {
+        MEM_set_budget(old_budget);
+        scp_set_error_trap(old_trap);
+        return SCP_FALSE;
+    }
+    *result = scp_call_function(inter, batch->func, arg_count, args, -1);
+    MEM_set_budget(old_budget);
+    scp_set_error_trap(old_trap);
+
+    return SCP_TRUE;
+}
+
+/* 工作线程主循环，每个线程持有自己的解释器上下文 */
+static void *worker_main(void *arg)
+{
+    ThreadPool      *pool = arg;
+    SCP_Interpreter *inter = scp_create_worker_interpreter(pool->parent);
+    PmapBatch       *batch;
+    ErrorTrap       trap;
+    SCP_Value       result;
+    int             index;
+
+    scp_set_current_interpreter(inter);
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (!pool->shutdown
+               && (pool->batch == NULL || pool->batch->next >= pool->batch->count)) {
+            pthread_cond_wait(&pool->task_cond, &pool->mutex);
+        }
+        if (pool->shutdown)
+            break;
+        /* 领取一条记录 */
+        batch = pool->batch;
+        index = batch->next++;
+        batch->state[index] = PMAP_TASK_RUNNING;
+        batch->active++;
+        inter->function_list = batch->function_list;
+        pthread_mutex_unlock(&pool->mutex);
+
+        if (run_task(inter, batch, index, &result, &trap)) {
+            pthread_mutex_lock(&pool->mutex);
+            batch->results[index] = result;
+            batch->state[index] = PMAP_TASK_DONE;
+        }
+        else {
+            /* 释放出错的调用持有的局部环境和字符串，上下文可以继续使用 */
+            scp_unwind(inter);
+
+            pthread_mutex_lock(&pool->mutex);
+            if (batch->error_message == NULL) {
+                batch->error_line = trap.line_number;
+                batch->error_message = trap.message;
+            } else {
+                MEM_free(trap.message);
+            }
+            /* 停止分发剩余记录 */
+            batch->next = batch->count;
+        }
+        batch->active--;
+        if (batch->active == 0 && batch->next >= batch->count) {
+            pthread_cond_broadcast(&pool->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    SCP_dispose_interpreter(inter);
+
+    return NULL;
+}
+
+/* 获取解释器的线程池，首次使用时按CPU核数创建 */
+static ThreadPool * get_thread_pool(SCP_Interpreter *inter)
+{
+    ThreadPool *pool = inter->thread_pool;
+    long cpu_count;
+    int i;
+
+    if (pool)
+        return pool;
+
+    cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count < 1) {
+        cpu_count = 1;
+    } else if (cpu_count > PMAP_MAX_THREADS) {
+        cpu_count = PMAP_MAX_THREADS;
+    }
+    pool = MEM_malloc(sizeof(ThreadPool));
+    pool->parent = inter;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->task_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    pool->batch = NULL;
+    pool->shutdown = SCP_FALSE;
+    pool->thread_count = 0;
+    pool->threads = MEM_malloc(sizeof(pthread_t) * cpu_count);
+    for (i = 0; i < cpu_count; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0)
+            break;
+        pool->thread_count++;
+    }
+    DBG_assert(pool->thread_count > 0, ("pthread_create failed\n"));
+    inter->thread_pool = pool;
+
+    return pool;
+}
+
+/* 销毁线程池，等待所有工作线程退出 */
+void scp_dispose_thread_pool(ThreadPool *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = SCP_TRUE;
+    pthread_cond_broadcast(&pool->task_cond);
+    pthread_mutex_unlock(&pool->mutex);
+    for (i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->task_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    MEM_free(pool->threads);
+    MEM_free(pool);
+}
+
+/* 将记录字符串按换行符切分为实参数组，返回记录数 */
+static int split_records(char *str, SCP_Value **args)
+{
+    char *pos, *end;
+    int count = 0, i;
+
+    for (pos = str; *pos; pos = end + 1) {
+        count++;
+        end = strchr(pos, '\n');
+        if (end == NULL)
+            break;
+    }
+    *args = MEM_malloc(sizeof(SCP_Value) * (count > 0 ? count : 1));
+    for (i = 0, pos = str; i < count; i++, pos = end + 1) {
+        char *record;
+        int len;
+
+        end = strchr(pos, '\n');
+        len = end ? end - pos : strlen(pos);
+        record = MEM_malloc(len + 1);
+        memcpy(record, pos, len);
+        record[len] = '\0';
+        (*args)[i].type = SCP_STRING_VALUE;
+        (*args)[i].u.string_value = scp_create_sicpy_string(record);
+        if (end == NULL)
+            break;
+    }
+    return count;
+}
+
+/* 按顺序用换行符连接结果，释放各结果 */
+static SCP_String * join_results(SCP_Value *results, int count, SCP_Boolean trailing_newline)
+{
+    SCP_String  **strings = MEM_malloc(sizeof(SCP_String *) * (count > 0 ? count : 1));
+    int         len = 0, i;
+    char        *str, *pos;
+
+    for (i = 0; i < count; i++) {
+        strings[i] = scp_value_to_string(&results[i]);
+        len += strlen(strings[i]->string) + 1;
+    }
+    pos = str = MEM_malloc(len + 1);
+    for (i = 0; i < count; i++) {
+        int piece = strlen(strings[i]->string);
+        memcpy(pos, strings[i]->string, piece);
+        pos += piece;
+        if (i < count - 1 || trailing_newline) {
+            *pos++ = '\n';
+        }
+        scp_release_string(strings[i]);
+    }
+    *pos = '\0';
+    MEM_free(strings);
+
+    return scp_create_sicpy_string(str);
+}
+
+/* 在调用方的上下文中依次处理，用于工作线程中再次调用pmap的情况 */
+static void run_sequential(SCP_Interpreter *inter, PmapBatch *batch)
+{
+    SCP_Value args[2];
+    int i, arg_count;
+
+    for (i = 0; i < batch->count; i++) {
+        arg_count = setup_task_args(batch, i, args);
+        batch->state[i] = PMAP_TASK_RUNNING;
+        batch->results[i] = scp_call_function(inter, batch->func, arg_count, args, -1);
+        batch->state[i] = PMAP_TASK_DONE;
+    }
+}
+
+/* 交给线程池处理并等待整个批次结束 */
+static void run_in_pool(SCP_Interpreter *inter, PmapBatch *batch)
+{
+    ThreadPool *pool = get_thread_pool(inter);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->batch = batch;
+    pthread_cond_broadcast(&pool->task_cond);
+    while (batch->active > 0 || batch->next < batch->count) {
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    }
+    pool->batch = NULL;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/* 出错时释放批次中尚未交出的字符串 */
+static void release_batch_values(PmapBatch *batch)
+{
+    int i;
+    for (i = 0; i < batch->count; i++) {
+        SCP_Value *v = NULL;
+        if (batch->state[i] == PMAP_TASK_PENDING) {
+            v = &batch->args[i];
+        } else if (batch->state[i] == PMAP_TASK_DONE) {
+            v = &batch->results[i];
+        }
+        if (v && v->type == SCP_STRING_VALUE) {
+            scp_release_string(v->u.string_value);
+        }
+    }
+}
+
+/* 回卷根的释放函数，在工作线程中依次处理时出错 */
+static void release_batch_root(void *object)
+{
+    PmapBatch *batch = object;
+
+    release_batch_values(batch);
+    MEM_free(batch->args);
+    MEM_free(batch->results);
+    MEM_free(batch->state);
+}
+
+/* 并行map：在工作线程上对每条记录调用func，结果按原顺序以换行符连接 */
+SCP_Value scp_parallel_map(SCP_Interpreter *inter, FunctionDefinition *func,
+                           SCP_String *records, SCP_Value *context)
+{
+    PmapBatch   batch;
+    SCP_Value   value;
+    int         i, len;
+
+    batch.func = func;
+    batch.function_list = inter->function_list;
+    batch.has_context = context != NULL;
+    if (context) {
+        batch.context = *context;
+        /* 所有工作线程共享同一个上下文字符串 */
+        if (context->type == SCP_STRING_VALUE) {
+            scp_publish_string(context->u.string_value);
+        }
+    }
+    batch.count = split_records(records->string, &batch.args);
+    batch.results = MEM_malloc(sizeof(SCP_Value) * (batch.count > 0 ? batch.count : 1));
+    batch.state = MEM_malloc(sizeof(PmapTaskState) * (batch.count > 0 ? batch.count : 1));
+    for (i = 0; i < batch.count; i++) {
+        batch.state[i] = PMAP_TASK_PENDING;
+    }
+    batch.next = 0;
+    batch.active = 0;
+    batch.error_line = 0;
+    batch.error_message = NULL;
+
+    if (batch.count > 0) {
+        if (inter->parent) {
+            scp_push_unwind_root(inter, NULL, 0, &batch, release_batch_root);
+            run_sequential(inter, &batch);
+            SCP_POP_UNWIND_ROOT(inter);
+        } else {
+            run_in_pool(inter, &batch);
+        }
+    }
+
+    /* 有记录出错，在调用方报告运行错误 */
+    if (batch.error_message) {
+        char message[LINE_BUF_SIZE];
+        strncpy(message, batch.error_message, LINE_BUF_SIZE - 1);
+        message[LINE_BUF_SIZE - 1] = '\0';
+        MEM_free(batch.error_message);
+        release_batch_values(&batch);
+        MEM_free(batch.args);
+        MEM_free(batch.results);
+        MEM_free(batch.state);
+        scp_runtime_error(-1, PMAP_WORKER_ERR, INT_MESSAGE_ARGUMENT, "line", batch.error_line,
+                          STRING_MESSAGE_ARGUMENT, "name", func->name,
+                          STRING_MESSAGE_ARGUMENT, "message", message, MESSAGE_ARGUMENT_END);
+    }
+
+    len = strlen(records->string);
+    value.type = SCP_STRING_VALUE;
+    value.u.string_value = join_results(batch.results, batch.count,
+                                        len > 0 && records->string[len - 1] == '\n');
+    MEM_free(batch.args);
+    MEM_free(batch.results);
+    MEM_free(batch.state);
+
+    return value;
+}
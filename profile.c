@@ -0,0 +1,379 @@
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/time.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+#define PROFILE_INTERVAL_USEC   (1000)  /* 采样间隔（CPU时间） */
+#define PROFILE_HASH_SIZE       (1024)  /* 调用栈哈希表的桶数 */
+#define PROFILE_TOPLEVEL_NAME   "<toplevel>"
+
+/*
+ * 采样分析器：SIGPROF信号处理函数只把scp_profile_pending计数加1，
+ * 真正的采样在主解释器执行下一条语句前进行，此时行号和调用栈都是一致的。
+ * 两次检查之间到达的每个信号都计一次采样，长时间的原生函数调用（pmap、读写文件）不会被少算。
+ */
+
+/* 一种调用栈（由外到内的函数序列）及其采样次数 */
+typedef struct StackSample_tag {
+    unsigned long       hash;
+    int                 depth;
+    FunctionDefinition  **funcs;
+    long                count;
+    struct StackSample_tag *next;
+} StackSample;
+
+struct Profiler_tag {
+    char        *script_path;
+    long        total_samples;
+    long        *line_samples;          /* 下标为行号 */
+    int         line_alloc;
+    StackSample *stack_table[PROFILE_HASH_SIZE];
+};
+
+/* 报告中每个函数的统计 */
+typedef struct {
+    FunctionDefinition  *func;
+    long                self;           /* 位于栈顶的采样数 */
+    long                total;          /* 位于栈中的采样数 */
+} FunctionSample;
+
+volatile sig_atomic_t scp_profile_pending = 0;
+
+static Profiler *st_active_profiler = NULL;
+static SCP_Boolean st_atexit_registered = SCP_FALSE;
+
+/* SIGPROF处理函数，只累计未处理的信号数，信号可能在任一线程中处理 */
+static void profile_signal_handler(int sig)
+{
+    __atomic_add_fetch(&scp_profile_pending, 1, __ATOMIC_RELAXED);
+}
+
+/* 创建分析器，报告写入script_path.prof和script_path.folded */
+Profiler * scp_create_profiler(char *script_path)
+{
+    Profiler *profiler = MEM_malloc(sizeof(Profiler));
+    int i;
+
+    profiler->script_path = MEM_strdup(script_path);
+    profiler->total_samples = 0;
+    profiler->line_alloc = 0;
+    profiler->line_samples = NULL;
+    for (i = 0; i < PROFILE_HASH_SIZE; i++) {
+        profiler->stack_table[i] = NULL;
+    }
+
+    return profiler;
+}
+
+/* 对调用栈中的函数序列计算FNV-1a哈希 */
+static unsigned long hash_call_stack(CallFrame *stack, int depth)
+{
+    unsigned long hash = 2166136261UL;
+    int i;
+
+    for (i = 0; i < depth; i++) {
+        hash ^= (unsigned long)stack[i].func;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+/* 记录count次相同调用栈的采样 */
+static void add_stack_sample(Profiler *profiler, CallFrame *stack, int depth, long count)
+{
+    unsigned long hash = hash_call_stack(stack, depth);
+    StackSample **bucket = &profiler->stack_table[hash % PROFILE_HASH_SIZE];
+    StackSample *pos;
+    int i;
+
+    for (pos = *bucket; pos; pos = pos->next) {
+        if (pos->hash != hash || pos->depth != depth)
+            continue;
+        for (i = 0; i < depth; i++) {
+            if (pos->funcs[i] != stack[i].func)
+                break;
+        }
+        if (i == depth) {
+            pos->count += count;
+            return;
+        }
+    }
+
+    /* 新的调用栈，头插法加入桶中 */
+    pos = MEM_malloc(sizeof(StackSample));
+    pos->hash = hash;
+    pos->depth = depth;
+    pos->funcs = MEM_malloc(sizeof(FunctionDefinition *) * (depth > 0 ? depth : 1));
+    for (i = 0; i < depth; i++) {
+        pos->funcs[i] = stack[i].func;
+    }
+    pos->count = count;
+    pos->next = *bucket;
+    *bucket = pos;
+}
+
+/* 按未处理的信号数记录当前行号和调用栈，由主解释器在执行语句前调用 */
+void scp_profile_sample(SCP_Interpreter *inter)
+{
+    Profiler *profiler = inter->profiler;
+    int line = inter->current_line_number;
+    int new_alloc;
+    long ticks;
+
+    ticks = __atomic_exchange_n(&scp_profile_pending, 0, __ATOMIC_RELAXED);
+    if (ticks <= 0)
+        return;
+    profiler->total_samples += ticks;
+
+    if (line >= profiler->line_alloc) {
+        new_alloc = profiler->line_alloc ? profiler->line_alloc : 256;
+        while (line >= new_alloc) {
+            new_alloc *= 2;
+        }
+        profiler->line_samples = MEM_realloc(profiler->line_samples, sizeof(long) * new_alloc);
+        memset(profiler->line_samples + profiler->line_alloc, 0,
+               sizeof(long) * (new_alloc - profiler->line_alloc));
+        profiler->line_alloc = new_alloc;
+    }
+    if (line >= 0) {
+        profiler->line_samples[line] += ticks;
+    }
+    add_stack_sample(profiler, inter->call_stack, inter->call_stack_depth, ticks);
+}
+
+/* 查找或新增函数统计项 */
+static FunctionSample * search_function_sample(FunctionSample *table, int *count,
+                                               FunctionDefinition *func)
+{
+    int i;
+    for (i = 0; i < *count; i++) {
+        if (table[i].func == func)
+            return &table[i];
+    }
+    table[*count].func = func;
+    table[*count].self = 0;
+    table[*count].total = 0;
+    return &table[(*count)++];
+}
+
+/* 按total降序 */
+static int compare_function_sample(const void *a, const void *b)
+{
+    const FunctionSample *fa = a;
+    const FunctionSample *fb = b;
+
+    if (fa->total != fb->total)
+        return fa->total < fb->total ? 1 : -1;
+    return fa->self < fb->self ? 1 : (fa->self > fb->self ? -1 : 0);
+}
+
+static char * function_name(FunctionDefinition *func)
+{
+    return func ? func->name : PROFILE_TOPLEVEL_NAME;
+}
+
+/* 写出按行统计的表，附上对应的源码 */
+static void write_line_table(Profiler *profiler, FILE *out)
+{
+    FILE *src = fopen(profiler->script_path, "r");
+    char buf[1024];
+    int line = 1, len;
+    SCP_Boolean line_head = SCP_TRUE, complete;
+    double total = profiler->total_samples > 0 ? (double)profiler->total_samples : 1.0;
+
+    fprintf(out, "# sicpy profile of %s: %ld samples, %d us interval\n",
+            profiler->script_path, profiler->total_samples, PROFILE_INTERVAL_USEC);
+    fprintf(out, "#\n#   line    samples  percent  source\n");
+    if (src == NULL) {
+        for (line = 0; line < profiler->line_alloc; line++) {
+            if (profiler->line_samples[line] == 0)
+                continue;
+            fprintf(out, "%8d %10ld  %6.2f%%\n", line, profiler->line_samples[line],
+                    profiler->line_samples[line] * 100.0 / total);
+        }
+        return;
+    }
+    /* 逐行读取源码，只输出有采样的行 */
+    while (fgets(buf, sizeof(buf), src)) {
+        len = strlen(buf);
+        complete = (buf[len - 1] == '\n');
+        if (complete) {
+            buf[len - 1] = '\0';
+        }
+        /* 过长的行只输出开头部分 */
+        if (line_head && line < profiler->line_alloc && profiler->line_samples[line] > 0) {
+            fprintf(out, "%8d %10ld  %6.2f%%  %s\n", line, profiler->line_samples[line],
+                    profiler->line_samples[line] * 100.0 / total, buf);
+        }
+        line_head = complete;
+        if (complete) {
+            line++;
+        }
+    }
+    fclose(src);
+}
+
+/* 写出按函数统计的表，self为函数自身的采样，total包含其调用的函数 */
+static void write_function_table(Profiler *profiler, FILE *out)
+{
+    FunctionSample *table;
+    FunctionSample *entry;
+    StackSample *pos;
+    int capacity = 1, count = 0, i, j, k;
+    double total = profiler->total_samples > 0 ? (double)profiler->total_samples : 1.0;
+
+    /* 函数个数不会超过所有调用栈深度之和加上顶层 */
+    for (i = 0; i < PROFILE_HASH_SIZE; i++) {
+        for (pos = profiler->stack_table[i]; pos; pos = pos->next) {
+            capacity += pos->depth;
+        }
+    }
+    table = MEM_malloc(sizeof(FunctionSample) * capacity);
+
+    for (i = 0; i < PROFILE_HASH_SIZE; i++) {
+        for (pos = profiler->stack_table[i]; pos; pos = pos->next) {
+            entry = search_function_sample(table, &count, NULL);
+            entry->total += pos->count;
+            if (pos->depth == 0) {
+                entry->self += pos->count;
+            }
+            for (j = 0; j < pos->depth; j++) {
+                /* 递归调用在同一个栈中只计一次total */
+                for (k = 0; k < j; k++) {
+                    if (pos->funcs[k] == pos->funcs[j])
+                        break;
+                }
+                entry = search_function_sample(table, &count, pos->funcs[j]);
+                if (k == j) {
+                    entry->total += pos->count;
+                }
+                if (j == pos->depth - 1) {
+                    entry->self += pos->count;
+                }
+            }
+        }
+    }
+    qsort(table, count, sizeof(FunctionSample), compare_function_sample);
+
+    fprintf(out, "#\n# function                          self   percent      total   percent\n");
+    for (i = 0; i < count; i++) {
+        fprintf(out, "  %-28s %10ld  %6.2f%% %10ld  %6.2f%%\n", function_name(table[i].func),
+                table[i].self, table[i].self * 100.0 / total,
+                table[i].total, table[i].total * 100.0 / total);
+    }
+    MEM_free(table);
+}
+
+/* 写出折叠调用栈文件，每行形如"<toplevel>;f;g 12"，可直接交给火焰图工具 */
+static void write_folded_stacks(Profiler *profiler, FILE *out)
+{
+    StackSample *pos;
+    int i, j;
+
+    for (i = 0; i < PROFILE_HASH_SIZE; i++) {
+        for (pos = profiler->stack_table[i]; pos; pos = pos->next) {
+            fputs(PROFILE_TOPLEVEL_NAME, out);
+            for (j = 0; j < pos->depth; j++) {
+                fprintf(out, ";%s", pos->funcs[j]->name);
+            }
+            fprintf(out, " %ld\n", pos->count);
+        }
+    }
+}
+
+/* 打开报告文件，文件名为脚本路径加上后缀 */
+static FILE * open_report(Profiler *profiler, char *suffix)
+{
+    char *path = MEM_malloc(strlen(profiler->script_path) + strlen(suffix) + 1);
+    FILE *fp;
+
+    strcpy(path, profiler->script_path);
+    strcat(path, suffix);
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "cannot write profile %s.\n", path);
+    }
+    MEM_free(path);
+
+    return fp;
+}
+
+static void stop_timer(void)
+{
+    struct itimerval timer;
+
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    signal(SIGPROF, SIG_IGN);
+}
+
+/* 停止采样，写出报告并释放分析器 */
+void scp_stop_profiler(Profiler *profiler)
+{
+    StackSample *pos;
+    FILE *fp;
+    int i;
+
+    stop_timer();
+    st_active_profiler = NULL;
+
+    if ((fp = open_report(profiler, ".prof")) != NULL) {
+        write_line_table(profiler, fp);
+        write_function_table(profiler, fp);
+        fclose(fp);
+    }
+    if ((fp = open_report(profiler, ".folded")) != NULL) {
+        write_folded_stacks(profiler, fp);
+        fclose(fp);
+    }
+
+    for (i = 0; i < PROFILE_HASH_SIZE; i++) {
+        while (profiler->stack_table[i]) {
+            pos = profiler->stack_table[i];
+            profiler->stack_table[i] = pos->next;
+            MEM_free(pos->funcs);
+            MEM_free(pos);
+        }
+    }
+    MEM_free(profiler->line_samples);
+    MEM_free(profiler->script_path);
+    MEM_free(profiler);
+}
+
+/* 运行错误直接退出进程时，仍然写出已采集的数据 */
+static void finish_at_exit(void)
+{
+    if (st_active_profiler) {
+        scp_stop_profiler(st_active_profiler);
+    }
+}
+
+/* 开始采样 */
+void scp_start_profiler(Profiler *profiler)
+{
+    struct sigaction action;
+    struct itimerval timer;
+
+    if (!st_atexit_registered) {
+        atexit(finish_at_exit);
+        st_atexit_registered = SCP_TRUE;
+    }
+    st_active_profiler = profiler;
+    scp_profile_pending = 0;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = profile_signal_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, NULL);
+
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = PROFILE_INTERVAL_USEC;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
@@ -0,0 +1,210 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+/*
+ * 预热的fork服务（--server）：脚本只编译一次，之后在本地Unix套接字上等待请求。
+ * 客户端（--client）把自己的标准输入、输出和错误三个文件描述符以SCM_RIGHTS传过来，
+ * 服务为每个请求fork一个子进程，子进程与父进程写时复制地共享编译好的程序，
+ * 把三个描述符换成标准输入输出后执行SCP_interpret，结束时把退出码写回客户端。
+ */
+
+#define SERVER_FD_COUNT     (3)     /* 标准输入、输出、错误 */
+#define SERVER_BACKLOG      (128)
+
+static void set_socket_address(struct sockaddr_un *address, char *path)
+{
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    strncpy(address->sun_path, path, sizeof(address->sun_path) - 1);
+}
+
+/* 关闭控制消息中收到的所有描述符，消息不符合要求时不能把它们留在服务进程中 */
+static void close_received_fds(struct msghdr *message)
+{
+    struct cmsghdr *cmsg;
+    int *received;
+    int count, i;
+
+    for (cmsg = CMSG_FIRSTHDR(message); cmsg; cmsg = CMSG_NXTHDR(message, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+            || cmsg->cmsg_len < CMSG_LEN(0))
+            continue;
+        count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        received = (int *)CMSG_DATA(cmsg);
+        for (i = 0; i < count; i++) {
+            close(received[i]);
+        }
+    }
+}
+
+/*
+ * 收取客户端传来的文件描述符，成功时返回SCP_TRUE。
+ * 控制消息被截断、类型或长度不对时关闭收到的描述符并返回SCP_FALSE
+ */
+static SCP_Boolean receive_fds(int connection, int *fds)
+{
+    struct msghdr message;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char byte;
+    char control[CMSG_SPACE(sizeof(int) * SERVER_FD_COUNT)];
+    ssize_t received;
+
+    memset(&message, 0, sizeof(message));
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    received = recvmsg(connection, &message, 0);
+    if (received < 0)
+        return SCP_FALSE;
+    if (received != 1) {
+        /* 没有收到数据时也可能带有描述符 */
+        close_received_fds(&message);
+        return SCP_FALSE;
+    }
+    cmsg = CMSG_FIRSTHDR(&message);
+    if ((message.msg_flags & MSG_CTRUNC) || cmsg == NULL
+        || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+        || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * SERVER_FD_COUNT)
+        || CMSG_NXTHDR(&message, cmsg) != NULL) {
+        close_received_fds(&message);
+        return SCP_FALSE;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * SERVER_FD_COUNT);
+
+    return SCP_TRUE;
+}
+
+/* 子进程：换上客户端的标准输入输出执行脚本，退出码写回客户端 */
+static void run_request(SCP_Interpreter *interpreter, int connection, int *fds)
+{
+    int i, status;
+
+    for (i = 0; i < SERVER_FD_COUNT; i++) {
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+    clearerr(stdin);
+    status = scp_run_child(interpreter, NULL);
+    if (write(connection, &status, sizeof(status)) < 0) {
+        status = 1;
+    }
+    _exit(status);
+}
+
+/*
+ * 在path上监听，为每个请求fork子进程执行已编译的脚本，正常情况下不返回。
+ * 不能监听时返回-1
+ */
+int SCP_serve(SCP_Interpreter *interpreter, char *path)
+{
+    struct sockaddr_un address;
+    int listener, connection, i;
+    int fds[SERVER_FD_COUNT];
+    pid_t pid;
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+        return -1;
+    set_socket_address(&address, path);
+    unlink(path);
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0
+        || listen(listener, SERVER_BACKLOG) < 0) {
+        close(listener);
+        return -1;
+    }
+    /* 子进程结束后自动回收 */
+    signal(SIGCHLD, SIG_IGN);
+    for (;;) {
+        connection = accept(listener, NULL, NULL);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+        if (!receive_fds(connection, fds)) {
+            close(connection);
+            continue;
+        }
+        pid = scp_fork();
+        if (pid == 0) {
+            close(listener);
+            run_request(interpreter, connection, fds);
+        }
+        for (i = 0; i < SERVER_FD_COUNT; i++) {
+            close(fds[i]);
+        }
+        if (pid < 0) {
+            i = 1;
+            if (write(connection, &i, sizeof(i)) < 0) {
+                /* 客户端已断开 */
+            }
+        }
+        close(connection);
+    }
+    close(listener);
+
+    return -1;
+}
+
+/*
+ * 客户端：把自己的标准输入、输出和错误交给path上的服务执行脚本，
+ * 返回脚本的退出码，连不上服务时返回-1
+ */
+int SCP_run_client(char *path)
+{
+    struct sockaddr_un address;
+    struct msghdr message;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    int fds[SERVER_FD_COUNT] = {0, 1, 2};
+    char control[CMSG_SPACE(sizeof(int) * SERVER_FD_COUNT)];
+    char byte = 0;
+    int connection, status;
+
+    connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0)
+        return -1;
+    set_socket_address(&address, path);
+    if (connect(connection, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        close(connection);
+        return -1;
+    }
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(connection, &message, 0) != 1) {
+        close(connection);
+        return -1;
+    }
+    /* 子进程异常终止时连接直接关闭，视为出错 */
+    if (read(connection, &status, sizeof(status)) != sizeof(status)) {
+        status = 1;
+    }
+    close(connection);
+
+    return status;
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <string.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+/*
+ * 未调用函数的剪除（--tree-shake）：从顶层语句出发沿调用关系找出可能执行的函数，
+ * 其余的sicpy函数从函数链表中摘除，之后的类型推断、循环优化、预编译缓存和每次调用时的
+ * 函数查找都不再涉及它们。pmap()和memo_stats()以字符串传入函数名，
+ * 所以与某个函数同名的字符串常量也算作对该函数的引用；运行时拼接出的函数名无法得知。
+ * --lazy时只分析可达函数的函数体，不可达的函数体始终不分析。
+ */
+
+typedef struct {
+    FunctionDefinition  **function;     /* 函数链表中的sicpy函数 */
+    SCP_Boolean         *reached;
+    int                 count;
+    int                 *table;         /* 按函数名散列的下标，-1为空位 */
+    unsigned int        mask;
+    int                 *work;          /* 已到达、尚未扫描函数体的函数 */
+    int                 work_count;
+} TreeShaker;
+
+static int search_index(TreeShaker *shaker, char *name)
+{
+    unsigned int i = scp_hash_string(name, strlen(name)) & shaker->mask;
+
+    for (; shaker->table[i] >= 0; i = (i + 1) & shaker->mask) {
+        if (!strcmp(shaker->function[shaker->table[i]]->name, name))
+            return shaker->table[i];
+    }
+    return -1;
+}
+
+/* name为sicpy函数且第一次到达时加入工作表 */
+static void reach(TreeShaker *shaker, char *name)
+{
+    int index = search_index(shaker, name);
+
+    if (index < 0 || shaker->reached[index])
+        return;
+    shaker->reached[index] = SCP_TRUE;
+    shaker->work[shaker->work_count++] = index;
+}
+
+/* 调用的函数和与函数同名的字符串常量 */
+static SCP_Boolean scan_expression(Visitor *visitor, Expression *expr)
+{
+    if (expr->type == STRING_EXPRESSION) {
+        reach(visitor->data, expr->u.string_value->string);
+    } else if (expr->type == FUNCTION_CALL_EXPRESSION) {
+        reach(visitor->data, expr->u.function_call_expression.identifier);
+    }
+    return SCP_TRUE;
+}
+
+static void scan_statement_list(TreeShaker *shaker, StatementList *list)
+{
+    Visitor visitor;
+
+    visitor.statement = NULL;
+    visitor.expression = scan_expression;
+    visitor.data = shaker;
+    scp_visit_statement_list(&visitor, list);
+}
+
+/* 收集sicpy函数并按函数名建立散列表 */
+static void init_shaker(TreeShaker *shaker, SCP_Interpreter *inter)
+{
+    FunctionDefinition *func;
+    unsigned int size, i;
+    int n;
+
+    shaker->count = 0;
+    for (func = inter->function_list; func; func = func->next) {
+        if (func->type == SICPY_FUNCTION_DEFINITION)
+            shaker->count++;
+    }
+    for (size = 16; size < (unsigned int)shaker->count * 2; size *= 2)
+        ;
+    shaker->mask = size - 1;
+    shaker->table = MEM_malloc(sizeof(int) * size);
+    for (i = 0; i < size; i++) {
+        shaker->table[i] = -1;
+    }
+    shaker->function = MEM_malloc(sizeof(FunctionDefinition *) * (shaker->count + 1));
+    shaker->reached = MEM_malloc(sizeof(SCP_Boolean) * (shaker->count + 1));
+    shaker->work = MEM_malloc(sizeof(int) * (shaker->count + 1));
+    shaker->work_count = 0;
+    n = 0;
+    for (func = inter->function_list; func; func = func->next) {
+        if (func->type != SICPY_FUNCTION_DEFINITION)
+            continue;
+        shaker->function[n] = func;
+        shaker->reached[n] = SCP_FALSE;
+        i = scp_hash_string(func->name, strlen(func->name)) & shaker->mask;
+        while (shaker->table[i] >= 0) {
+            i = (i + 1) & shaker->mask;
+        }
+        shaker->table[i] = n;
+        n++;
+    }
+}
+
+static void dispose_shaker(TreeShaker *shaker)
+{
+    MEM_free(shaker->function);
+    MEM_free(shaker->reached);
+    MEM_free(shaker->table);
+    MEM_free(shaker->work);
+}
+
+/* 摘除不可达的sicpy函数，被摘除的函数名记录在inter中，由预编译缓存一起保存 */
+void scp_tree_shake(SCP_Interpreter *inter)
+{
+    TreeShaker shaker;
+    FunctionDefinition *func, **link;
+    IdentifierList **removed = &inter->tree_shake_removed;
+    int index;
+
+    init_shaker(&shaker, inter);
+    scan_statement_list(&shaker, inter->statement_list);
+    while (shaker.work_count > 0) {
+        func = shaker.function[shaker.work[--shaker.work_count]];
+        if (func->u.sicpy_f.lazy) {
+            scp_parse_lazy_function(func);
+        }
+        scan_statement_list(&shaker, func->u.sicpy_f.block->statement_list);
+    }
+
+    index = 0;
+    for (link = &inter->function_list; *link; ) {
+        func = *link;
+        if (func->type != SICPY_FUNCTION_DEFINITION) {
+            link = &func->next;
+            continue;
+        }
+        if (shaker.reached[index++]) {
+            link = &func->next;
+            continue;
+        }
+        *link = func->next;
+        if (func->u.sicpy_f.memo) {
+            scp_dispose_memo_cache(func->u.sicpy_f.memo);
+            func->u.sicpy_f.memo = NULL;
+        }
+        *removed = scp_create_global_identifier(func->name);
+        removed = &(*removed)->next;
+    }
+    inter->tree_shake_count = shaker.count;
+    dispose_shaker(&shaker);
+}
+
+/* report不为NULL时输出被摘除的函数和摘除的个数 */
+void scp_report_tree_shake(SCP_Interpreter *inter, FILE *report)
+{
+    IdentifierList *pos;
+    int removed = 0;
+
+    if (report == NULL)
+        return;
+    for (pos = inter->tree_shake_removed; pos; pos = pos->next) {
+        fprintf(report, "tree-shake: removed %s\n", pos->name);
+        removed++;
+    }
+    fprintf(report, "tree-shake: %d of %d functions removed\n", removed,
+            inter->tree_shake_count);
+}
@@ -1,17 +1,35 @@
 #ifndef PUBLIC_SICPY_H_INCLUDED
 #define PRIVATE_SICPY_H_INCLUDED
 #include <stdio.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/types.h>
 #include "MEM.h"
 #include "SCP.h"
 
 #define MESSAGE_ARGUMENT_MAX    (256)
 #define LINE_BUF_SIZE           (1024)
+#define CALL_STACK_INITIAL_SIZE (64)
+#define SCP_STACK_MARGIN        (128 * 1024)    /* C栈剩余空间少于该值时换到新的栈段 */
+#define SCP_DEFAULT_MAX_STACK   (2048)          /* 栈段总大小的默认上限，单位MB */
+#define SCP_LIMIT_CLOCK_TICKS   (1024)          /* 有时间限制时每隔多少个节拍读一次时钟 */
 
 /* 编译错误类型，注意第一个赋值为0，之后会递增 */
 typedef enum {
     PARSE_ERR = 0,
     CHARACTER_INVALID_ERR,
     FUNCTION_MULTIPLE_DEFINE_ERR,
+    YIELD_OUTSIDE_FUNCTION_ERR,
+    FOR_IN_NOT_RANGE_ERR,
+    RANGE_ARGUMENT_COUNT_ERR,
+    MATCH_DUPLICATE_CASE_ERR,
+    MEMO_GLOBAL_ERR,
+    MEMO_NATIVE_CALL_ERR,
+    MEMO_GENERATOR_ERR,
+    IMPORT_NOT_FOUND_ERR,
+    IMPORT_CYCLE_ERR,
+    MODULE_STATEMENT_ERR,
+    PARSE_ABORT_ERR,
     COMPILE_ERROR_COUNT_PLUS_1
 } CompileError;
 
@@ -34,6 +52,21 @@ typedef enum {
     GLOBAL_VARIABLE_NOT_FOUND_ERR,
     GLOBAL_STATEMENT_IN_TOPLEVEL_ERR,
     BAD_OPERATOR_FOR_STRING_ERR,
+    PMAP_ARGUMENT_TYPE_ERR,
+    PMAP_WORKER_ERR,
+    GENERATOR_RUNNING_ERR,
+    GENERATOR_ACTIVE_ERR,
+    STACK_OVERFLOW_ERR,
+    RANGE_ARGUMENT_TYPE_ERR,
+    RANGE_STEP_ZERO_ERR,
+    MEMO_STATS_ARGUMENT_ERR,
+    FUEL_EXHAUSTED_ERR,
+    TIME_LIMIT_ERR,
+    MEMORY_LIMIT_ERR,
+    SNAPSHOT_ARGUMENT_ERR,
+    SNAPSHOT_POSITION_ERR,
+    SNAPSHOT_VALUE_ERR,
+    SNAPSHOT_WRITE_ERR,
     RUNTIME_ERROR_COUNT_PLUS_1
 } RuntimeError;
 
@@ -83,6 +116,10 @@ typedef enum {
     MINUS_EXPRESSION,
     FUNCTION_CALL_EXPRESSION,
     NULL_EXPRESSION,
+    COMPOUND_ASSIGN_EXPRESSION,
+    INCREMENT_EXPRESSION,
+    DECREMENT_EXPRESSION,
+    LOOP_INVARIANT_EXPRESSION,
     EXPRESSION_TYPE_COUNT_PLUS_1
 } ExpressionType;
 
@@ -99,12 +136,33 @@ typedef enum {
 #define dkc_is_logical_operator(operator) \
   ((operator) == LOGICAL_AND_EXPRESSION || (operator) == LOGICAL_OR_EXPRESSION)
 
+/*
+ * 类型推断的结果：UNKNOWN表示还没有推断出任何值（不可能执行到或尚未赋值），
+ * ANY表示可能是多种类型，其余为能够证明的唯一类型
+ */
+typedef enum {
+    INFER_UNKNOWN = 0,
+    INFER_BOOLEAN,
+    INFER_INT,
+    INFER_DOUBLE,
+    INFER_STRING,
+    INFER_NULL,
+    INFER_ANY
+} InferType;
+
+/* SCP布尔值 */
+typedef enum {
+    SCP_FALSE = 0,
+    SCP_TRUE = 1
+} SCP_Boolean;
+
 typedef struct Statement_tag Statement;
 typedef struct Expression_tag Expression;
 
 typedef struct StatementList_tag {
     Statement   *statement;
     struct StatementList_tag    *next;
+    struct StatementList_tag    *last;  /* 链表尾，仅头节点有效，追加时不必遍历 */
 } StatementList;
 
 /* 实参列表，内容为表达式，这样可以在实参中传递表达式 */
@@ -119,6 +177,13 @@ typedef struct {
     Expression  *operand;
 } AssignExpression;
 
+/* 复合赋值表达式，形如a += 3，operator为对应的算术表达式类型 */
+typedef struct {
+    char            *variable;
+    ExpressionType  operator;
+    Expression      *operand;
+} CompoundAssignExpression;
+
 /* 二值表达式 */
 typedef struct {
     Expression  *left;
@@ -129,14 +194,9 @@ typedef struct {
 typedef struct {
     char                *identifier;
     ArgumentList        *argument;
+    SCP_Boolean         is_tail_call;   /* return语句中对所在函数自身的调用 */
 } FunctionCallExpression;
 
-/* SCP布尔值 */
-typedef enum {
-    SCP_FALSE = 0,
-    SCP_TRUE = 1
-} SCP_Boolean;
-
 
 
 /* SCP Value类型 */
@@ -160,7 +220,10 @@ typedef struct {
 typedef struct SCP_String_tag {
     int         ref_count;      /* 引用计数 */
     char        *string;        /* 字符数组 */
-    SCP_Boolean is_literal;     /* 是否需要进行引用计数 */
+    SCP_Boolean is_literal;     /* 字面常量，不可变且不进行引用计数 */
+    SCP_Boolean is_shared;      /* 已发布给其他线程，引用计数改用原子操作 */
+    int         length;         /* 字符数，不含结尾的'\0' */
+    int         capacity;       /* 字符数组的容量，+=原地追加时成倍扩大 */
 }SCP_String;
 
 /* SCP基础值类型，包括布尔、int、double、string和指针 */
@@ -175,20 +238,34 @@ typedef struct {
     } u;
 } SCP_Value;
 
+/*
+ * 循环不变表达式：包装从循环中提出的子表达式，每次进入循环后第一次求值时计算，
+ * 同一次循环中之后直接取缓存的值。loop_epoch指向所在循环当前的激活编号
+ */
+typedef struct {
+    Expression          *operand;
+    unsigned long       *loop_epoch;
+    unsigned long       epoch;          /* value所属的激活编号 */
+    SCP_Value           value;
+} LoopInvariantExpression;
+
 /* 表达式结构体 */
 struct Expression_tag {
     ExpressionType type;
     int line_number;
+    InferType static_type;      /* 类型推断的结果 */
     union {
         SCP_Boolean             boolean_value;              /* 布尔值 */
         int                     int_value;                  /* int值 */
         double                  double_value;               /* double值 */
-        char                    *string_value;              /* string值 */
+        SCP_String              *string_value;              /* string值，编译期创建的字面常量 */
         char                    *identifier;                /* 标识符 */
         AssignExpression        assign_expression;          /* 赋值表达式 */
+        CompoundAssignExpression compound_assign_expression; /* 复合赋值表达式 */
         BinaryExpression        binary_expression;          /* 二值表达式 */
         Expression              *minus_expression;          /* 负值表达式 */
         FunctionCallExpression  function_call_expression;   /* 函数调用表达式 */
+        LoopInvariantExpression *loop_invariant;            /* 循环不变表达式 */
     } u;
 };
 
@@ -221,6 +298,7 @@ typedef struct {
 typedef struct {
     Expression  *condition;
     Block       *block;
+    unsigned long       epoch;      /* 当前这次执行的激活编号 */
 } WhileBlock;
 
 /* For语句块，有初始化、条件内容、循环中执行内容与语句块 */
@@ -229,8 +307,51 @@ typedef struct {
     Expression  *condition;
     Expression  *post;
     Block       *block;
+    unsigned long       epoch;
 } ForBlock;
 
+/* for-in语句块，遍历range(start, end, step)，start和step可省略 */
+typedef struct {
+    char        *variable;
+    Expression  *start;
+    Expression  *end;
+    Expression  *step;
+    Block       *block;
+    unsigned long       epoch;
+} RangeForBlock;
+
+/* match的分支，labels为常量表达式链表，default分支的labels为NULL */
+typedef struct MatchCase_tag {
+    ArgumentList        *labels;
+    Block               *block;
+    struct MatchCase_tag *next;
+} MatchCase;
+
+/* int分支的跳转表项，按值排序后二分查找 */
+typedef struct {
+    int         value;
+    Block       *block;
+} MatchIntEntry;
+
+/* string分支的散列表项，开放定址，string为NULL的是空位 */
+typedef struct {
+    char        *string;
+    int         length;
+    unsigned int hash;
+    Block       *block;
+} MatchStringEntry;
+
+/* match语句块，分支表在语法分析时建立 */
+typedef struct {
+    Expression          *condition;
+    MatchCase           *case_list;
+    Block               *default_block;
+    MatchIntEntry       *int_table;
+    int                 int_count;
+    MatchStringEntry    *string_table;
+    unsigned int        string_mask;        /* 散列表大小减1 */
+} MatchBlock;
+
 
 /* 语句类型 */
 typedef enum {
@@ -242,6 +363,9 @@ typedef enum {
     RETURN_STATEMENT,
     BREAK_STATEMENT,
     CONTINUE_STATEMENT,
+    YIELD_STATEMENT,
+    RANGE_FOR_STATEMENT,
+    MATCH_STATEMENT,
     STATEMENT_TYPE_COUNT_PLUS_1
 } StatementType;
 
@@ -255,10 +379,24 @@ struct Statement_tag {
         IfBlock         if_block;                       /* if代码块 */
         WhileBlock      while_block;                    /* while代码块 */
         ForBlock        for_block;                      /* for代码块 */
+        RangeForBlock   range_for_block;                /* for-in代码块 */
+        MatchBlock      match_block;                    /* match代码块 */
         Expression      *return_expression;             /* 返回表达式 */
+        Expression      *yield_expression;              /* yield表达式 */
     } u;
 };
 
+/*
+ * 语法树的遍历，按源码中的顺序先访问节点本身，再访问其中的表达式和语句。
+ * 回调返回SCP_FALSE时不访问该节点的子节点；statement为NULL时访问所有语句，
+ * expression为NULL时不访问表达式
+ */
+typedef struct Visitor_tag {
+    SCP_Boolean (*statement)(struct Visitor_tag *visitor, Statement *st);
+    SCP_Boolean (*expression)(struct Visitor_tag *visitor, Expression *expr);
+    void        *data;
+} Visitor;
+
 
 /* 形参列表结构体 */
 typedef struct ParameterList_tag {
@@ -266,6 +404,26 @@ typedef struct ParameterList_tag {
     struct ParameterList_tag *next;
 } ParameterList;
 
+/*
+ * --lazy时尚未分析的函数体：源码中从{到}的范围和起始行号，
+ * 以及其中global语句声明的名字（词法分析跳过函数体时记录，供类型推断和循环优化使用）
+ */
+typedef struct {
+    char                *text;
+    int                 length;
+    int                 line_number;
+    IdentifierList      *globals;
+} LazyBody;
+
+/* import声明的模块路径，语法分析结束后按出现的顺序导入 */
+typedef struct ImportList_tag {
+    char                *path;
+    int                 line_number;
+    struct ImportList_tag *next;
+} ImportList;
+
+typedef struct Module_tag Module;
+
 /* 函数定义类型，包含普通函数定义，和预留的被C调用的函数接口 */
 typedef enum {
     SICPY_FUNCTION_DEFINITION = 1,
@@ -275,6 +433,10 @@ typedef enum {
 typedef SCP_Value SCP_NativeFunctionProc(SCP_Interpreter *interpreter, int arg_count, SCP_Value *args);
 
 /* 函数定义结构体 */
+typedef struct JitInfo_tag JitInfo;
+typedef struct MemoCache_tag MemoCache;
+typedef struct MemoEntry_tag MemoEntry;
+
 typedef struct FunctionDefinition_tag {
     char                *name;
     FunctionDefinitionType      type;
@@ -282,6 +444,13 @@ typedef struct FunctionDefinition_tag {
         struct {
             ParameterList       *parameter;
             Block               *block;
+            SCP_Boolean         is_generator;   /* 函数体含有yield语句 */
+            int                 call_count;     /* 编译前的调用次数 */
+            JitInfo             *jit;           /* JIT编译结果，未尝试编译时为NULL */
+            MemoCache           *memo;          /* memo函数的结果缓存，普通函数为NULL */
+            InferType           return_type;    /* 类型推断得到的返回值类型 */
+            LazyBody            *lazy;          /* 尚未分析的函数体，分析后为NULL */
+            Module              *module;        /* 导入的函数所属的模块，本文件定义的为NULL */
         } sicpy_f;       /* 原生scp函数 */
         struct {
             SCP_NativeFunctionProc      *proc;
@@ -301,6 +470,7 @@ typedef enum {
     RETURN_STATEMENT_RESULT,
     BREAK_STATEMENT_RESULT,
     CONTINUE_STATEMENT_RESULT,
+    TAIL_CALL_STATEMENT_RESULT,     /* 尾调用自身，形参已在当前环境中重新绑定 */
     STATEMENT_RESULT_TYPE_COUNT_PLUS_1
 } StatementResultType;
 
@@ -323,6 +493,84 @@ typedef struct {
 } LocalEnvironment;
 
 
+/* 错误陷阱，设置后编译错误和运行错误不再退出进程，而是记录信息后跳回设置处 */
+typedef struct {
+    jmp_buf     environment;
+    SCP_ErrorType type;
+    int         code;               /* CompileError或RuntimeError */
+    int         line_number;        /* 出错行号 */
+    char        *message;           /* 错误信息，MEM_malloc分配 */
+} ErrorTrap;
+
+/*
+ * 回卷根：执行中只由C局部变量持有的字符串和局部环境，出错跳回陷阱时由scp_unwind释放。
+ * 按后进先出压入和弹出，正常执行时由持有者自己释放
+ */
+typedef struct {
+    SCP_Value   *value;             /* 不为NULL时释放其中count个值的字符串 */
+    int         count;
+    void        *object;            /* 不为NULL时以release释放 */
+    void        (*release)(void *object);
+} UnwindRoot;
+
+#define SCP_POP_UNWIND_ROOT(inter)  ((inter)->unwind_root_count--)
+
+/* 调用栈帧，记录正在执行的sicpy函数及调用处行号 */
+typedef struct {
+    FunctionDefinition  *func;
+    int                 line_number;
+} CallFrame;
+
+typedef struct ThreadPool_tag ThreadPool;
+typedef struct GeneratorFrame_tag GeneratorFrame;
+typedef struct Profiler_tag Profiler;
+typedef struct StackSegment_tag StackSegment;
+typedef struct CompileCache_tag CompileCache;
+typedef struct Snapshot_tag Snapshot;
+
+/*
+ * 执行限制：燃料（循环的每次迭代和每次函数调用各消耗1）、执行时间和内存上限，
+ * 工作线程共享主解释器的限制
+ */
+typedef struct {
+    long                fuel_limit;         /* 0为不限制 */
+    long                fuel;               /* 剩余燃料，多个线程原子地扣减 */
+    double              time_limit;         /* 秒，0为不限制 */
+    double              deadline;           /* 开始执行时的单调时钟加上time_limit */
+    MEM_Budget          memory;             /* limit为0时不限制 */
+} ExecutionLimit;
+
+/* 循环回边和函数调用处计一个节拍，没有设置限制时只多一次判断 */
+#define SCP_LIMIT_TICK(inter, line_number) \
+    do { if ((inter)->limit) scp_limit_tick((inter), (line_number)); } while (0)
+
+/* 读入内存的源码，末尾有两个'\0'，供词法分析器直接扫描 */
+typedef struct {
+    char        *text;
+    size_t      length;
+    size_t      map_size;       /* mmap映射的大小，读入堆中时为0 */
+} SourceText;
+
+#ifdef SCP_INSTRUMENT
+typedef struct Instrument_tag Instrument;
+
+/* 插桩计时上下文，主流程和每个生成器各一个，切换出去后暂停计时 */
+typedef struct {
+    unsigned long       child_cycles;       /* 当前节点中子节点的耗时 */
+    unsigned long       paused_cycles;      /* 累计暂停的时间 */
+    unsigned long       pause_start;
+} InstrumentClock;
+
+/* 一次节点执行的计时 */
+typedef struct {
+    unsigned long       start;
+    unsigned long       saved_child;
+} InstrumentSpan;
+
+#define INSTRUMENT_EXPRESSION_KIND(type)    (type)
+#define INSTRUMENT_STATEMENT_KIND(type)     (EXPRESSION_TYPE_COUNT_PLUS_1 + (type))
+#endif /* SCP_INSTRUMENT */
+
 /* SCP解释器 */
 struct SCP_Interpreter_tag {
     MEM_Storage         interpreter_storage;    /* 解释器内存 */
@@ -331,6 +579,44 @@ struct SCP_Interpreter_tag {
     FunctionDefinition  *function_list;         /* 函数定义链表 */
     StatementList       *statement_list;        /* 语句链表 */
     int                 current_line_number;    /* 行号 */
+    struct SCP_Interpreter_tag *parent;         /* 父解释器，仅工作线程上下文非空 */
+    ThreadPool          *thread_pool;           /* pmap工作线程池，首次使用时创建 */
+    GeneratorFrame      *generator_list;        /* 挂起中的生成器帧 */
+    GeneratorFrame      *current_generator;     /* 正在执行的生成器帧 */
+    CallFrame           *call_stack;            /* sicpy函数调用栈 */
+    int                 call_stack_depth;
+    int                 call_stack_size;
+    Profiler            *profiler;              /* --profile采样分析器，仅主解释器 */
+    char                *stack_limit;           /* 当前C栈的安全下限，低于它时换到新的栈段 */
+    char                *native_stack_limit;    /* 线程自己的栈的安全下限 */
+    StackSegment        *stack_segment;         /* 最内层的栈段，在线程自己的栈上时为NULL */
+    StackSegment        *free_segments;         /* 缓存的空闲栈段 */
+    size_t              stack_segment_bytes;    /* 使用中的栈段总大小 */
+    size_t              max_stack_bytes;        /* 栈段总大小上限 */
+    JitInfo             *jit_list;              /* 已编译的函数，销毁时释放机器码 */
+    SCP_Boolean         jit_enabled;            /* 仅主解释器 */
+    unsigned long       loop_epoch;             /* 已分配的循环激活编号，仅主解释器 */
+    CompileCache        *compile_cache;         /* 预编译缓存，未设置缓存目录时为NULL */
+    SCP_Boolean         lazy;                   /* 函数体在第一次调用时才分析 */
+    SourceText          lazy_source;            /* --lazy时保留的源码，函数体指向其中 */
+    ImportList          *import_list;           /* import声明，按出现的顺序 */
+    SCP_Boolean         tree_shake;             /* 编译时摘除不可达的函数 */
+    FILE                *tree_shake_report;     /* 输出被摘除的函数，可为NULL */
+    IdentifierList      *tree_shake_removed;    /* 被摘除的函数名，按函数链表的顺序 */
+    int                 tree_shake_count;       /* 摘除前的sicpy函数个数 */
+    ExecutionLimit      *limit;                 /* 执行限制，未设置任何限制时为NULL */
+    int                 limit_clock_ticks;      /* 距下次读时钟的节拍数 */
+    UnwindRoot          *unwind_root;           /* 出错时需要释放的临时值和局部环境 */
+    int                 unwind_root_count;
+    int                 unwind_root_size;
+    SCP_Error           error;                  /* 最近一次编译或执行的错误 */
+    unsigned long       source_hash;            /* 源码的散列值，快照据此判断是否属于同一脚本 */
+    Snapshot            *snapshot;              /* 装入的快照，执行时从中恢复全局变量 */
+    char                *input;                 /* 全局变量INPUT的值，为NULL时不定义 */
+#ifdef SCP_INSTRUMENT
+    Instrument          *instrument;            /* 插桩统计，仅主解释器 */
+    InstrumentClock     *instrument_clock;      /* 当前的计时上下文 */
+#endif
 };
 
 
@@ -338,8 +624,16 @@ struct SCP_Interpreter_tag {
 void SCP_add_native_function(SCP_Interpreter *interpreter, char *name, SCP_NativeFunctionProc *proc);
 void scp_add_global_variable(SCP_Interpreter *inter, char *identifier, SCP_Value *value);
 
+/* interface.c */
+SCP_Interpreter *scp_create_worker_interpreter(SCP_Interpreter *parent);
+void scp_parse_program(SCP_Interpreter *interpreter, SourceText *source);
+
 /* create.c */
-void scp_define_function(char *identifier, ParameterList *parameter_list, Block *block);
+void scp_define_function(char *identifier, ParameterList *parameter_list, Block *block,
+                         SCP_Boolean is_memo);
+void scp_define_lazy_function(char *identifier, ParameterList *parameter_list, LazyBody *body,
+                              SCP_Boolean is_memo);
+void scp_finish_lazy_function(FunctionDefinition *func, Block *block);
 ParameterList *scp_create_one_parameter_list(char *identifier);
 ParameterList *scp_chain_parameter_list(ParameterList *list, char *identifier);
 ArgumentList *scp_create_one_argument_list(Expression *expression);
@@ -348,6 +642,9 @@ StatementList *scp_create_one_statement_list(Statement *statement);
 StatementList *scp_chain_statement_list(StatementList *list, Statement *statement);
 Expression *scp_alloc_expression(ExpressionType type);
 Expression *scp_create_assign_expression(char *variable, Expression *operand);
+Expression *scp_create_compound_assign_expression(char *variable, ExpressionType operator,
+                                                  Expression *operand);
+Expression *scp_create_increment_expression(ExpressionType type, char *variable);
 Expression *scp_create_binary_expression(ExpressionType operator,Expression *left, Expression *right);
 Expression *scp_create_minus_expression(Expression *operand);
 Expression *scp_create_function_call_expression(char *func_name, ArgumentList *argument);
@@ -355,11 +652,23 @@ IdentifierList *scp_create_global_identifier(char *identifier);
 IdentifierList *scp_chain_identifier(IdentifierList *list, char *identifier);
 Statement *scp_create_if_statement(Expression *condition,
                                     Block *then_block, Elif *elif_list,Block *else_block);
+Statement *alloc_statement(StatementType type);
+Statement *scp_create_yield_statement(Expression *expression);
+Statement *scp_create_range_for_statement(char *variable, char *function_name,
+                                          ArgumentList *argument, Block *block);
+MatchCase *scp_create_match_case(ArgumentList *labels, StatementList *statement_list);
+MatchCase *scp_chain_match_case(MatchCase *list, MatchCase *match_case);
+Statement *scp_create_match_statement(Expression *condition, MatchCase *case_list);
+void scp_check_toplevel_statement(void);
 
 /* string.c */
 void scp_add_character(int letter);
+void scp_add_string(char *str, int length);
 void scp_reset_string_buffer(void);
 char *scp_close_string(void);
+void scp_set_lex_source(char *text, size_t length, SCP_Boolean lazy);
+void scp_set_lex_function_body(char *text, int length);
+void scp_close_lex_source(void);
 
 /* execute.c */
 StatementResult scp_execute_statement_list(SCP_Interpreter *inter,
@@ -371,15 +680,29 @@ SCP_Value scp_eval_binary_expression(SCP_Interpreter *inter, LocalEnvironment *e
 SCP_Value scp_eval_minus_expression(SCP_Interpreter *inter,
                                 LocalEnvironment *env, Expression *operand);
 SCP_Value scp_eval_expression(SCP_Interpreter *inter, LocalEnvironment *env, Expression *expr);
+Variable *scp_search_assign_target(SCP_Interpreter *inter, LocalEnvironment *env,
+                                   char *identifier);
+SCP_Value scp_execute_sicpy_function(SCP_Interpreter *inter, LocalEnvironment *local_env,
+                                     FunctionDefinition *func, int line_number);
+SCP_Value scp_call_function(SCP_Interpreter *inter, FunctionDefinition *func,
+                            int arg_count, SCP_Value *args, int line_number);
+SCP_String *scp_value_to_string(SCP_Value *v);
+void scp_dispose_local_environment(LocalEnvironment *env);
+void scp_prepare_tail_call(SCP_Interpreter *inter, LocalEnvironment *env, Expression *expr);
 
 /* string_pool.c */
+void scp_refer_string(SCP_String *str);
 void scp_release_string(SCP_String *str);
+void scp_publish_string(SCP_String *str);
 SCP_String *scp_create_sicpy_string(char *str);
+SCP_String *scp_create_literal_string(char *str);
 SCP_String * alloc_scp_string(char *str, SCP_Boolean is_literal);
 
 /* util.c */
 SCP_Interpreter *scp_get_interpreter(void);
 void scp_set_current_interpreter(SCP_Interpreter *inter);
+void scp_lock_parser(void);
+void scp_unlock_parser(void);
 void *scp_malloc(size_t size);
 Variable *scp_search_local_variable(LocalEnvironment *env, char *identifier);
 Variable * scp_search_global_variable(SCP_Interpreter *inter, char *identifier);
@@ -387,10 +710,23 @@ void scp_add_local_variable(LocalEnvironment *env, char *identifier, SCP_Value *
 SCP_NativeFunctionProc * scp_search_native_function(SCP_Interpreter *inter, char *name);
 FunctionDefinition *scp_search_function(char *name);
 char *scp_get_operator_string(ExpressionType type);
+unsigned int scp_hash_string(char *str, int length);
+SCP_Boolean scp_is_in_identifier_list(IdentifierList *list, char *name);
+IdentifierList *scp_add_identifiers(IdentifierList *list, IdentifierList *ids);
+void scp_dispose_identifier_list(IdentifierList *list);
+SCP_Boolean scp_write_file(int fd, void *data, size_t size);
 
 /* error.c */
 void scp_compile_error(CompileError id, ...);
 void scp_runtime_error(int line_number, RuntimeError id, ...);
+ErrorTrap *scp_set_error_trap(ErrorTrap *trap);
+void scp_raise_error(ErrorTrap *caught);
+
+/* unwind.c */
+void scp_push_unwind_root(SCP_Interpreter *inter, SCP_Value *value, int count,
+                          void *object, void (*release)(void *object));
+void scp_unwind(SCP_Interpreter *inter);
+void scp_dispose_unwind_roots(SCP_Interpreter *inter);
 
 /* native.c */
 SCP_Value scp_nv_print_proc(SCP_Interpreter *interpreter, int arg_count, SCP_Value *args);
@@ -398,6 +734,118 @@ SCP_Value scp_nv_fopen_proc(SCP_Interpreter *interpreter, int arg_count, SCP_Val
 SCP_Value scp_nv_fclose_proc(SCP_Interpreter *interpreter, int arg_count, SCP_Value *args);
 SCP_Value scp_nv_fread_proc(SCP_Interpreter *interpreter, int arg_count, SCP_Value *args);
 SCP_Value scp_nv_fwrite_proc(SCP_Interpreter *interpreter, int arg_count, SCP_Value *args);
+SCP_Value scp_nv_pmap_proc(SCP_Interpreter *interpreter, int arg_count, SCP_Value *args);
+SCP_Value scp_nv_memo_stats_proc(SCP_Interpreter *interpreter, int arg_count, SCP_Value *args);
+SCP_Value scp_nv_snapshot_proc(SCP_Interpreter *interpreter, int arg_count, SCP_Value *args);
 void scp_add_std_fp(SCP_Interpreter *inter);
 
+/* parallel.c */
+SCP_Value scp_parallel_map(SCP_Interpreter *inter, FunctionDefinition *func,
+                           SCP_String *records, SCP_Value *context);
+void scp_dispose_thread_pool(ThreadPool *pool);
+
+/* jit.c */
+SCP_Boolean scp_jit_execute(SCP_Interpreter *inter, FunctionDefinition *func,
+                            LocalEnvironment *env, SCP_Value *result);
+void scp_dispose_jit(SCP_Interpreter *inter);
+
+/* limit.c */
+ExecutionLimit *scp_get_execution_limit(SCP_Interpreter *inter);
+void scp_start_execution_limit(SCP_Interpreter *inter);
+void scp_stop_execution_limit(SCP_Interpreter *inter);
+SCP_Boolean scp_limit_charge(SCP_Interpreter *inter, long ticks, RuntimeError *error);
+void scp_limit_tick(SCP_Interpreter *inter, int line_number);
+void scp_limit_error(SCP_Interpreter *inter, int line_number, RuntimeError error);
+
+/* stack.c */
+void scp_init_stack(SCP_Interpreter *inter, size_t max_stack_bytes);
+SCP_Value scp_call_on_stack_segment(SCP_Interpreter *inter, LocalEnvironment *env,
+                                    FunctionDefinition *func, int line_number);
+void scp_reset_stack_segments(SCP_Interpreter *inter);
+void scp_dispose_stack_segments(SCP_Interpreter *inter);
+
+/* memo.c */
+MemoCache *scp_create_memo_cache(void);
+SCP_Boolean scp_memo_lookup(FunctionDefinition *func, LocalEnvironment *env,
+                            SCP_Value *value, MemoEntry **pending);
+void scp_memo_store(FunctionDefinition *func, MemoEntry *entry, SCP_Value *value);
+void scp_memo_discard(MemoEntry *entry);
+SCP_String *scp_memo_stats(FunctionDefinition *func);
+void scp_check_memo_functions(SCP_Interpreter *inter);
+SCP_Boolean scp_is_pure_function(FunctionDefinition *func);
+void scp_dispose_memo_cache(MemoCache *cache);
+void scp_dispose_memo(SCP_Interpreter *inter);
+
+/* infer.c */
+void scp_infer_types(SCP_Interpreter *inter, FILE *dump);
+void scp_infer_function_types(SCP_Interpreter *inter, FunctionDefinition *func);
+
+/* loop.c */
+void scp_optimize_loops(SCP_Interpreter *inter);
+void scp_optimize_function_loops(SCP_Interpreter *inter, FunctionDefinition *func);
+
+/* lazy.c */
+void scp_parse_lazy_function(FunctionDefinition *func);
+void scp_compile_lazy_function(SCP_Interpreter *inter, FunctionDefinition *func);
+void scp_set_lazy_block(Block *block);
+
+/* module.c */
+void scp_add_import(Expression *path);
+void scp_import_modules(SCP_Interpreter *inter);
+
+/* shake.c */
+void scp_tree_shake(SCP_Interpreter *inter);
+void scp_report_tree_shake(SCP_Interpreter *inter, FILE *report);
+
+/* visit.c */
+void scp_visit_expression(Visitor *visitor, Expression *expr);
+void scp_visit_statement_list(Visitor *visitor, StatementList *list);
+IdentifierList *scp_collect_globals(StatementList *list, IdentifierList *globals);
+IdentifierList *scp_collect_function_globals(SCP_Interpreter *inter, IdentifierList *globals);
+
+/* source.c */
+void scp_open_source(FILE *fp, SourceText *source);
+void scp_close_source(SourceText *source);
+
+/* cache.c */
+unsigned long scp_hash_source(char *source, size_t length);
+void scp_create_compile_cache(SCP_Interpreter *inter, char *directory);
+SCP_Boolean scp_load_compile_cache(SCP_Interpreter *inter, SourceText *source);
+void scp_save_compile_cache(SCP_Interpreter *inter);
+void scp_dispose_compile_cache(SCP_Interpreter *inter);
+
+/* snapshot.c */
+void scp_write_snapshot(SCP_Interpreter *inter, char *path);
+StatementList *scp_install_snapshot(SCP_Interpreter *inter);
+void scp_dispose_snapshot(SCP_Interpreter *inter);
+
+/* batch.c */
+void scp_add_input(SCP_Interpreter *inter);
+pid_t scp_fork(void);
+int scp_run_child(SCP_Interpreter *interpreter, char *prefix);
+
+/* generator.c */
+SCP_Value scp_resume_generator(SCP_Interpreter *inter, FunctionDefinition *func,
+                               LocalEnvironment *env, int line_number);
+void scp_generator_yield(SCP_Interpreter *inter, SCP_Value *value);
+char *scp_suspended_generator_name(SCP_Interpreter *inter);
+void scp_dispose_generators(SCP_Interpreter *inter);
+
+/* profile.c */
+extern volatile sig_atomic_t scp_profile_pending;   /* 尚未记录的SIGPROF信号数 */
+Profiler *scp_create_profiler(char *script_path);
+void scp_start_profiler(Profiler *profiler);
+void scp_stop_profiler(Profiler *profiler);
+void scp_profile_sample(SCP_Interpreter *inter);
+
+#ifdef SCP_INSTRUMENT
+/* instrument.c */
+void scp_create_instrument(SCP_Interpreter *inter);
+void scp_instrument_init_clock(InstrumentClock *clock);
+InstrumentClock *scp_instrument_switch_clock(SCP_Interpreter *inter, InstrumentClock *clock);
+void scp_instrument_begin(SCP_Interpreter *inter, InstrumentSpan *span);
+void scp_instrument_end(SCP_Interpreter *inter, InstrumentSpan *span, int kind, int line_number);
+void scp_dispose_instrument(SCP_Interpreter *inter);
+#endif
+
 #endif /* PRIVATE_SICPY_H_INCLUDED */
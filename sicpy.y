@@ -14,21 +14,29 @@
     Block               *block;             /* 块，包含语句链表 */
     Elif                *elif;              /* elif表达式 */
     IdentifierList      *identifier_list;   /* 标识符链表 */
+    MatchCase           *match_case;        /* match的分支 */
+    LazyBody            *lazy_body;         /* --lazy时跳过的函数体 */
 }
 
 %token <expression>     INT_TOKEN DOUBLE_TOKEN STRING_TOKEN
 %token <identifier>     IDENTIFIER
+%token <lazy_body>      LAZY_BODY
 %token FUNCTION IF ELSE ELIF WHILE FOR RETURN_T BREAK CONTINUE NULL_T
         LP RP LC RC SEMICOLON COMMA ASSIGN LOGICAL_AND LOGICAL_OR
-        EQ NE GT GE LT LE ADD SUB MUL DIV MOD TRUE_T FALSE_T GLOBAL_T
+        EQ NE GT GE LT LE ADD SUB MUL DIV MOD
+        ADD_ASSIGN SUB_ASSIGN MUL_ASSIGN DIV_ASSIGN MOD_ASSIGN INCREMENT DECREMENT TRUE_T FALSE_T GLOBAL_T YIELD_T IN_T
+        MATCH_T CASE_T DEFAULT_T COLON MEMO_T FUNCTION_BODY_T IMPORT_T
 %type   <parameter_list> parameter_list
-%type   <argument_list> argument_list
+%type   <argument_list> argument_list match_label_list
 %type   <expression> expression expression_opt
         logical_and_expression logical_or_expression equality_expression relational_expression
         additive_expression multiplicative_expression unary_expression primary_expression
+        match_label
 %type   <statement> statement global_statement if_statement while_statement
-        for_statement return_statement break_statement continue_statement
-%type   <statement_list> statement_list
+        for_statement return_statement break_statement continue_statement yield_statement
+        match_statement
+%type   <statement_list> statement_list case_body
+%type   <match_case> match_case match_case_list
 %type   <block> block
 %type   <elif> elif elif_list
 %type   <identifier_list> identifier_list
@@ -37,26 +45,57 @@
 /* 最顶层单元 */
 translation_unit: definition_or_statement
         | translation_unit definition_or_statement
-        ;
+        | FUNCTION_BODY_T block {
+            /* --lazy时单独分析的函数体 */
+            scp_set_lazy_block($2);
+        };
 
 /* 定义或语句 */
 definition_or_statement: function_definition
+        | import_declaration
         | statement {
             SCP_Interpreter *inter = scp_get_interpreter();
+            /* yield不能出现在顶层语句中 */
+            scp_check_toplevel_statement();
             /* 传入语句，链接现有语句链表 */
             inter->statement_list = scp_chain_statement_list(inter->statement_list, $1);
         };
 
+/* 导入模块，形如import "lib.scp";，语法分析结束后再编译和合并模块的函数 */
+import_declaration: IMPORT_T STRING_TOKEN SEMICOLON {
+            scp_add_import($2);
+        };
+
 /* 函数定义 */
 function_definition: FUNCTION IDENTIFIER LP parameter_list RP block {
             /* 形如function func(a = 0){} */
             /* 传入标识符、参数链表和语句块 */
-            scp_define_function($2, $4, $6);
+            scp_define_function($2, $4, $6, SCP_FALSE);
         }
         | FUNCTION IDENTIFIER LP RP block        {
             /* 形如function func(){} */
             /* 传入标识符、空（参数链表）和语句块 */
-            scp_define_function($2, NULL, $5);
+            scp_define_function($2, NULL, $5, SCP_FALSE);
+        }
+        | MEMO_T FUNCTION IDENTIFIER LP parameter_list RP block {
+            /* 形如memo function func(a){}，缓存函数的结果 */
+            scp_define_function($3, $5, $7, SCP_TRUE);
+        }
+        | MEMO_T FUNCTION IDENTIFIER LP RP block {
+            scp_define_function($3, NULL, $6, SCP_TRUE);
+        }
+        | FUNCTION IDENTIFIER LP parameter_list RP LAZY_BODY {
+            /* --lazy时函数体被词法分析器跳过，只记录其范围 */
+            scp_define_lazy_function($2, $4, $6, SCP_FALSE);
+        }
+        | FUNCTION IDENTIFIER LP RP LAZY_BODY {
+            scp_define_lazy_function($2, NULL, $5, SCP_FALSE);
+        }
+        | MEMO_T FUNCTION IDENTIFIER LP parameter_list RP LAZY_BODY {
+            scp_define_lazy_function($3, $5, $7, SCP_TRUE);
+        }
+        | MEMO_T FUNCTION IDENTIFIER LP RP LAZY_BODY {
+            scp_define_lazy_function($3, NULL, $6, SCP_TRUE);
         };
 
 /* 参数链表 */
@@ -97,6 +136,22 @@ expression: logical_or_expression
             /* 形如a=3或a=b+3 */
             /* 传入标识符和表达式，创建新表达式 */
             $$ = scp_create_assign_expression($1, $3);
+        }
+        | IDENTIFIER ADD_ASSIGN expression {
+            /* 形如a+=3，以下复合赋值传入标识符、对应的算术运算和右边的表达式 */
+            $$ = scp_create_compound_assign_expression($1, ADD_EXPRESSION, $3);
+        }
+        | IDENTIFIER SUB_ASSIGN expression {
+            $$ = scp_create_compound_assign_expression($1, SUB_EXPRESSION, $3);
+        }
+        | IDENTIFIER MUL_ASSIGN expression {
+            $$ = scp_create_compound_assign_expression($1, MUL_EXPRESSION, $3);
+        }
+        | IDENTIFIER DIV_ASSIGN expression {
+            $$ = scp_create_compound_assign_expression($1, DIV_EXPRESSION, $3);
+        }
+        | IDENTIFIER MOD_ASSIGN expression {
+            $$ = scp_create_compound_assign_expression($1, MOD_EXPRESSION, $3);
         };
 
 /* 逻辑或表达式 */
@@ -188,6 +243,14 @@ primary_expression: IDENTIFIER LP argument_list RP {
             /* 对括号的处理 */
             $$ = $2;
         }
+        | IDENTIFIER INCREMENT {
+            /* 形如a++，值为自增前的值 */
+            $$ = scp_create_increment_expression(INCREMENT_EXPRESSION, $1);
+        }
+        | IDENTIFIER DECREMENT {
+            /* 形如a--，值为自减前的值 */
+            $$ = scp_create_increment_expression(DECREMENT_EXPRESSION, $1);
+        }
         | IDENTIFIER {
             /* 形如单个标识符 */
             Expression *exp = scp_alloc_expression(IDENTIFIER_EXPRESSION);
@@ -228,6 +291,8 @@ statement: expression SEMICOLON {
         | return_statement
         | break_statement
         | continue_statement
+        | yield_statement
+        | match_statement
         ;
 
 /* 声明全局变量语句 */
@@ -292,6 +357,7 @@ while_statement: WHILE LP expression RP block{
             Statement *st = alloc_statement(WHILE_STATEMENT);
             st->u.while_block.condition = $3;
             st->u.while_block.block = $5;
+            st->u.while_block.epoch = 0;
             $$ = st;
         };
 
@@ -303,9 +369,60 @@ for_statement: FOR LP expression_opt SEMICOLON expression_opt SEMICOLON expressi
             st->u.for_block.condition = $5;
             st->u.for_block.post = $7;
             st->u.for_block.block = $9;
+            st->u.for_block.epoch = 0;
             $$ = st;
+        }
+        | FOR LP IDENTIFIER IN_T IDENTIFIER LP argument_list RP RP block{
+            /* 形如for(i in range(0, n, 2)){} */
+            $$ = scp_create_range_for_statement($3, $5, $7, $10);
+        };
+
+/* match语句 */
+match_statement: MATCH_T LP expression RP LC match_case_list RC {
+            /* 形如match(a){case 1: ... default: ...} */
+            $$ = scp_create_match_statement($3, $6);
         };
 
+/* match的分支链表 */
+match_case_list: match_case
+        | match_case_list match_case {
+            $$ = scp_chain_match_case($1, $2);
+        };
+
+/* 单个分支，执行完不会进入下一个分支 */
+match_case: CASE_T match_label_list COLON case_body {
+            /* 形如case 1, 2: ... */
+            $$ = scp_create_match_case($2, $4);
+        }
+        | DEFAULT_T COLON case_body {
+            /* 形如default: ... */
+            $$ = scp_create_match_case(NULL, $3);
+        };
+
+/* case的常量链表 */
+match_label_list: match_label {
+            $$ = scp_create_one_argument_list($1);
+        }
+        | match_label_list COMMA match_label {
+            $$ = scp_chain_argument_list($1, $3);
+        };
+
+/* case的常量，只能是int或string */
+match_label: INT_TOKEN
+        | SUB INT_TOKEN {
+            /* 负数 */
+            $2->u.int_value = -$2->u.int_value;
+            $$ = $2;
+        }
+        | STRING_TOKEN;
+
+/* 分支的语句（可以为空） */
+case_body: /* 空 */
+        {
+            $$ = NULL;
+        }
+        | statement_list;
+
 /* for循环中的部分表达式（可以为空） */
 expression_opt: /* 空 */
         {
@@ -321,6 +438,12 @@ return_statement: RETURN_T expression_opt SEMICOLON{
             $$ = st;
         };
 
+/* yield语句 */
+yield_statement: YIELD_T expression_opt SEMICOLON{
+            /* 形如yield a; */
+            $$ = scp_create_yield_statement($2);
+        };
+
 /* break语句 */
 break_statement: BREAK SEMICOLON{
             /* 形如break; */
@@ -0,0 +1,323 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+/*
+ * 初始化后的快照：脚本在顶层执行snapshot("path")时，把此刻的全局变量写成快照文件，
+ * 记录这条语句在顶层语句中的位置。之后以--restore装入快照，执行时直接恢复全局变量，
+ * 从这条语句的下一条开始执行，跳过前面的初始化。
+ * 文件由头部、全局变量表和字符串池组成，不含指针；装入时用mmap映射，
+ * 字符串值作为字面常量直接指向映射的内存，不复制，映射保留到解释器销毁。
+ * 编译结果由预编译缓存（--cache-dir）保存；STDIN等文件指针每次执行时重新设置，
+ * 其他文件指针不能写入快照。挂起中的生成器帧的局部变量和C栈也不能写入，这时快照出错。
+ */
+
+#define SNAPSHOT_MAGIC      "SCPS"
+#define SNAPSHOT_VERSION    (1)
+
+typedef struct {
+    char            magic[4];
+    int             version;
+    unsigned long   source_hash;
+    int             statement_index;    /* snapshot()所在的顶层语句 */
+    int             global_count;
+    int             pool_size;
+} SnapshotHeader;
+
+typedef struct {
+    int             name;               /* 变量名在字符串池中的偏移 */
+    int             type;
+    union {
+        SCP_Boolean boolean_value;
+        int         int_value;
+        double      double_value;
+        int         string_value;       /* 字符串在字符串池中的偏移 */
+    } u;
+} SnapshotGlobal;
+
+struct Snapshot_tag {
+    void            *map;
+    size_t          map_size;
+    StatementList   *resume;            /* 恢复后开始执行的语句 */
+    int             global_count;
+    char            **names;
+    SCP_Value       *values;            /* 字符串为指向映射的字面常量 */
+};
+
+typedef struct {
+    char            *pool;
+    int             pool_size;
+    int             pool_alloc;
+} SnapshotWriter;
+
+static int write_string(SnapshotWriter *w, char *string)
+{
+    int length = strlen(string) + 1;
+    int offset = w->pool_size;
+
+    if (w->pool_size + length > w->pool_alloc) {
+        w->pool_alloc = (w->pool_size + length) * 2;
+        w->pool = MEM_realloc(w->pool, w->pool_alloc);
+    }
+    memcpy(w->pool + w->pool_size, string, length);
+    w->pool_size += length;
+
+    return offset;
+}
+
+/* STDIN、STDOUT和STDERR每次执行时重新设置，不写入快照 */
+static SCP_Boolean is_std_fp(SCP_Value *v)
+{
+    return v->u.native_pointer.pointer == stdin || v->u.native_pointer.pointer == stdout
+        || v->u.native_pointer.pointer == stderr;
+}
+
+/* INPUT每次执行时重新设置，不写入快照 */
+static SCP_Boolean is_input(SCP_Interpreter *inter, Variable *v)
+{
+    return inter->input && v->value.type == SCP_STRING_VALUE
+        && v->value.u.string_value->string == inter->input && !strcmp(v->name, "INPUT");
+}
+
+/* 查找正在执行的snapshot()所在的顶层语句，不是顶层的一条语句时返回-1 */
+static int search_snapshot_statement(SCP_Interpreter *inter)
+{
+    StatementList *pos;
+    Expression *expr;
+    int index;
+
+    if (inter->parent || inter->call_stack_depth > 0 || inter->current_generator)
+        return -1;
+    for (pos = inter->statement_list, index = 0; pos; pos = pos->next, index++) {
+        if (pos->statement->type != EXPRESSION_STATEMENT
+            || pos->statement->line_number != inter->current_line_number)
+            continue;
+        expr = pos->statement->u.expression_s;
+        if (expr->type == FUNCTION_CALL_EXPRESSION
+            && !strcmp(expr->u.function_call_expression.identifier, "snapshot"))
+            return index;
+    }
+    return -1;
+}
+
+/* 把全局变量写入快照文件，先写临时文件再改名 */
+void scp_write_snapshot(SCP_Interpreter *inter, char *path)
+{
+    SnapshotWriter w;
+    SnapshotHeader header;
+    SnapshotGlobal *globals;
+    Variable *pos;
+    char *temp_path;
+    SCP_Boolean ok = SCP_FALSE;
+    char *generator;
+    int index, count, fd;
+
+    index = search_snapshot_statement(inter);
+    if (index < 0) {
+        scp_runtime_error(inter->current_line_number, SNAPSHOT_POSITION_ERR,
+                          MESSAGE_ARGUMENT_END);
+    }
+    /* 恢复后生成器会从头开始，与快照前已产出的值不一致 */
+    generator = scp_suspended_generator_name(inter);
+    if (generator) {
+        scp_runtime_error(inter->current_line_number, SNAPSHOT_VALUE_ERR,
+                          STRING_MESSAGE_ARGUMENT, "name", generator, MESSAGE_ARGUMENT_END);
+    }
+    count = 0;
+    for (pos = inter->variable; pos; pos = pos->next) {
+        if (pos->value.type == SCP_NATIVE_POINTER_VALUE) {
+            if (is_std_fp(&pos->value))
+                continue;
+            scp_runtime_error(inter->current_line_number, SNAPSHOT_VALUE_ERR,
+                              STRING_MESSAGE_ARGUMENT, "name", pos->name, MESSAGE_ARGUMENT_END);
+        }
+        if (is_input(inter, pos))
+            continue;
+        count++;
+    }
+
+    memset(&w, 0, sizeof(w));
+    globals = MEM_malloc(sizeof(SnapshotGlobal) * (count > 0 ? count : 1));
+    memset(globals, 0, sizeof(SnapshotGlobal) * (count > 0 ? count : 1));
+    count = 0;
+    for (pos = inter->variable; pos; pos = pos->next) {
+        if (pos->value.type == SCP_NATIVE_POINTER_VALUE || is_input(inter, pos))
+            continue;
+        globals[count].name = write_string(&w, pos->name);
+        globals[count].type = pos->value.type;
+        switch (pos->value.type) {
+        case SCP_BOOLEAN_VALUE:
+            globals[count].u.boolean_value = pos->value.u.boolean_value;
+            break;
+        case SCP_INT_VALUE:
+            globals[count].u.int_value = pos->value.u.int_value;
+            break;
+        case SCP_DOUBLE_VALUE:
+            globals[count].u.double_value = pos->value.u.double_value;
+            break;
+        case SCP_STRING_VALUE:
+            globals[count].u.string_value = write_string(&w, pos->value.u.string_value->string);
+            break;
+        case SCP_NULL_VALUE:
+            break;
+        case SCP_NATIVE_POINTER_VALUE:
+        default:
+            DBG_panic(("bad case. type..%d\n", pos->value.type));
+        }
+        count++;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, 4);
+    header.version = SNAPSHOT_VERSION;
+    header.source_hash = inter->source_hash;
+    header.statement_index = index;
+    header.global_count = count;
+    header.pool_size = w.pool_size;
+
+    temp_path = MEM_malloc(strlen(path) + 32);
+    sprintf(temp_path, "%s.%ld.tmp", path, (long)getpid());
+    fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        ok = scp_write_file(fd, &header, sizeof(header))
+            && scp_write_file(fd, globals, sizeof(SnapshotGlobal) * count)
+            && scp_write_file(fd, w.pool, w.pool_size);
+        close(fd);
+        if (!ok || rename(temp_path, path) != 0) {
+            unlink(temp_path);
+            ok = SCP_FALSE;
+        }
+    }
+    MEM_free(temp_path);
+    MEM_free(globals);
+    MEM_free(w.pool);
+    if (!ok) {
+        scp_runtime_error(inter->current_line_number, SNAPSHOT_WRITE_ERR,
+                          STRING_MESSAGE_ARGUMENT, "path", path, MESSAGE_ARGUMENT_END);
+    }
+}
+
+/* 检查映射的快照文件，有效时在interpreter中建立快照 */
+static SCP_Boolean load_snapshot(SCP_Interpreter *inter, void *map, size_t map_size)
+{
+    SnapshotHeader *header = map;
+    SnapshotGlobal *globals;
+    Snapshot *snapshot;
+    StatementList *resume;
+    char *pool;
+    int i;
+
+    if (map_size < sizeof(SnapshotHeader) || memcmp(header->magic, SNAPSHOT_MAGIC, 4) != 0
+        || header->version != SNAPSHOT_VERSION || header->source_hash != inter->source_hash
+        || header->global_count < 0 || header->pool_size < 0
+        || map_size != sizeof(SnapshotHeader) + sizeof(SnapshotGlobal) * (size_t)header->global_count
+                       + header->pool_size
+        || (header->pool_size > 0 && ((char *)map)[map_size - 1] != '\0'))
+        return SCP_FALSE;
+    for (resume = inter->statement_list, i = 0; resume && i < header->statement_index;
+         resume = resume->next, i++)
+        ;
+    if (resume == NULL)
+        return SCP_FALSE;
+
+    globals = (SnapshotGlobal *)(header + 1);
+    pool = (char *)(globals + header->global_count);
+    for (i = 0; i < header->global_count; i++) {
+        if (globals[i].name < 0 || globals[i].name >= header->pool_size)
+            return SCP_FALSE;
+        if (globals[i].type == SCP_STRING_VALUE
+            && (globals[i].u.string_value < 0 || globals[i].u.string_value >= header->pool_size))
+            return SCP_FALSE;
+        if (globals[i].type != SCP_BOOLEAN_VALUE && globals[i].type != SCP_INT_VALUE
+            && globals[i].type != SCP_DOUBLE_VALUE && globals[i].type != SCP_STRING_VALUE
+            && globals[i].type != SCP_NULL_VALUE)
+            return SCP_FALSE;
+    }
+
+    snapshot = scp_malloc(sizeof(Snapshot));
+    snapshot->map = map;
+    snapshot->map_size = map_size;
+    snapshot->resume = resume->next;
+    snapshot->global_count = header->global_count;
+    snapshot->names = scp_malloc(sizeof(char *) * (header->global_count + 1));
+    snapshot->values = scp_malloc(sizeof(SCP_Value) * (header->global_count + 1));
+    for (i = 0; i < header->global_count; i++) {
+        snapshot->names[i] = pool + globals[i].name;
+        snapshot->values[i].type = globals[i].type;
+        switch (globals[i].type) {
+        case SCP_BOOLEAN_VALUE:
+            snapshot->values[i].u.boolean_value = globals[i].u.boolean_value;
+            break;
+        case SCP_INT_VALUE:
+            snapshot->values[i].u.int_value = globals[i].u.int_value;
+            break;
+        case SCP_DOUBLE_VALUE:
+            snapshot->values[i].u.double_value = globals[i].u.double_value;
+            break;
+        case SCP_STRING_VALUE:
+            snapshot->values[i].u.string_value
+                = scp_create_literal_string(pool + globals[i].u.string_value);
+            break;
+        default:
+            break;
+        }
+    }
+    inter->snapshot = snapshot;
+
+    return SCP_TRUE;
+}
+
+/* 装入快照，须在SCP_compile之后调用。文件不存在或不属于这个脚本时返回-1 */
+int SCP_restore_snapshot(SCP_Interpreter *interpreter, char *path)
+{
+    struct stat st;
+    void *map;
+    int fd;
+
+    scp_set_current_interpreter(interpreter);
+    scp_dispose_snapshot(interpreter);
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    if (!load_snapshot(interpreter, map, st.st_size)) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+    return 0;
+}
+
+/* 执行开始时恢复全局变量，返回开始执行的语句 */
+StatementList * scp_install_snapshot(SCP_Interpreter *inter)
+{
+    Snapshot *snapshot = inter->snapshot;
+    int i;
+
+    /* 头插法加入全局变量，倒序加入以保持写入时的顺序 */
+    for (i = snapshot->global_count - 1; i >= 0; i--) {
+        scp_add_global_variable(inter, snapshot->names[i], &snapshot->values[i]);
+    }
+    return snapshot->resume;
+}
+
+void scp_dispose_snapshot(SCP_Interpreter *inter)
+{
+    if (inter->snapshot == NULL)
+        return;
+    munmap(inter->snapshot->map, inter->snapshot->map_size);
+    inter->snapshot = NULL;
+}
@@ -0,0 +1,82 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+/*
+ * 源码的读入：词法分析器直接扫描内存中的源码，要求末尾有两个'\0'。
+ * 普通文件先映射一段比文件大的匿名内存，再把文件用MAP_FIXED映射到它的开头，
+ * 文件之后的部分为匿名页，全是0，即使文件大小恰好是页的整数倍也不会越界。
+ * 映射是私有可写的，词法分析器在单词末尾临时写入的'\0'不会写回文件。
+ * 管道、标准输入等不能映射的输入读入堆中。
+ */
+
+/* 读入堆中，末尾加两个'\0' */
+static void read_source(FILE *fp, SourceText *source)
+{
+    size_t alloc = 4096, n;
+
+    source->text = MEM_malloc(alloc);
+    source->length = 0;
+    source->map_size = 0;
+    while ((n = fread(source->text + source->length, 1, alloc - source->length - 2, fp)) > 0) {
+        source->length += n;
+        if (source->length + 2 == alloc) {
+            alloc *= 2;
+            source->text = MEM_realloc(source->text, alloc);
+        }
+    }
+    source->text[source->length] = '\0';
+    source->text[source->length + 1] = '\0';
+}
+
+/* 映射普通文件，不能映射时返回SCP_FALSE */
+static SCP_Boolean map_source(FILE *fp, SourceText *source)
+{
+    struct stat st;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t map_size;
+    void *base;
+
+    /* 已经读过一部分的文件从当前位置读，不映射 */
+    if (fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0
+        || ftell(fp) != 0)
+        return SCP_FALSE;
+    map_size = (st.st_size + 2 + page - 1) / page * page;
+    base = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return SCP_FALSE;
+    if (mmap(base, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+             fileno(fp), 0) == MAP_FAILED) {
+        munmap(base, map_size);
+        return SCP_FALSE;
+    }
+    source->text = base;
+    source->length = st.st_size;
+    source->map_size = map_size;
+
+    return SCP_TRUE;
+}
+
+/* 取得fp的全部源码 */
+void scp_open_source(FILE *fp, SourceText *source)
+{
+    if (!map_source(fp, source)) {
+        read_source(fp, source);
+    }
+}
+
+void scp_close_source(SourceText *source)
+{
+    if (source->map_size) {
+        munmap(source->text, source->map_size);
+    } else {
+        MEM_free(source->text);
+    }
+    source->text = NULL;
+}
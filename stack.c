@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+/*
+ * 分段调用栈：每次调用sicpy函数前检查当前C栈的剩余空间，不足SCP_STACK_MARGIN时
+ * 在堆上分配一个新的栈段，切换到栈段上执行这次调用。嵌套的栈段大小逐个加倍，
+ * 因此深度为n的递归只需O(log n)次分配；用完的较小栈段缓存起来，在同一深度附近反复
+ * 进出时不再分配，较大的栈段直接释放，分配它的代价已由其中的大量调用分摊。所有使用中的栈段总大小超过max_stack_bytes时报运行错误。
+ */
+
+#define STACK_SEGMENT_INITIAL_SIZE  (1024 * 1024)
+#define STACK_SEGMENT_CACHE_SIZE    (16 * 1024 * 1024)  /* 不超过该大小的栈段用完后缓存 */
+#define STACK_NATIVE_DEFAULT_SIZE   (8 * 1024 * 1024)   /* 取不到线程栈信息时假定的大小 */
+#define STACK_NATIVE_MAX_SIZE       (1024L * 1024 * 1024)
+
+struct StackSegment_tag {
+    char                *memory;
+    size_t              size;
+    ucontext_t          context;
+    ucontext_t          caller_context;
+    FunctionDefinition  *func;              /* 在栈段上执行的调用 */
+    LocalEnvironment    *env;
+    int                 line_number;
+    SCP_Value           value;
+    struct StackSegment_tag *next;          /* 使用中为外层栈段，缓存中为下一个空闲栈段 */
+};
+
+/* 根据当前线程的栈设定解释器的栈下限，在解释器所在的线程中调用 */
+void scp_init_stack(SCP_Interpreter *inter, size_t max_stack_bytes)
+{
+    pthread_attr_t attr;
+    void *stack_address = NULL;
+    size_t stack_size = 0;
+    char marker;
+
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+        pthread_attr_getstack(&attr, &stack_address, &stack_size);
+        pthread_attr_destroy(&attr);
+    }
+    /* 取不到栈信息，或者栈大小不受限制时，假定当前位置之下（栈向低地址增长）还有默认大小的空间 */
+    if (stack_address == NULL || &marker < (char *)stack_address
+        || &marker >= (char *)stack_address + stack_size
+        || &marker - (char *)stack_address > STACK_NATIVE_MAX_SIZE) {
+        stack_address = &marker - STACK_NATIVE_DEFAULT_SIZE;
+    }
+    inter->stack_limit = (char *)stack_address + SCP_STACK_MARGIN;
+    inter->native_stack_limit = inter->stack_limit;
+    inter->stack_segment = NULL;
+    inter->free_segments = NULL;
+    inter->stack_segment_bytes = 0;
+    inter->max_stack_bytes = max_stack_bytes;
+}
+
+/* 栈段的入口，执行完调用后回到切换前的栈 */
+static void segment_entry(void)
+{
+    SCP_Interpreter *inter = scp_get_interpreter();
+    StackSegment *segment = inter->stack_segment;
+
+    segment->value = scp_execute_sicpy_function(inter, segment->env, segment->func,
+                                                segment->line_number);
+    setcontext(&segment->caller_context);
+}
+
+/* 取得下一层栈段，大小为外层栈段的两倍，优先使用缓存 */
+static StackSegment * acquire_segment(SCP_Interpreter *inter, size_t size)
+{
+    StackSegment **pos;
+    StackSegment *segment;
+
+    for (pos = &inter->free_segments; *pos; pos = &(*pos)->next) {
+        if ((*pos)->size == size) {
+            segment = *pos;
+            *pos = segment->next;
+            return segment;
+        }
+    }
+    segment = MEM_malloc(sizeof(StackSegment));
+    segment->memory = MEM_malloc(size);
+    segment->size = size;
+
+    return segment;
+}
+
+/* 在新的栈段上执行sicpy函数调用 */
+SCP_Value scp_call_on_stack_segment(SCP_Interpreter *inter, LocalEnvironment *env,
+                                    FunctionDefinition *func, int line_number)
+{
+    StackSegment *segment;
+    char *old_limit;
+    size_t size;
+    SCP_Value value;
+
+    size = inter->stack_segment ? inter->stack_segment->size * 2 : STACK_SEGMENT_INITIAL_SIZE;
+    if (inter->stack_segment_bytes + size > inter->max_stack_bytes) {
+        scp_runtime_error(line_number, STACK_OVERFLOW_ERR,
+                          STRING_MESSAGE_ARGUMENT, "name", func->name,
+                          INT_MESSAGE_ARGUMENT, "limit", (int)(inter->max_stack_bytes / (1024 * 1024)),
+                          MESSAGE_ARGUMENT_END);
+    }
+    segment = acquire_segment(inter, size);
+    segment->func = func;
+    segment->env = env;
+    segment->line_number = line_number;
+
+    getcontext(&segment->context);
+    segment->context.uc_stack.ss_sp = segment->memory;
+    segment->context.uc_stack.ss_size = segment->size;
+    segment->context.uc_link = NULL;
+    makecontext(&segment->context, segment_entry, 0);
+
+    segment->next = inter->stack_segment;
+    inter->stack_segment = segment;
+    inter->stack_segment_bytes += size;
+    old_limit = inter->stack_limit;
+    inter->stack_limit = segment->memory + SCP_STACK_MARGIN;
+
+    swapcontext(&segment->caller_context, &segment->context);
+
+    inter->stack_limit = old_limit;
+    inter->stack_segment_bytes -= size;
+    inter->stack_segment = segment->next;
+    value = segment->value;
+    if (size <= STACK_SEGMENT_CACHE_SIZE) {
+        segment->next = inter->free_segments;
+        inter->free_segments = segment;
+    } else {
+        MEM_free(segment->memory);
+        MEM_free(segment);
+    }
+
+    return value;
+}
+
+static void dispose_segment_list(StackSegment *segment)
+{
+    StackSegment *next;
+
+    for (; segment; segment = next) {
+        next = segment->next;
+        MEM_free(segment->memory);
+        MEM_free(segment);
+    }
+}
+
+/* 出错跳回陷阱后释放未能退出的栈段，回到线程自己的栈 */
+void scp_reset_stack_segments(SCP_Interpreter *inter)
+{
+    dispose_segment_list(inter->stack_segment);
+    inter->stack_segment = NULL;
+    inter->stack_segment_bytes = 0;
+    inter->stack_limit = inter->native_stack_limit;
+}
+
+/* 释放缓存的栈段，以及出错时未能退出的栈段 */
+void scp_dispose_stack_segments(SCP_Interpreter *inter)
+{
+    dispose_segment_list(inter->stack_segment);
+    dispose_segment_list(inter->free_segments);
+    inter->stack_segment = NULL;
+    inter->free_segments = NULL;
+}
@@ -4,32 +4,67 @@
 #include "DBG.h"
 #include "sicpy.h"
 
+/*
+ * 引用计数采用偏向方式：字符串创建后只被当前线程持有，引用计数使用普通加减；
+ * 通过scp_publish_string发布给其他线程后，之后的引用计数改用原子操作。
+ * 字面常量不可变，整个生命周期与解释器相同，不进行引用计数。
+ */
+
 /* 分配SCP字串空间 */
 SCP_String * alloc_scp_string(char *str, SCP_Boolean is_literal)
 {
     SCP_String *scp_string = MEM_malloc(sizeof(SCP_String));
     scp_string->ref_count = 0;
     scp_string->is_literal = is_literal;
+    scp_string->is_shared = SCP_FALSE;
     scp_string->string = str;
+    scp_string->length = strlen(str);
+    scp_string->capacity = scp_string->length + 1;
     return scp_string;
 }
 
+/* 增加引用 */
+void scp_refer_string(SCP_String *str)
+{
+    if (str->is_literal)
+        return;
+    if (str->is_shared) {
+        __atomic_add_fetch(&str->ref_count, 1, __ATOMIC_RELAXED);
+    } else {
+        str->ref_count++;
+    }
+}
+
 /* 释放字串 */
 void scp_release_string(SCP_String *str)
 {
-    str->ref_count--;
+    int ref_count;
+
+    if (str->is_literal)
+        return;
+    if (str->is_shared) {
+        ref_count = __atomic_sub_fetch(&str->ref_count, 1, __ATOMIC_ACQ_REL);
+    } else {
+        ref_count = --str->ref_count;
+    }
 
     /* 断言引用计数至少应比0大 */
-    DBG_assert(str->ref_count >= 0, ("str->ref_count..%d\n", str->ref_count));
-    if (str->ref_count == 0) {
-        /* 如果不是字面常量，先释放字符数组，再释放整个字符串结构体 */
-        if (!str->is_literal) {
-            MEM_free(str->string);
-        }
+    DBG_assert(ref_count >= 0, ("str->ref_count..%d\n", ref_count));
+    if (ref_count == 0) {
+        /* 先释放字符数组，再释放整个字符串结构体 */
+        MEM_free(str->string);
         MEM_free(str);
     }
 }
 
+/* 发布字符串，之后可以被多个线程同时引用和释放，须在交给其他线程之前调用 */
+void scp_publish_string(SCP_String *str)
+{
+    if (!str->is_literal) {
+        str->is_shared = SCP_TRUE;
+    }
+}
+
 /* 创建SCP字符串 */
 SCP_String * scp_create_sicpy_string(char *str)
 {
@@ -38,3 +73,17 @@ SCP_String * scp_create_sicpy_string(char *str)
 
     return scp_string;
 }
+
+/* 创建字面常量字符串，分配在解释器内存中，随解释器一起释放 */
+SCP_String * scp_create_literal_string(char *str)
+{
+    SCP_String *scp_string = scp_malloc(sizeof(SCP_String));
+    scp_string->ref_count = 1;
+    scp_string->is_literal = SCP_TRUE;
+    scp_string->is_shared = SCP_FALSE;
+    scp_string->string = str;
+    scp_string->length = strlen(str);
+    scp_string->capacity = scp_string->length + 1;
+
+    return scp_string;
+}
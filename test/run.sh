@@ -0,0 +1,47 @@
+#!/bin/sh
+# 运行test/下的回归测试：每个有同名.out文件的.scp程序，其标准输出和标准错误须与.out一致。
+#
+# 用法: sh test/run.sh [sicpy路径]
+#   .scp的第一行形如"# args: --fuel 100"时，把其后的选项传给sicpy，
+#   选项中的@tmp@换成为这个程序新建的临时目录，程序结束后删除
+#   有"# runs: N"一行时连续执行N次（如检查预编译缓存），各次的输出依次比较
+#   程序以非0状态退出时，在输出末尾追加一行"exit N"一并比较
+#
+# 程序在仓库根目录下执行。有不一致时输出差异并以状态1退出。
+
+SICPY=${1:-./sicpy}
+SICPY="$(cd "$(dirname "$SICPY")" && pwd)/$(basename "$SICPY")"
+
+cd "$(dirname "$0")/.." || exit 1
+ACTUAL=$(mktemp)
+WORK=$(mktemp -d)
+trap 'rm -f "$ACTUAL"; rm -rf "$WORK"' EXIT
+
+passed=0
+failed=0
+for script in test/*.scp; do
+    expected=${script%.scp}.out
+    [ -f "$expected" ] || continue
+    rm -rf "$WORK"/*
+    args=$(sed -n '1s/^# args: //p' "$script" | sed "s|@tmp@|$WORK|g")
+    runs=$(sed -n 's/^# runs: //p' "$script" | head -n 1)
+    : > "$ACTUAL"
+    run=0
+    while [ $run -lt "${runs:-1}" ]; do
+        # args中的选项按空格拆开
+        "$SICPY" $args "$script" < /dev/null >> "$ACTUAL" 2>&1
+        status=$?
+        [ $status -ne 0 ] && echo "exit $status" >> "$ACTUAL"
+        run=$((run + 1))
+    done
+    if cmp -s "$expected" "$ACTUAL"; then
+        passed=$((passed + 1))
+    else
+        echo "FAIL $script"
+        diff "$expected" "$ACTUAL" | head -n 20
+        failed=$((failed + 1))
+    fi
+done
+
+echo "$passed passed, $failed failed"
+[ $failed -eq 0 ]
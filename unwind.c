@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+/*
+ * 出错回卷：运行错误经错误陷阱跳回宿主时，正在执行的各层调用来不及释放它们持有的
+ * 局部环境和临时字符串。执行中这些对象压入回卷根，正常返回时由持有者弹出并自己释放，
+ * 跳回陷阱后scp_unwind从栈顶向下释放剩下的根，并复位调用栈、栈段和生成器，
+ * 解释器可以再次执行。
+ */
+
+#define UNWIND_ROOT_INITIAL_SIZE    (64)
+
+/* 压入一个回卷根，空间不足时加倍 */
+void scp_push_unwind_root(SCP_Interpreter *inter, SCP_Value *value, int count,
+                          void *object, void (*release)(void *object))
+{
+    UnwindRoot *root;
+
+    if (inter->unwind_root_count == inter->unwind_root_size) {
+        inter->unwind_root_size = inter->unwind_root_size ? inter->unwind_root_size * 2
+                                                          : UNWIND_ROOT_INITIAL_SIZE;
+        inter->unwind_root = MEM_realloc(inter->unwind_root,
+                                         sizeof(UnwindRoot) * inter->unwind_root_size);
+    }
+    root = &inter->unwind_root[inter->unwind_root_count++];
+    root->value = value;
+    root->count = count;
+    root->object = object;
+    root->release = release;
+}
+
+/* 释放出错时还未弹出的回卷根，复位执行状态 */
+void scp_unwind(SCP_Interpreter *inter)
+{
+    UnwindRoot *root;
+    int i;
+
+    while (inter->unwind_root_count > 0) {
+        root = &inter->unwind_root[--inter->unwind_root_count];
+        if (root->value) {
+            for (i = 0; i < root->count; i++) {
+                if (root->value[i].type == SCP_STRING_VALUE) {
+                    scp_release_string(root->value[i].u.string_value);
+                }
+            }
+        }
+        if (root->object) {
+            root->release(root->object);
+        }
+    }
+    inter->call_stack_depth = 0;
+    scp_reset_stack_segments(inter);
+    scp_dispose_generators(inter);
+    inter->current_generator = NULL;
+}
+
+void scp_dispose_unwind_roots(SCP_Interpreter *inter)
+{
+    MEM_free(inter->unwind_root);
+    inter->unwind_root = NULL;
+    inter->unwind_root_count = 0;
+    inter->unwind_root_size = 0;
+}
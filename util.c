@@ -1,10 +1,42 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "MEM.h"
 #include "DBG.h"
 #include "sicpy.h"
 
-static SCP_Interpreter *st_interpreter;
+/* 当前线程的解释器，pmap工作线程各自持有自己的解释器上下文 */
+static __thread SCP_Interpreter *st_interpreter;
+
+/*
+ * 词法分析器和语法分析器使用全局状态，所有yyparse都在这个进程范围的锁中进行，
+ * 模块表也由它保护。编译模块和延迟分析函数体时会嵌套加锁，所以锁可重入
+ */
+static pthread_once_t st_parser_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t st_parser_mutex;
+
+static void init_parser_mutex(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&st_parser_mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void scp_lock_parser(void)
+{
+    pthread_once(&st_parser_once, init_parser_mutex);
+    pthread_mutex_lock(&st_parser_mutex);
+}
+
+void scp_unlock_parser(void)
+{
+    pthread_mutex_unlock(&st_parser_mutex);
+}
 
 /* 获取当前解释器*/
 SCP_Interpreter * scp_get_interpreter(void)
@@ -25,8 +57,8 @@ FunctionDefinition * scp_search_function(char *name)
     SCP_Interpreter *inter = scp_get_interpreter();
 
     for (func = inter->function_list; func; func = func->next) {
-        /* strcmp比较的两字符串，如果相等则返回0，str1<str2则返回负数，反之返回整数 */
-        if (!strcmp(func->name, name))
+        /* 标识符在词法分析时驻留，同名的通常是同一个指针，不同时再用strcmp比较 */
+        if (func->name == name || !strcmp(func->name, name))
             break;
     }
     return func;
@@ -52,7 +84,7 @@ Variable * scp_search_local_variable(LocalEnvironment *env, char *identifier)
     if (env == NULL)
         return NULL;
     for (pos = env->variable; pos; pos = pos->next) {
-        if (!strcmp(pos->name, identifier))
+        if (pos->name == identifier || !strcmp(pos->name, identifier))
             break;
     }
     if (pos == NULL) {
@@ -67,7 +99,7 @@ Variable * scp_search_global_variable(SCP_Interpreter *inter, char *identifier)
 {
     Variable    *pos;
     for (pos = inter->variable; pos; pos = pos->next) {
-        if (!strcmp(pos->name, identifier))
+        if (pos->name == identifier || !strcmp(pos->name, identifier))
             return pos;
     }
     return NULL;
@@ -147,6 +179,14 @@ char * scp_get_operator_string(ExpressionType type)
     case MINUS_EXPRESSION:
         str = "-";
         break;
+    case INCREMENT_EXPRESSION:
+        str = "++";
+        break;
+    case DECREMENT_EXPRESSION:
+        str = "--";
+        break;
+    case COMPOUND_ASSIGN_EXPRESSION:
+    case LOOP_INVARIANT_EXPRESSION:
     case FUNCTION_CALL_EXPRESSION:
     case NULL_EXPRESSION:
     case EXPRESSION_TYPE_COUNT_PLUS_1:
@@ -161,3 +201,68 @@ char * scp_get_operator_string(ExpressionType type)
 
     return str;
 }
+
+/* FNV-1a散列 */
+unsigned int scp_hash_string(char *str, int length)
+{
+    unsigned int hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < length; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+SCP_Boolean scp_is_in_identifier_list(IdentifierList *list, char *name)
+{
+    for (; list; list = list->next) {
+        if (!strcmp(list->name, name))
+            return SCP_TRUE;
+    }
+    return SCP_FALSE;
+}
+
+/* 把ids中的名字加入list，已有的不重复加入，返回新的链表头；结点用MEM_malloc分配 */
+IdentifierList * scp_add_identifiers(IdentifierList *list, IdentifierList *ids)
+{
+    IdentifierList *id, *new_id;
+
+    for (id = ids; id; id = id->next) {
+        if (!scp_is_in_identifier_list(list, id->name)) {
+            new_id = MEM_malloc(sizeof(IdentifierList));
+            new_id->name = id->name;
+            new_id->next = list;
+            list = new_id;
+        }
+    }
+    return list;
+}
+
+/* 释放scp_add_identifiers建立的链表，名字不释放 */
+void scp_dispose_identifier_list(IdentifierList *list)
+{
+    IdentifierList *next;
+
+    for (; list; list = next) {
+        next = list->next;
+        MEM_free(list);
+    }
+}
+
+/* 把size字节全部写入fd，只写入一部分时继续写剩下的，出错时返回SCP_FALSE */
+SCP_Boolean scp_write_file(int fd, void *data, size_t size)
+{
+    char *p = data;
+    ssize_t written;
+
+    while (size > 0) {
+        written = write(fd, p, size);
+        if (written <= 0)
+            return SCP_FALSE;
+        p += written;
+        size -= written;
+    }
+    return SCP_TRUE;
+}
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <string.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "sicpy.h"
+
+/*
+ * 语法树的遍历：各遍分析只需在Visitor中给出关心的节点的处理，子节点的访问在这里统一进行。
+ * 节点的处理需要在子节点之后进行时，回调自己调用scp_visit_expression再返回SCP_FALSE。
+ * match的case常量也作为表达式访问。
+ */
+
+void scp_visit_expression(Visitor *visitor, Expression *expr)
+{
+    ArgumentList *arg;
+
+    if (expr == NULL || visitor->expression == NULL)
+        return;
+    if (!visitor->expression(visitor, expr))
+        return;
+    switch (expr->type) {
+    case ASSIGN_EXPRESSION:
+        scp_visit_expression(visitor, expr->u.assign_expression.operand);
+        break;
+    case COMPOUND_ASSIGN_EXPRESSION:
+        scp_visit_expression(visitor, expr->u.compound_assign_expression.operand);
+        break;
+    case ADD_EXPRESSION:
+    case SUB_EXPRESSION:
+    case MUL_EXPRESSION:
+    case DIV_EXPRESSION:
+    case MOD_EXPRESSION:
+    case EQ_EXPRESSION:
+    case NE_EXPRESSION:
+    case GT_EXPRESSION:
+    case GE_EXPRESSION:
+    case LT_EXPRESSION:
+    case LE_EXPRESSION:
+    case LOGICAL_AND_EXPRESSION:
+    case LOGICAL_OR_EXPRESSION:
+        scp_visit_expression(visitor, expr->u.binary_expression.left);
+        scp_visit_expression(visitor, expr->u.binary_expression.right);
+        break;
+    case MINUS_EXPRESSION:
+        scp_visit_expression(visitor, expr->u.minus_expression);
+        break;
+    case FUNCTION_CALL_EXPRESSION:
+        for (arg = expr->u.function_call_expression.argument; arg; arg = arg->next) {
+            scp_visit_expression(visitor, arg->expression);
+        }
+        break;
+    case LOOP_INVARIANT_EXPRESSION:
+        scp_visit_expression(visitor, expr->u.loop_invariant->operand);
+        break;
+    case BOOLEAN_EXPRESSION:
+    case INT_EXPRESSION:
+    case DOUBLE_EXPRESSION:
+    case STRING_EXPRESSION:
+    case IDENTIFIER_EXPRESSION:
+    case INCREMENT_EXPRESSION:
+    case DECREMENT_EXPRESSION:
+    case NULL_EXPRESSION:
+        break;
+    case EXPRESSION_TYPE_COUNT_PLUS_1:
+    default:
+        DBG_panic(("bad case. type..%d\n", expr->type));
+    }
+}
+
+static void visit_statement(Visitor *visitor, Statement *st)
+{
+    Elif *elif;
+    MatchCase *match_case;
+    ArgumentList *label;
+
+    if (visitor->statement && !visitor->statement(visitor, st))
+        return;
+    switch (st->type) {
+    case EXPRESSION_STATEMENT:
+        scp_visit_expression(visitor, st->u.expression_s);
+        break;
+    case IF_STATEMENT:
+        scp_visit_expression(visitor, st->u.if_block.condition);
+        scp_visit_statement_list(visitor, st->u.if_block.then_block->statement_list);
+        for (elif = st->u.if_block.elif_list; elif; elif = elif->next) {
+            scp_visit_expression(visitor, elif->condition);
+            scp_visit_statement_list(visitor, elif->block->statement_list);
+        }
+        if (st->u.if_block.else_block) {
+            scp_visit_statement_list(visitor, st->u.if_block.else_block->statement_list);
+        }
+        break;
+    case WHILE_STATEMENT:
+        scp_visit_expression(visitor, st->u.while_block.condition);
+        scp_visit_statement_list(visitor, st->u.while_block.block->statement_list);
+        break;
+    case FOR_STATEMENT:
+        scp_visit_expression(visitor, st->u.for_block.init);
+        scp_visit_expression(visitor, st->u.for_block.condition);
+        scp_visit_expression(visitor, st->u.for_block.post);
+        scp_visit_statement_list(visitor, st->u.for_block.block->statement_list);
+        break;
+    case RANGE_FOR_STATEMENT:
+        scp_visit_expression(visitor, st->u.range_for_block.start);
+        scp_visit_expression(visitor, st->u.range_for_block.end);
+        scp_visit_expression(visitor, st->u.range_for_block.step);
+        scp_visit_statement_list(visitor, st->u.range_for_block.block->statement_list);
+        break;
+    case MATCH_STATEMENT:
+        scp_visit_expression(visitor, st->u.match_block.condition);
+        for (match_case = st->u.match_block.case_list; match_case;
+             match_case = match_case->next) {
+            for (label = match_case->labels; label; label = label->next) {
+                scp_visit_expression(visitor, label->expression);
+            }
+            scp_visit_statement_list(visitor, match_case->block->statement_list);
+        }
+        break;
+    case RETURN_STATEMENT:
+        scp_visit_expression(visitor, st->u.return_expression);
+        break;
+    case YIELD_STATEMENT:
+        scp_visit_expression(visitor, st->u.yield_expression);
+        break;
+    case GLOBAL_STATEMENT:
+    case BREAK_STATEMENT:
+    case CONTINUE_STATEMENT:
+        break;
+    case STATEMENT_TYPE_COUNT_PLUS_1:
+    default:
+        DBG_panic(("bad case...%d", st->type));
+    }
+}
+
+void scp_visit_statement_list(Visitor *visitor, StatementList *list)
+{
+    StatementList *pos;
+
+    for (pos = list; pos; pos = pos->next) {
+        visit_statement(visitor, pos->statement);
+    }
+}
+
+/* ---------------------------------------------------------------- global声明 */
+
+static SCP_Boolean collect_global_statement(Visitor *visitor, Statement *st)
+{
+    if (st->type == GLOBAL_STATEMENT) {
+        visitor->data = scp_add_identifiers(visitor->data, st->u.global_identifier_list);
+    }
+    return SCP_TRUE;
+}
+
+/* 把语句链表中（包括内层块中）global语句声明的名字加入globals，返回新的链表头 */
+IdentifierList * scp_collect_globals(StatementList *list, IdentifierList *globals)
+{
+    Visitor visitor;
+
+    visitor.statement = collect_global_statement;
+    visitor.expression = NULL;
+    visitor.data = globals;
+    scp_visit_statement_list(&visitor, list);
+
+    return visitor.data;
+}
+
+/* 收集所有sicpy函数中声明为global的名字，尚未分析的函数体使用词法分析时记录的名字 */
+IdentifierList * scp_collect_function_globals(SCP_Interpreter *inter, IdentifierList *globals)
+{
+    FunctionDefinition *func;
+
+    for (func = inter->function_list; func; func = func->next) {
+        if (func->type != SICPY_FUNCTION_DEFINITION)
+            continue;
+        if (func->u.sicpy_f.lazy) {
+            globals = scp_add_identifiers(globals, func->u.sicpy_f.lazy->globals);
+        } else {
+            globals = scp_collect_globals(func->u.sicpy_f.block->statement_list, globals);
+        }
+    }
+    return globals;
+}